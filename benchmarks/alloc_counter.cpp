@@ -0,0 +1,31 @@
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+#include "alloc_counter.hpp"
+
+static std::atomic<uint64_t> gAllocCount(0);
+
+uint64_t
+AllocCounter::getCount() {
+    return gAllocCount.load(std::memory_order_relaxed);
+}
+
+void*
+operator new(std::size_t size) {
+    gAllocCount.fetch_add(1, std::memory_order_relaxed);
+    void* ret = std::malloc(size == 0 ? 1 : size);
+    if (ret == nullptr)
+        throw std::bad_alloc();
+    return ret;
+}
+
+void
+operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Counts calls to global operator new in all threads.
+ * */
+class AllocCounter {
+    public:
+        static uint64_t getCount();
+};
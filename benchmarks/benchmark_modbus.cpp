@@ -0,0 +1,27 @@
+#include "benchmark_modbus.hpp"
+
+constexpr int BenchmarkModbusContext::ObjectsPerSlave;
+
+BenchmarkModbusContext::BenchmarkModbusContext(LatencyRecorder& recorder) : mRecorder(recorder) {
+    int slaveCount = (recorder.getObjectCount() + ObjectsPerSlave - 1) / ObjectsPerSlave;
+    for(int i = 1; i <= slaveCount; i++) {
+        Slave& slave(getSlave(i));
+        slave.mReadTime = std::chrono::milliseconds::zero();
+    }
+}
+
+std::vector<uint16_t>
+BenchmarkModbusContext::readModbusRegisters(int slaveId, modmqttd::RegisterType regType, int firstRegister, int count) {
+    std::vector<uint16_t> values(MockedModbusContext::readModbusRegisters(slaveId, regType, firstRegister, count));
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    // change all values, so every read is published
+    mGeneration++;
+    int firstObject = (slaveId - 1) * ObjectsPerSlave + firstRegister - 1;
+    for(int i = 0; i < count; i++) {
+        values[i] += mGeneration;
+        if (firstObject + i < mRecorder.getObjectCount())
+            mRecorder.setReadTime(firstObject + i, now);
+    }
+    return values;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+
+#include "unittests/mockedmodbuscontext.hpp"
+#include "latency_recorder.hpp"
+
+/**
+ * Mocked modbus context with zero read latency.
+ *
+ * Every read returns new values, so every poll ends with
+ * a state publish. Object with index N is mapped to register
+ * N % ObjectsPerSlave + 1 on slave N / ObjectsPerSlave + 1.
+ * */
+class BenchmarkModbusContext : public MockedModbusContext {
+    public:
+        static constexpr int ObjectsPerSlave = 10000;
+
+        BenchmarkModbusContext(LatencyRecorder& recorder);
+        virtual std::vector<uint16_t> readModbusRegisters(int slaveId, modmqttd::RegisterType regType, int firstRegister, int count);
+    private:
+        LatencyRecorder& mRecorder;
+        uint16_t mGeneration = 0;
+};
+
+class BenchmarkModbusFactory : public modmqttd::IModbusFactory {
+    public:
+        BenchmarkModbusFactory(LatencyRecorder& recorder) : mRecorder(recorder) {}
+        virtual std::shared_ptr<modmqttd::IModbusContext> getContext(const modmqttd::ModbusNetworkConfig&) {
+            return std::shared_ptr<modmqttd::IModbusContext>(new BenchmarkModbusContext(mRecorder));
+        }
+    private:
+        LatencyRecorder& mRecorder;
+};
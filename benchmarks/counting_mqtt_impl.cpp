@@ -0,0 +1,32 @@
+#include <cstring>
+#include <cstdlib>
+
+#include "counting_mqtt_impl.hpp"
+#include "libmodmqttsrv/mqttclient.hpp"
+
+void
+CountingMqttImpl::connect(const modmqttd::MqttBrokerConfig&) {
+    mOwner->onConnect();
+}
+
+void
+CountingMqttImpl::reconnect() {
+    mOwner->onConnect();
+}
+
+void
+CountingMqttImpl::disconnect() {
+    mOwner->onDisconnect();
+}
+
+void
+CountingMqttImpl::publish(const char* topic, int, const void*, const modmqttd::MqttPublishProps&) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    // benchmark topics are o<object index>/state
+    char* end;
+    long idx = std::strtol(topic + 1, &end, 10);
+    if (std::strcmp(end, "/state") != 0 || idx < 0 || idx >= mRecorder.getObjectCount())
+        return;
+    mPublishCount.fetch_add(1, std::memory_order_relaxed);
+    mRecorder.published(idx, now);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+
+#include "libmodmqttsrv/imqttimpl.hpp"
+#include "latency_recorder.hpp"
+
+/**
+ * Mqtt implementation that always stays connected
+ * and only counts published state messages.
+ * */
+class CountingMqttImpl : public modmqttd::IMqttImpl {
+    public:
+        CountingMqttImpl(LatencyRecorder& recorder) : mRecorder(recorder) {}
+
+        virtual void init(modmqttd::MqttClient* owner, const char*) { mOwner = owner; }
+        virtual void connect(const modmqttd::MqttBrokerConfig&);
+        virtual void reconnect();
+        virtual void disconnect();
+        virtual void stop() {}
+
+        virtual void subscribe(const char*, int) {}
+        virtual void publish(const char* topic, int len, const void* data, const modmqttd::MqttPublishProps& props);
+
+        virtual void on_disconnect(int) {}
+        virtual void on_connect(int) {}
+        virtual void on_log(int, const char*) {}
+
+        uint64_t getPublishCount() const { return mPublishCount.load(std::memory_order_relaxed); }
+    private:
+        modmqttd::MqttClient* mOwner = nullptr;
+        LatencyRecorder& mRecorder;
+        std::atomic<uint64_t> mPublishCount { 0 };
+};
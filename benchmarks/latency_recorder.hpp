@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Measures time from modbus read to mqtt publish of mqtt object.
+ *
+ * Read times are set from modbus threads. Publish times
+ * are recorded from the single MqttPublisher thread, so
+ * samples are not locked.
+ * */
+class LatencyRecorder {
+    public:
+        LatencyRecorder(int objectCount, std::size_t maxSamples)
+            : mObjectCount(objectCount), mReadTime(new std::atomic<int64_t>[objectCount]())
+        {
+            mSamples.reserve(maxSamples);
+        }
+
+        int getObjectCount() const { return mObjectCount; }
+
+        void setReadTime(int objectIdx, const std::chrono::steady_clock::time_point& time) {
+            mReadTime[objectIdx].store(time.time_since_epoch().count(), std::memory_order_relaxed);
+        }
+
+        void published(int objectIdx, const std::chrono::steady_clock::time_point& time) {
+            if (!mRecording || mSamples.size() == mSamples.capacity())
+                return;
+            int64_t readTime = mReadTime[objectIdx].load(std::memory_order_relaxed);
+            if (readTime != 0)
+                mSamples.push_back(time.time_since_epoch().count() - readTime);
+        }
+
+        void setRecording(bool flag) { mRecording = flag; }
+
+        // returns latency in microseconds, 0 < percent <= 100
+        double getPercentile(double percent) {
+            if (mSamples.empty())
+                return 0;
+            std::size_t idx = std::min(mSamples.size() - 1, std::size_t(mSamples.size() * percent / 100));
+            std::nth_element(mSamples.begin(), mSamples.begin() + idx, mSamples.end());
+            return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+                std::chrono::steady_clock::duration(mSamples[idx])
+            ).count();
+        }
+    private:
+        int mObjectCount;
+        std::unique_ptr<std::atomic<int64_t>[]> mReadTime;
+        std::atomic<bool> mRecording { false };
+        std::vector<int64_t> mSamples;
+};
@@ -0,0 +1,147 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <boost/program_options.hpp>
+
+#include "libmodmqttsrv/modmqtt.hpp"
+#include "alloc_counter.hpp"
+#include "benchmark_modbus.hpp"
+#include "counting_mqtt_impl.hpp"
+#include "latency_recorder.hpp"
+
+namespace args = boost::program_options;
+using namespace std;
+
+static string
+getConverter(const string& mix, int objectIdx) {
+    static const char* converters[] = { "", "std.divide(10,2)", "expr.evaluate(\"R0 * 2\")" };
+    if (mix == "raw")
+        return converters[0];
+    if (mix == "divide")
+        return converters[1];
+    if (mix == "expr")
+        return converters[2];
+    if (mix == "mixed")
+        return converters[objectIdx % 3];
+    throw invalid_argument("Unknown converter mix " + mix);
+}
+
+static string
+createConfig(int objectCount, int refreshMsec, const string& mix) {
+    ostringstream out;
+    out << "modmqttd:\n"
+        << "  converter_plugins:\n"
+        << "    - stdconv.so\n";
+    if (mix == "expr" || mix == "mixed")
+        out << "    - exprconv.so\n";
+    out << "modbus:\n"
+        << "  networks:\n"
+        << "    - name: bench\n"
+        << "      address: localhost\n"
+        << "      port: 501\n"
+        << "mqtt:\n"
+        << "  client_id: benchmark\n"
+        << "  refresh: " << refreshMsec << "ms\n"
+        << "  broker:\n"
+        << "    host: localhost\n"
+        << "  objects:\n";
+    for(int i = 0; i < objectCount; i++) {
+        int slave = i / BenchmarkModbusContext::ObjectsPerSlave + 1;
+        int reg = i % BenchmarkModbusContext::ObjectsPerSlave + 1;
+        out << "    - topic: o" << i << "\n"
+            << "      state:\n"
+            << "        register: bench." << slave << "." << reg << "\n"
+            << "        register_type: input\n";
+        string converter = getConverter(mix, i);
+        if (!converter.empty())
+            out << "        converter: '" << converter << "'\n";
+    }
+    return out.str();
+}
+
+int main(int ac, char* av[]) {
+    int objectCount;
+    int refreshMsec;
+    double warmupSec;
+    double durationSec;
+    int maxSamples;
+    string mix;
+    vector<string> converterPaths;
+
+    args::options_description desc("Measures registers/second, read to publish latency and allocations per update");
+    desc.add_options()
+        ("help", "produce help message")
+        ("objects", args::value<int>(&objectCount)->default_value(1000), "number of mqtt objects, each with a single register")
+        ("refresh", args::value<int>(&refreshMsec)->default_value(100), "register refresh in milliseconds")
+        ("converter", args::value<string>(&mix)->default_value("raw"), "converter mix: raw, divide, expr or mixed")
+        ("warmup", args::value<double>(&warmupSec)->default_value(1), "seconds to run before measurement")
+        ("duration", args::value<double>(&durationSec)->default_value(5), "measurement time in seconds")
+        ("max-samples", args::value<int>(&maxSamples)->default_value(1000000), "max number of latency samples")
+        ("converter-path", args::value<vector<string>>(&converterPaths)->default_value({"../stdconv", "../exprconv"}, "../stdconv ../exprconv"),
+            "converter plugin search path")
+    ;
+
+    args::variables_map vm;
+    try {
+        args::store(args::parse_command_line(ac, av, desc), vm);
+        args::notify(vm);
+    } catch (const exception& ex) {
+        cerr << ex.what() << endl << desc << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help")) {
+        cout << desc << endl;
+        return EXIT_SUCCESS;
+    }
+
+    modmqttd::Log::init_logging(modmqttd::Log::severity::error);
+
+    LatencyRecorder recorder(objectCount, maxSamples);
+    shared_ptr<CountingMqttImpl> mqtt(new CountingMqttImpl(recorder));
+
+    modmqttd::ModMqtt server;
+    server.setModbusContextFactory(shared_ptr<modmqttd::IModbusFactory>(new BenchmarkModbusFactory(recorder)));
+    server.setMqttImplementation(mqtt);
+    for(vector<string>::const_iterator it = converterPaths.begin(); it != converterPaths.end(); it++)
+        server.addConverterPath(*it);
+
+    try {
+        auto initStart = chrono::steady_clock::now();
+        server.init(YAML::Load(createConfig(objectCount, refreshMsec, mix)));
+        auto initEnd = chrono::steady_clock::now();
+        cout << "init: " << chrono::duration_cast<chrono::milliseconds>(initEnd - initStart).count() << "ms" << endl;
+    } catch (const exception& ex) {
+        cerr << "Initialization failed: " << ex.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    thread serverThread([&server]() { server.start(); });
+
+    this_thread::sleep_for(chrono::duration<double>(warmupSec));
+
+    uint64_t startPublishes = mqtt->getPublishCount();
+    uint64_t startAllocs = AllocCounter::getCount();
+    recorder.setRecording(true);
+    auto start = chrono::steady_clock::now();
+
+    this_thread::sleep_for(chrono::duration<double>(durationSec));
+
+    recorder.setRecording(false);
+    auto end = chrono::steady_clock::now();
+    uint64_t publishes = mqtt->getPublishCount() - startPublishes;
+    uint64_t allocs = AllocCounter::getCount() - startAllocs;
+
+    server.stop();
+    serverThread.join();
+
+    double seconds = chrono::duration<double>(end - start).count();
+    cout << "objects: " << objectCount << ", refresh: " << refreshMsec << "ms, converter: " << mix << endl;
+    cout << "updates: " << publishes << " in " << seconds << "s" << endl;
+    cout << "registers/s: " << publishes / seconds << endl;
+    cout << "latency p50: " << recorder.getPercentile(50) << "us" << endl;
+    cout << "latency p99: " << recorder.getPercentile(99) << "us" << endl;
+    cout << "allocations/update: " << (publishes != 0 ? double(allocs) / publishes : 0) << endl;
+    return EXIT_SUCCESS;
+}
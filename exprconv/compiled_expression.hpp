@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <exprtk.hpp>
+#include "libmodmqttconv/convexception.hpp"
+#include "libmodmqttconv/modbusregisters.hpp"
+
+/**
+ * Expression compiled with its own register variables.
+ *
+ * exprtk reads variables through references bound at compile time,
+ * so a compiled expression cannot be evaluated by two threads at once.
+ * Every thread gets its own instance for each source text, all
+ * converters with the same expression share it.
+ * */
+class CompiledExpression {
+    public:
+        static const int MAX_REGISTERS = 10;
+
+        /**
+         * Returns expression compiled for calling thread.
+         * Expression is compiled on first use in a thread.
+         * */
+        static CompiledExpression& forThread(const std::string& source) {
+            static thread_local std::unordered_map<std::string, std::unique_ptr<CompiledExpression>> cache;
+
+            auto it = cache.find(source);
+            if (it == cache.end()) {
+                std::unique_ptr<CompiledExpression> expr(new CompiledExpression(source));
+                it = cache.emplace(source, std::move(expr)).first;
+            }
+            return *it->second;
+        }
+
+        double evaluate(const RegisterSpan& data) {
+            if (data.getCount() > MAX_REGISTERS)
+                throw ConvException("Maximum " + std::to_string(MAX_REGISTERS) + " registers allowed");
+
+            for(int i = 0; i < data.getCount(); i++)
+                mValues[i] = data.getValue(i);
+            return mExpression.value();
+        }
+
+        CompiledExpression(const CompiledExpression&) = delete;
+    private:
+        CompiledExpression(const std::string& source) : mValues(MAX_REGISTERS, 0) {
+            mSymbolTable.add_constants();
+
+            for(std::size_t i = 0; i < mValues.size(); i++)
+                mSymbolTable.add_variable("R" + std::to_string(i), mValues[i], false);
+
+            mExpression.register_symbol_table(mSymbolTable);
+            exprtk::parser<double> parser;
+            if (!parser.compile(source, mExpression))
+                throw ConvException("Cannot compile expression " + source);
+        }
+
+        exprtk::symbol_table<double> mSymbolTable;
+        exprtk::expression<double> mExpression;
+        // variables R0..R9 bound to expression
+        std::vector<double> mValues;
+};
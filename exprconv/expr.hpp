@@ -1,45 +1,32 @@
 #pragma once
 
-#include <exprtk.hpp>
+#include <cmath>
+
 #include "libmodmqttconv/convexception.hpp"
 #include "libmodmqttconv/converter.hpp"
+#include "compiled_expression.hpp"
 
-class ExprtkConverter : public IStateConverter {
+class ExprtkConverter : public IStateConverterV2 {
     public:
-        static const int MAX_REGISTERS = 10;
-
-        ExprtkConverter() : mValues(MAX_REGISTERS, 0) {}
+        static const int MAX_REGISTERS = CompiledExpression::MAX_REGISTERS;
 
-        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
+            double ret = CompiledExpression::forThread(mSource).evaluate(data);
 
-            if (data.getCount() > MAX_REGISTERS)
-                throw new ConvException("Maximum " +std::to_string(MAX_REGISTERS) + " registers allowed");
-
-            for(int i = 0; i < data.getCount(); i++) {
-                mValues[i] =  data.getValue(i);
+            if (precision == 0) {
+                out.setInt(ret);
+                return;
             }
 
-            double ret = mExpression.value();
-
-            if (precision == 0)
-                return MqttValue::fromInt(ret);
-
             if (precision != -1)
                 ret = round(ret, precision);
-            return MqttValue::fromDouble(ret);
+            out.setDouble(ret);
         }
 
         virtual void setArgs(const std::vector<std::string>& args) {
-            mSymbolTable.add_constants();
-
-            char buf[8];
-            for(int i = 0; i < mValues.size(); i++) {
-                sprintf(buf, "R%d", i);
-                mSymbolTable.add_variable(buf, mValues[i], false);
-            }
-
-            mExpression.register_symbol_table(mSymbolTable);
-            mParser.compile(getArg(0, args), mExpression);
+            mSource = getArg(0, args);
+            // compile in configuration thread to report errors early
+            CompiledExpression::forThread(mSource);
 
             if (args.size() == 2)
                 precision = getIntArg(1, args);
@@ -47,10 +34,7 @@ class ExprtkConverter : public IStateConverter {
 
         virtual ~ExprtkConverter() {}
     private:
-        exprtk::symbol_table<double> mSymbolTable;
-        exprtk::parser<double> mParser;
-        exprtk::expression<double> mExpression;
-        mutable std::vector<double> mValues;
+        std::string mSource;
         int precision = -1;
 
         static double round(double val, int decimal_digits) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 
 #include <vector>
@@ -72,3 +73,97 @@ class IStateConverter : public ConverterBase {
     public:
         virtual MqttValue toMqtt(const ModbusRegisters& data) const = 0;
 };
+
+/**
+ * Receives converted value. Implemented by modmqttd to write
+ * value directly to mqtt payload or JSON document.
+ * */
+class IMqttValueSink {
+    public:
+        virtual void setInt(int32_t val) = 0;
+        virtual void setDouble(double val) = 0;
+        virtual void setString(const char* data, size_t len) = 0;
+
+        void setValue(const MqttValue& val) {
+            switch(val.getSourceType()) {
+                case MqttValue::SourceType::INT:
+                    setInt(val.getInt());
+                    break;
+                case MqttValue::SourceType::DOUBLE:
+                    setDouble(val.getDouble());
+                    break;
+                case MqttValue::SourceType::BINARY:
+                    setString(static_cast<const char*>(val.getBinaryPtr()), val.getBinarySize());
+                    break;
+            }
+        }
+
+        virtual ~IMqttValueSink() {}
+};
+
+/**
+ * Converter interface version 2
+ *
+ * Registers are passed as a view of buffer owned by caller
+ * and result is written to sink, so conversion does not need
+ * to allocate memory.
+ *
+ * Plugins can return both IStateConverter and IStateConverterV2
+ * from ConverterPlugin::getStateConverter(). modmqttd wraps
+ * IStateConverter with an adapter.
+ * */
+class IStateConverterV2 : public IStateConverter {
+    public:
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const = 0;
+
+        /**
+         * Converts every register in data as a separate single
+         * register value. out must have data.getCount() elements.
+         *
+         * Used for lists of registers with the same converter.
+         * Default implementation calls convert() for every register.
+         * */
+        virtual void convertBatch(const RegisterSpan& data, MqttValue* out) const {
+            for(int i = 0; i < data.getCount(); i++) {
+                ValueSink sink(out[i]);
+                convert(RegisterSpan(data.begin() + i, 1), sink);
+            }
+        }
+
+        // legacy interface implemented with convert()
+        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
+            MqttValue ret;
+            ValueSink sink(ret);
+            convert(RegisterSpan(data), sink);
+            return ret;
+        }
+    protected:
+        /**
+         * Helper for convertBatch() implementations.
+         * Values are computed into a stack buffer first, so compiler
+         * can vectorize loop over fn without MqttValue type handling.
+         * */
+        template <typename T, typename F>
+        static void convertEach(const RegisterSpan& data, MqttValue* out, F&& fn) {
+            static const int CHUNK_SIZE = 64;
+            T values[CHUNK_SIZE];
+            for(int start = 0; start < data.getCount(); start += CHUNK_SIZE) {
+                int count = std::min(CHUNK_SIZE, data.getCount() - start);
+                const uint16_t* registers = data.begin() + start;
+                for(int i = 0; i < count; i++)
+                    values[i] = fn(registers[i]);
+                for(int i = 0; i < count; i++)
+                    out[start + i] = MqttValue(values[i]);
+            }
+        }
+    private:
+        class ValueSink : public IMqttValueSink {
+            public:
+                ValueSink(MqttValue& value) : mValue(value) {}
+                virtual void setInt(int32_t val) { mValue.setInt(val); }
+                virtual void setDouble(double val) { mValue.setDouble(val); }
+                virtual void setString(const char* data, size_t len) { mValue.setBinary(data, len); }
+            private:
+                MqttValue& mValue;
+        };
+};
@@ -11,6 +11,26 @@ class ModbusRegisters {
         uint16_t getValue(int idx) const { return mRegisters[idx]; }
         void setValue(int idx, uint16_t val) { mRegisters[idx] = val; }
         void addValue(uint16_t val) { mRegisters.push_back(val); }
+        const uint16_t* getData() const { return mRegisters.data(); }
     private:
         std::vector<uint16_t> mRegisters;
 };
+
+/**
+ * Read-only view of consecutive register values.
+ *
+ * Buffer is owned by caller and must be valid
+ * as long as the view is used.
+ * */
+class RegisterSpan {
+    public:
+        RegisterSpan(const uint16_t* data, int count) : mData(data), mCount(count) {}
+        RegisterSpan(const ModbusRegisters& registers) : mData(registers.getData()), mCount(registers.getCount()) {}
+        int getCount() const { return mCount; }
+        uint16_t getValue(int idx) const { return mData[idx]; }
+        const uint16_t* begin() const { return mData; }
+        const uint16_t* end() const { return mData + mCount; }
+    private:
+        const uint16_t* mData;
+        int mCount;
+};
@@ -1,10 +1,10 @@
 #pragma once
 
+#include <charconv>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
-#include <variant>
 #include <string>
-#include <sstream>
 #include <limits>
 
 class MqttValue {
@@ -18,6 +18,12 @@ class MqttValue {
             BINARY = 2
         } SourceType;
 
+        // binary values shorter than this are stored without allocation
+        static constexpr size_t SmallBufferSize = 32;
+
+        // buffer size for toChars() that is enough for any int or double value
+        static constexpr size_t MaxCharsLength = std::numeric_limits<double>::max_exponent10 + 20;
+
         static MqttValue fromInt(int val) {
             return MqttValue(val);
         }
@@ -26,6 +32,16 @@ class MqttValue {
             return MqttValue(val);
         }
 
+        static MqttValue fromBinary(const void* data, size_t size) {
+            MqttValue ret;
+            ret.setBinary(data, size);
+            return ret;
+        }
+
+        MqttValue() {
+            setInt(0);
+        }
+
         MqttValue(int val) {
             setInt(val);
         }
@@ -34,30 +50,108 @@ class MqttValue {
             setDouble(val);
         }
 
+        MqttValue(const MqttValue& other) {
+            copyFrom(other);
+        }
+
+        MqttValue(MqttValue&& other) noexcept {
+            moveFrom(other);
+        }
+
+        MqttValue& operator=(const MqttValue& other) {
+            if (this != &other) {
+                release();
+                copyFrom(other);
+            }
+            return *this;
+        }
+
+        MqttValue& operator=(MqttValue&& other) noexcept {
+            if (this != &other) {
+                release();
+                moveFrom(other);
+            }
+            return *this;
+        }
+
         void setString(const char* val) {
-            size_t len = strlen(val);
-            mValue.binary = (char*)malloc(len);
-            memcpy(mValue.binary, val, len);
+            setBinary(val, strlen(val));
         }
-        void setDouble(double val) { mValue.v_double = val, mType = SourceType::DOUBLE; }
-        void setInt(int32_t val) { mValue.v_int = val, mType = SourceType::INT; }
+
+        void setBinary(const void* data, size_t size) {
+            release();
+            char* buf = mSmallBuffer;
+            if (size >= SmallBufferSize) {
+                buf = new char[size + 1];
+                mValue.heap = buf;
+            }
+            memcpy(buf, data, size);
+            // terminated for strtod and strtol
+            buf[size] = '\0';
+            mBinarySize = size;
+            mType = SourceType::BINARY;
+        }
+
+        void setDouble(double val) { release(); mValue.v_double = val, mType = SourceType::DOUBLE; }
+        void setInt(int32_t val) { release(); mValue.v_int = val, mType = SourceType::INT; }
 
         std::string getString() const {
             switch(mType) {
                 case SourceType::BINARY:
-                    return std::string(static_cast<const char*>(mValue.binary), mBinarySize);
+                    return std::string(getBinaryData(), mBinarySize);
                 case SourceType::INT:
-                    return std::to_string(mValue.v_int);
                 case SourceType::DOUBLE:
-                    return double_to_string(mValue.v_double);
+                    char buf[MaxCharsLength];
+                    return std::string(buf, toChars(buf, buf + sizeof(buf)));
             }
             return std::string();
         }
 
+        /**
+         * Writes value as text to [first, last) without allocation.
+         * Doubles are written with up to six decimal digits
+         * without trailing zeros.
+         * Returns pointer past the last written character
+         * or nullptr if buffer is too small.
+         * */
+        char* toChars(char* first, char* last) const {
+            switch(mType) {
+                case SourceType::BINARY:
+                    if (last - first < (ptrdiff_t)mBinarySize)
+                        return nullptr;
+                    memcpy(first, getBinaryData(), mBinarySize);
+                    return first + mBinarySize;
+                case SourceType::INT:
+                    return toChars(first, last, mValue.v_int);
+                case SourceType::DOUBLE:
+                    return toChars(first, last, mValue.v_double);
+            }
+            return nullptr;
+        }
+
+        static char* toChars(char* first, char* last, int32_t val) {
+            std::to_chars_result res = std::to_chars(first, last, val);
+            return res.ec == std::errc() ? res.ptr : nullptr;
+        }
+
+        static char* toChars(char* first, char* last, double val) {
+            // the same digits as std::to_string()
+            std::to_chars_result res = std::to_chars(first, last, val, std::chars_format::fixed, 6);
+            if (res.ec != std::errc())
+                return nullptr;
+            char* end = res.ptr;
+            // fixed format always has a decimal point
+            while(end[-1] == '0')
+                end--;
+            if (end[-1] == '.')
+                end--;
+            return end;
+        }
+
         double getDouble() const {
             switch(mType) {
                 case SourceType::BINARY:
-                    return std::strtod(static_cast<const char*>(mValue.binary), nullptr);
+                    return std::strtod(getBinaryData(), nullptr);
                 case SourceType::INT:
                     return mValue.v_int;
                 case SourceType::DOUBLE:
@@ -69,7 +163,7 @@ class MqttValue {
         int32_t getInt() const {
             switch(mType) {
                 case SourceType::BINARY:
-                    return std::strtol(static_cast<const char*>(mValue.binary), nullptr, 10);
+                    return std::strtol(getBinaryData(), nullptr, 10);
                 case SourceType::INT:
                     return mValue.v_int;
                 case SourceType::DOUBLE:
@@ -81,7 +175,7 @@ class MqttValue {
         void* getBinaryPtr() const {
             switch(mType) {
                 case SourceType::BINARY:
-                    return mValue.binary;
+                    return const_cast<char*>(getBinaryData());
                 default:
                     return (void*)&mValue;
             }
@@ -103,8 +197,7 @@ class MqttValue {
         SourceType getSourceType() const { return mType; }
 
         ~MqttValue() {
-            if (mType == SourceType::BINARY && mValue.binary != nullptr)
-                free(mValue.binary);
+            release();
         }
     private:
         /**
@@ -113,28 +206,51 @@ class MqttValue {
         typedef union {
             int32_t v_int;
             double v_double;
-            void* binary;
+            // used for binary values that do not fit in mSmallBuffer
+            char* heap;
         } Variant;
 
         Variant mValue;
-        size_t mBinarySize;
-        SourceType mType;
+        size_t mBinarySize = 0;
+        SourceType mType = SourceType::INT;
+        char mSmallBuffer[SmallBufferSize];
+
+        bool isHeapAllocated() const {
+            return mType == SourceType::BINARY && mBinarySize >= SmallBufferSize;
+        }
 
-        //https://codereview.stackexchange.com/questions/90565/converting-a-double-to-a-stdstring-without-scientific-notation
-        static std::string double_to_string(double d)
-        {
-            std::string str = std::to_string(d);
+        const char* getBinaryData() const {
+            return isHeapAllocated() ? mValue.heap : mSmallBuffer;
+        }
 
-            // Remove padding
-            // This must be done in two steps because of numbers like 700.00
-            std::size_t pos1 = str.find_last_not_of("0");
-            if(pos1 != std::string::npos)
-                str.erase(pos1+1);
+        void release() {
+            if (isHeapAllocated())
+                delete[] mValue.heap;
+            mType = SourceType::INT;
+            mBinarySize = 0;
+        }
 
-            std::size_t pos2 = str.find_last_not_of(".");
-            if(pos2 != std::string::npos)
-                str.erase(pos2+1);
+        void copyFrom(const MqttValue& other) {
+            if (other.mType == SourceType::BINARY) {
+                setBinary(other.getBinaryData(), other.mBinarySize);
+            } else {
+                mValue = other.mValue;
+                mType = other.mType;
+                mBinarySize = 0;
+            }
+        }
 
-            return str;
+        void moveFrom(MqttValue& other) {
+            if (other.isHeapAllocated()) {
+                mValue.heap = other.mValue.heap;
+                mBinarySize = other.mBinarySize;
+                mType = SourceType::BINARY;
+                // other does not own the buffer anymore
+                other.mType = SourceType::INT;
+                other.mBinarySize = 0;
+                other.mValue.v_int = 0;
+            } else {
+                copyFrom(other);
+            }
         }
 };
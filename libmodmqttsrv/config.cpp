@@ -1,3 +1,5 @@
+#include <regex>
+
 #include "config.hpp"
 #include "common.hpp"
 
@@ -16,11 +18,45 @@ ConfigurationException::ConfigurationException(const YAML::Mark& mark, const cha
     mWhat += what;
 }
 
+bool
+ConfigTools::readOptionalTimespan(int& pDestMsec, const YAML::Node& parent, const char* nodeName) {
+    std::string str;
+    if (!readOptionalValue<std::string>(str, parent, nodeName))
+        return false;
+
+    std::regex re("([0-9]+)(ms|s|min)");
+    std::cmatch matches;
+
+    if (!std::regex_match(str.c_str(), matches, re))
+        throw ConfigurationException(parent[nodeName].Mark(), std::string("Invalid ") + nodeName + " time");
+
+    int value = std::stoi(matches[1]);
+    std::string unit = matches[2];
+    if (unit == "s")
+        value *= 1000;
+    else if (unit == "min")
+        value *= 1000 * 60;
+
+    pDestMsec = value;
+    return true;
+}
+
 ModbusNetworkConfig::ModbusNetworkConfig(const YAML::Node& source) {
     mName = ConfigTools::readRequiredString(source, "name");
+    ConfigTools::readOptionalValue<int>(mMaxReadGap, source, "max_read_gap");
+    if (mMaxReadGap < 0)
+        throw ConfigurationException(source["max_read_gap"].Mark(), "max_read_gap cannot be negative");
+    ConfigTools::readOptionalValue<bool>(mReadAfterWrite, source, "read_after_write");
+    ConfigTools::readOptionalTimespan(mResponseTimeoutMsec, source, "response_timeout");
+    ConfigTools::readOptionalTimespan(mResponseDataTimeoutMsec, source, "response_data_timeout");
 
     if (source["device"]) {
         mType = Type::RTU;
+        // RTU bus can handle only one request at a time
+        if (source["pool_size"])
+            throw ConfigurationException(source["pool_size"].Mark(), "pool_size is supported only for TCP networks");
+        if (source["pipeline_depth"])
+            throw ConfigurationException(source["pipeline_depth"].Mark(), "pipeline_depth is supported only for TCP networks");
         mDevice = ConfigTools::readRequiredString(source, "device");
         mBaud = ConfigTools::readRequiredValue<int>(source, "baud");
         mParity = ConfigTools::readRequiredValue<char>(source, "parity");
@@ -30,6 +66,20 @@ ModbusNetworkConfig::ModbusNetworkConfig(const YAML::Node& source) {
         mType = Type::TCPIP;
         mAddress = ConfigTools::readRequiredString(source, "address");
         mPort = ConfigTools::readRequiredValue<int>(source, "port");
+        std::string poolSize;
+        if (ConfigTools::readOptionalValue<std::string>(poolSize, source, "pool_size")) {
+            if (poolSize == "per_slave") {
+                mPoolSize = PoolPerSlave;
+            } else {
+                mPoolSize = source["pool_size"].as<int>();
+                if (mPoolSize < 1)
+                    throw ConfigurationException(source["pool_size"].Mark(), "pool_size must be a positive number or per_slave");
+            }
+        }
+        ConfigTools::readOptionalValue<int>(mPipelineDepth, source, "pipeline_depth");
+        if (mPipelineDepth < 1 || mPipelineDepth > MaxPipelineDepth)
+            throw ConfigurationException(source["pipeline_depth"].Mark(),
+                "pipeline_depth must be between 1 and " + std::to_string(MaxPipelineDepth));
     } else {
         throw ConfigurationException(source.Mark(), "Cannot determine modbus network type: missing 'device' or 'address'");
     }
@@ -41,6 +91,16 @@ MqttBrokerConfig::MqttBrokerConfig(const YAML::Node& source) {
     ConfigTools::readOptionalValue<int>(mKeepalive, source, "keepalive");
     ConfigTools::readOptionalValue<std::string>(mUsername, source, "username");
     ConfigTools::readOptionalValue<std::string>(mPassword, source, "password");
+
+    std::string protocolVersion;
+    if (ConfigTools::readOptionalValue<std::string>(protocolVersion, source, "protocol_version")) {
+        if (protocolVersion == "3.1.1")
+            mProtocolVersion = 4;
+        else if (protocolVersion == "5")
+            mProtocolVersion = 5;
+        else
+            throw ConfigurationException(source["protocol_version"].Mark(), "Unsupported protocol_version " + protocolVersion);
+    }
 }
 
 
@@ -63,6 +63,12 @@ class ConfigTools {
             pDest = node.as<T>();
             return true;
         }
+
+        /**
+         * Reads timespan in format <number><unit>, where unit
+         * is one of ms, s, min. Returns value in milliseconds.
+         * */
+        static bool readOptionalTimespan(int& pDestMsec, const YAML::Node& parent, const char* nodeName);
 };
 
 
@@ -94,9 +100,23 @@ class ModbusNetworkConfig {
             }
         };
 
-        //RTU only
+        // mPoolSize value for one connection per slave id
+        static constexpr int PoolPerSlave = 0;
+        static constexpr int MaxPipelineDepth = 64;
+
         Type mType;
         std::string mName = "";
+        // number of unused registers that can be read
+        // to merge polled registers into a single request
+        int mMaxReadGap = 0;
+        // read written registers back instead of
+        // publishing written value as register state
+        bool mReadAfterWrite = false;
+        // 0 for modbus library defaults
+        int mResponseTimeoutMsec = 0;
+        int mResponseDataTimeoutMsec = 0;
+
+        //RTU only
         std::string mDevice = "";
         int mBaud = 0;
         char mParity = '\0';
@@ -106,6 +126,12 @@ class ModbusNetworkConfig {
         //TCP only
         std::string mAddress = "";
         int mPort = 0;
+        // number of connections used to poll slaves
+        // concurrently, or PoolPerSlave
+        int mPoolSize = 1;
+        // number of requests sent on a single connection
+        // without waiting for responses
+        int mPipelineDepth = 1;
 };
 
 class MqttBrokerConfig {
@@ -117,7 +143,8 @@ class MqttBrokerConfig {
                     mPort == other.mPort &&
                     mKeepalive == other.mKeepalive &&
                     mUsername == other.mUsername &&
-                    mPassword == other.mPassword;
+                    mPassword == other.mPassword &&
+                    mProtocolVersion == other.mProtocolVersion;
         }
 
         //defaults are from mosqittopp.h
@@ -126,6 +153,8 @@ class MqttBrokerConfig {
         int mKeepalive = 60;
         std::string mUsername;
         std::string mPassword;
+        // MQTT protocol level, 4 for 3.1.1, 5 for MQTT v5
+        int mProtocolVersion = 4;
 
         std::string mClientId;
 };
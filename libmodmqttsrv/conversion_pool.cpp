@@ -0,0 +1,90 @@
+#include "conversion_pool.hpp"
+
+namespace modmqttd {
+
+void
+ConversionPool::start(int threadCount, const Handler& handler) {
+    if (isStarted())
+        return;
+    mHandler = handler;
+    mShouldRun = true;
+    for(int i = 0; i < threadCount; i++)
+        mWorkers.push_back(std::unique_ptr<Worker>(new Worker()));
+    // threads are started after mWorkers is complete
+    for(auto it = mWorkers.begin(); it != mWorkers.end(); it++) {
+        Worker& worker(**it);
+        worker.mThread.reset(new std::thread(&ConversionPool::workerLoop, this, std::ref(worker)));
+    }
+    BOOST_LOG_SEV(mWorkers[0]->log, Log::info) << "Started " << threadCount << " conversion threads";
+}
+
+void
+ConversionPool::stop() {
+    if (!isStarted())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mShouldRun = false;
+    }
+    mStartRun.notify_all();
+    for(auto it = mWorkers.begin(); it != mWorkers.end(); it++)
+        (*it)->mThread->join();
+    mWorkers.clear();
+}
+
+void
+ConversionPool::add(std::size_t key, MqttObject& object) {
+    mWorkers[key % mWorkers.size()]->mObjects.push_back(&object);
+}
+
+void
+ConversionPool::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mRunningCount = mWorkers.size();
+    mRunId++;
+    lock.unlock();
+    mStartRun.notify_all();
+
+    lock.lock();
+    while(mRunningCount != 0)
+        mRunFinished.wait(lock);
+    lock.unlock();
+
+    std::exception_ptr error;
+    for(auto it = mWorkers.begin(); it != mWorkers.end(); it++) {
+        if (error == nullptr)
+            error = (*it)->mError;
+        (*it)->mError = nullptr;
+    }
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
+void
+ConversionPool::workerLoop(Worker& worker) {
+    uint64_t lastRunId = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(true) {
+        while(mShouldRun && mRunId == lastRunId)
+            mStartRun.wait(lock);
+        if (!mShouldRun)
+            break;
+        lastRunId = mRunId;
+        lock.unlock();
+
+        try {
+            for(auto it = worker.mObjects.begin(); it != worker.mObjects.end(); it++)
+                mHandler(**it, worker);
+        } catch (...) {
+            worker.mError = std::current_exception();
+        }
+        worker.mObjects.clear();
+
+        lock.lock();
+        if (--mRunningCount == 0)
+            mRunFinished.notify_one();
+    }
+    BOOST_LOG_SEV(worker.log, Log::debug) << "Conversion thread ended";
+}
+
+}
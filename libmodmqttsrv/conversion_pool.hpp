@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.hpp"
+#include "mqttobject.hpp"
+
+namespace modmqttd {
+
+/**
+ * Threads that convert and serialize state of changed objects.
+ *
+ * Every object is assigned to a single worker by its key.
+ * Converter instances are never shared between objects, only between
+ * registers of a single object state (see ModMqtt::readObjectState),
+ * so converters and buffers of an object are never used concurrently,
+ * including IStateConverter plugins that are not thread safe.
+ * Objects are updated by main thread only between runs, run()
+ * returns after all workers finished.
+ * */
+class ConversionPool {
+    public:
+        class Worker {
+            public:
+                StateMessageBuilder mStateBuilder;
+                boost::log::sources::severity_logger<Log::severity> log;
+            private:
+                friend class ConversionPool;
+                std::vector<MqttObject*> mObjects;
+                std::unique_ptr<std::thread> mThread;
+                std::exception_ptr mError;
+        };
+
+        typedef std::function<void(MqttObject&, Worker&)> Handler;
+
+        void start(int threadCount, const Handler& handler);
+        void stop();
+        bool isStarted() const { return !mWorkers.empty(); }
+
+        // objects with the same key are handled by the same worker
+        void add(std::size_t key, MqttObject& object);
+        // calls handler for all added objects and waits for result,
+        // rethrows first exception thrown by handler
+        void run();
+
+        ~ConversionPool() { stop(); }
+    private:
+        std::vector<std::unique_ptr<Worker>> mWorkers;
+        Handler mHandler;
+
+        std::mutex mMutex;
+        std::condition_variable mStartRun;
+        std::condition_variable mRunFinished;
+        // incremented for every run
+        uint64_t mRunId = 0;
+        int mRunningCount = 0;
+        bool mShouldRun = false;
+
+        void workerLoop(Worker& worker);
+};
+
+}
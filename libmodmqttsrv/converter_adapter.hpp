@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+
+#include "libmodmqttconv/converter.hpp"
+
+namespace modmqttd {
+
+/**
+ * Allows to use converters from plugins that implement
+ * only IStateConverter interface as IStateConverterV2
+ * */
+class LegacyConverterAdapter : public IStateConverterV2 {
+    public:
+        LegacyConverterAdapter(const std::shared_ptr<IStateConverter>& converter) : mConverter(converter) {}
+
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
+            ModbusRegisters registers;
+            for(int i = 0; i < data.getCount(); i++)
+                registers.addValue(data.getValue(i));
+            out.setValue(mConverter->toMqtt(registers));
+        }
+
+        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
+            return mConverter->toMqtt(data);
+        }
+
+        virtual void setArgs(const std::vector<std::string>& args) {
+            mConverter->setArgs(args);
+        }
+    private:
+        std::shared_ptr<IStateConverter> mConverter;
+};
+
+}
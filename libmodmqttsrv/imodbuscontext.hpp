@@ -2,13 +2,38 @@
 
 #include <inttypes.h>
 #include <memory>
+#include <vector>
+#include <string>
+
+#include "modbus_types.hpp"
 
 namespace modmqttd {
 
 class RegisterPoll;
 class MsgRegisterValue;
+class MsgRegisterValues;
 class ModbusNetworkConfig;
 
+/**
+    Single block read, used to pass many reads to context at once
+*/
+class ModbusReadRequest {
+    public:
+        ModbusReadRequest(int slaveId, RegisterType regType, int firstRegister, int count)
+            : mSlaveId(slaveId), mRegisterType(regType), mFirstRegister(firstRegister), mCount(count)
+        {}
+        int mSlaveId;
+        RegisterType mRegisterType;
+        int mFirstRegister;
+        int mCount;
+        // set by context
+        std::vector<uint16_t> mValues;
+        // empty if read was successful
+        std::string mError;
+        // errno value for failed read
+        int mErrorCode = 0;
+};
+
 /**
     Abstract base class for modbus communication library implementation
 */
@@ -19,13 +44,35 @@ class IModbusContext {
         virtual bool isConnected() const = 0;
         virtual void disconnect() = 0;
         virtual uint16_t readModbusRegister(int slaveId, const RegisterPoll& regData) = 0;
+        /**
+            Read count registers starting from firstRegister with
+            a single modbus request. Values are returned in register order.
+        */
+        virtual std::vector<uint16_t> readModbusRegisters(int slaveId, RegisterType regType, int firstRegister, int count) = 0;
+        /**
+            Execute all read requests. Read errors are stored in
+            request mError field. Default implementation sends requests
+            one by one, contexts that can have more than one request
+            in flight should override it.
+        */
+        virtual void readModbusRegisters(std::vector<ModbusReadRequest>& requests);
+        /**
+            Number of read requests that context can send
+            without waiting for responses
+        */
+        virtual int getMaxPendingRequests() const { return 1; }
         virtual void writeModbusRegister(const MsgRegisterValue& msg) = 0;
+        /**
+            Write consecutive registers with a single request,
+            function 16 for holding registers, 15 for coils
+        */
+        virtual void writeModbusRegisters(const MsgRegisterValues& msg) = 0;
         virtual ~IModbusContext() {};
 };
 
 class IModbusFactory {
     public:
-        virtual std::shared_ptr<IModbusContext> getContext(const std::string& networkName) = 0;
+        virtual std::shared_ptr<IModbusContext> getContext(const ModbusNetworkConfig& config) = 0;
         virtual ~IModbusFactory() {};
 };
 
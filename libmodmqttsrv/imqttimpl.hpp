@@ -1,11 +1,26 @@
 #pragma once
 
+#include <chrono>
+
 #include "config.hpp"
 
 namespace modmqttd {
 
 class MqttClient;
 
+/**
+    Options of a single published message
+*/
+class MqttPublishProps {
+    public:
+        int mQos = 0;
+        bool mRetain = true;
+        // MQTT v5 message expiry interval, 0 if message never expires
+        int mMessageExpirySec = 0;
+        // MQTT v5 poll_time user property, not sent if not set
+        std::chrono::system_clock::time_point mPollTime;
+};
+
 /**
     Abstract base class for mqtt communication library implementation
 */
@@ -17,8 +32,8 @@ class IMqttImpl {
         virtual void disconnect() = 0;
         virtual void stop() = 0;
 
-        virtual void subscribe(const char* topic) = 0;
-        virtual void publish(const char* topic, int len, const void* data) = 0;
+        virtual void subscribe(const char* topic, int qos) = 0;
+        virtual void publish(const char* topic, int len, const void* data, const MqttPublishProps& props) = 0;
 
         virtual void on_disconnect(int rc) = 0;
         virtual void on_connect(int rc)= 0;
@@ -0,0 +1,207 @@
+#include <algorithm>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "metrics.hpp"
+#include "modbus_types.hpp"
+
+namespace modmqttd {
+
+constexpr std::array<int, 12> LatencyHistogram::BucketLimits;
+
+void
+LatencyHistogram::add(const std::chrono::steady_clock::duration& sample) {
+    std::size_t idx = 0;
+    while(idx < BucketLimits.size() && sample > std::chrono::milliseconds(BucketLimits[idx]))
+        idx++;
+    mBuckets[idx]++;
+    mCount++;
+    mSum += sample;
+    if (sample > mMax)
+        mMax = sample;
+}
+
+void
+LatencyHistogram::merge(const LatencyHistogram& other) {
+    for(std::size_t i = 0; i < mBuckets.size(); i++)
+        mBuckets[i] += other.mBuckets[i];
+    mCount += other.mCount;
+    mSum += other.mSum;
+    if (other.mMax > mMax)
+        mMax = other.mMax;
+}
+
+double
+LatencyHistogram::getAverageMsec() const {
+    if (mCount == 0)
+        return 0;
+    return std::chrono::duration<double, std::milli>(mSum).count() / mCount;
+}
+
+double
+LatencyHistogram::getMaxMsec() const {
+    return std::chrono::duration<double, std::milli>(mMax).count();
+}
+
+double
+LatencyHistogram::getPercentileMsec(double percentile) const {
+    if (mCount == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(1, mCount * percentile / 100.0 + 0.5);
+    uint64_t seen = 0;
+    for(std::size_t i = 0; i < BucketLimits.size(); i++) {
+        seen += mBuckets[i];
+        if (seen >= rank)
+            return std::min<double>(BucketLimits[i], getMaxMsec());
+    }
+    return getMaxMsec();
+}
+
+void
+ModbusSlaveStats::merge(const ModbusSlaveStats& other) {
+    mReads += other.mReads;
+    mErrors += other.mErrors;
+    mReadLatency.merge(other.mReadLatency);
+}
+
+void
+ModbusThreadStats::merge(const ModbusThreadStats& other) {
+    mPollCycleTime.merge(other.mPollCycleTime);
+    mLateness.merge(other.mLateness);
+    for(std::size_t i = 0; i < mRefreshStretch.size(); i++)
+        mRefreshStretch[i] = std::max(mRefreshStretch[i], other.mRefreshStretch[i]);
+    mWrites += other.mWrites;
+    mCollapsedWrites += other.mCollapsedWrites;
+    mCommandLatency.merge(other.mCommandLatency);
+    for(std::map<int, ModbusSlaveStats>::const_iterator it = other.mSlaves.begin(); it != other.mSlaves.end(); it++)
+        mSlaves[it->first].merge(it->second);
+}
+
+void
+MetricsCollector::setConfig(const MetricsConfig& config) {
+    mConfig = config;
+    mLastPublish = std::chrono::steady_clock::now();
+    mNextCollect = mLastPublish + std::chrono::milliseconds(mConfig.mIntervalMsec);
+}
+
+void
+MetricsCollector::startCollect(const std::chrono::steady_clock::time_point& now, int pendingReplies) {
+    mPendingReplies = pendingReplies;
+    mNextCollect = now + std::chrono::milliseconds(mConfig.mIntervalMsec);
+}
+
+bool
+MetricsCollector::addModbusStats(int networkId, const ModbusThreadStats& stats) {
+    mNetworks[networkId].mStats.merge(stats);
+    if (mPendingReplies == 0)
+        return false;
+    mPendingReplies--;
+    return mPendingReplies == 0;
+}
+
+void
+MetricsCollector::updateQueueDepth(int networkId, std::size_t toModbus, std::size_t fromModbus) {
+    NetworkMetrics& metrics(mNetworks[networkId]);
+    metrics.mMaxToModbusQueue = std::max(metrics.mMaxToModbusQueue, toModbus);
+    metrics.mMaxFromModbusQueue = std::max(metrics.mMaxFromModbusQueue, fromModbus);
+}
+
+static void
+writeHistogram(rapidjson::Writer<rapidjson::StringBuffer>& writer, const char* name, const LatencyHistogram& histogram) {
+    writer.Key(name);
+    writer.StartObject();
+    writer.Key("count");
+    writer.Uint64(histogram.getCount());
+    writer.Key("avg");
+    writer.Double(histogram.getAverageMsec());
+    writer.Key("p50");
+    writer.Double(histogram.getPercentileMsec(50));
+    writer.Key("p99");
+    writer.Double(histogram.getPercentileMsec(99));
+    writer.Key("max");
+    writer.Double(histogram.getMaxMsec());
+    writer.EndObject();
+}
+
+std::vector<MetricsCollector::Message>
+MetricsCollector::createMessages(
+    const std::vector<std::string>& networkNames,
+    uint64_t publishCount,
+    uint64_t supersededCount,
+    const std::chrono::steady_clock::time_point& now
+) {
+    std::vector<Message> ret;
+    double seconds = std::chrono::duration<double>(now - mLastPublish).count();
+
+    {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        uint64_t publishes = publishCount - mLastPublishCount;
+        writer.StartObject();
+        writer.Key("publishes");
+        writer.Uint64(publishes);
+        writer.Key("publish_rate");
+        writer.Double(seconds > 0 ? publishes / seconds : 0);
+        writer.Key("superseded");
+        writer.Uint64(supersededCount - mLastSupersededCount);
+        writer.EndObject();
+        ret.push_back(Message(mConfig.mTopic + "/mqtt", buffer.GetString()));
+    }
+
+    for(std::map<int, NetworkMetrics>::const_iterator net = mNetworks.begin(); net != mNetworks.end(); net++) {
+        std::string networkTopic = mConfig.mTopic + "/" + networkNames[net->first];
+        const ModbusThreadStats& stats(net->second.mStats);
+        {
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            writer.StartObject();
+            writeHistogram(writer, "poll_cycle_ms", stats.mPollCycleTime);
+            writeHistogram(writer, "lateness_ms", stats.mLateness);
+            writer.Key("refresh_stretch");
+            writer.StartObject();
+            writer.Key("high");
+            writer.Int(stats.mRefreshStretch[PollPriority::HIGH]);
+            writer.Key("normal");
+            writer.Int(stats.mRefreshStretch[PollPriority::NORMAL]);
+            writer.Key("low");
+            writer.Int(stats.mRefreshStretch[PollPriority::LOW]);
+            writer.EndObject();
+            writer.Key("writes");
+            writer.Uint64(stats.mWrites);
+            writer.Key("collapsed_writes");
+            writer.Uint64(stats.mCollapsedWrites);
+            writeHistogram(writer, "command_latency_ms", stats.mCommandLatency);
+            writer.Key("to_modbus_queue_max");
+            writer.Uint64(net->second.mMaxToModbusQueue);
+            writer.Key("from_modbus_queue_max");
+            writer.Uint64(net->second.mMaxFromModbusQueue);
+            writer.EndObject();
+            ret.push_back(Message(networkTopic, buffer.GetString()));
+        }
+
+        for(std::map<int, ModbusSlaveStats>::const_iterator slave = stats.mSlaves.begin(); slave != stats.mSlaves.end(); slave++) {
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            writer.StartObject();
+            writer.Key("reads");
+            writer.Uint64(slave->second.mReads);
+            writer.Key("errors");
+            writer.Uint64(slave->second.mErrors);
+            writer.Key("error_rate");
+            writer.Double(slave->second.mReads != 0 ? double(slave->second.mErrors) / slave->second.mReads : 0);
+            writeHistogram(writer, "read_latency_ms", slave->second.mReadLatency);
+            writer.EndObject();
+            ret.push_back(Message(networkTopic + "/" + std::to_string(slave->first), buffer.GetString()));
+        }
+    }
+
+    mNetworks.clear();
+    mLastPublish = now;
+    mLastPublishCount = publishCount;
+    mLastSupersededCount = supersededCount;
+    mPendingReplies = 0;
+    return ret;
+}
+
+}
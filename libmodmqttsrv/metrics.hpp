@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace modmqttd {
+
+/**
+ * Fixed bucket histogram of durations
+ *
+ * Adding a sample does not allocate memory, so it
+ * can be used in modbus poll loop.
+ * */
+class LatencyHistogram {
+    public:
+        // upper bounds of buckets in milliseconds,
+        // samples above last bound go to overflow bucket
+        static constexpr std::array<int, 12> BucketLimits = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+
+        void add(const std::chrono::steady_clock::duration& sample);
+        void merge(const LatencyHistogram& other);
+        void reset() { *this = LatencyHistogram(); }
+
+        uint64_t getCount() const { return mCount; }
+        double getAverageMsec() const;
+        double getMaxMsec() const;
+        // upper bound of bucket with requested percentile,
+        // max value if percentile is in overflow bucket
+        double getPercentileMsec(double percentile) const;
+    private:
+        std::array<uint64_t, BucketLimits.size() + 1> mBuckets = {};
+        uint64_t mCount = 0;
+        std::chrono::steady_clock::duration mSum = std::chrono::steady_clock::duration::zero();
+        std::chrono::steady_clock::duration mMax = std::chrono::steady_clock::duration::zero();
+};
+
+class ModbusSlaveStats {
+    public:
+        uint64_t mReads = 0;
+        uint64_t mErrors = 0;
+        LatencyHistogram mReadLatency;
+
+        void merge(const ModbusSlaveStats& other);
+};
+
+/**
+ * Counters collected by modbus thread between two
+ * metric publishes
+ * */
+class ModbusThreadStats {
+    public:
+        // time needed to poll all registers due in a single scheduler run
+        LatencyHistogram mPollCycleTime;
+        // how late was the most overdue register in a poll cycle
+        LatencyHistogram mLateness;
+        std::map<int, ModbusSlaveStats> mSlaves;
+        // refresh multiplier of each PollPriority
+        std::array<int, 3> mRefreshStretch = {{ 1, 1, 1 }};
+        // modbus write requests sent
+        uint64_t mWrites = 0;
+        // queued writes replaced by newer value before they were sent
+        uint64_t mCollapsedWrites = 0;
+        // time from receiving mqtt command to modbus write response
+        LatencyHistogram mCommandLatency;
+
+        void merge(const ModbusThreadStats& other);
+};
+
+class MetricsConfig {
+    public:
+        static constexpr int DefaultIntervalMsec = 60000;
+
+        // prefix of metric topics, metrics are disabled if empty
+        std::string mTopic;
+        int mIntervalMsec = DefaultIntervalMsec;
+
+        bool isEnabled() const { return !mTopic.empty(); }
+};
+
+/**
+ * Aggregates statistics from modbus threads and main thread
+ * and creates JSON messages for metric topics:
+ *
+ * <topic>/mqtt                    publish rate and superseded publishes
+ * <topic>/<network>               poll cycle time, lateness, command latency, refresh stretch and queue depths
+ * <topic>/<network>/<slave id>    read latency and error rate
+ * */
+class MetricsCollector {
+    public:
+        class Message {
+            public:
+                Message(const std::string& topic, const std::string& payload)
+                    : mTopic(topic), mPayload(payload) {}
+                std::string mTopic;
+                std::string mPayload;
+        };
+
+        void setConfig(const MetricsConfig& config);
+        bool isEnabled() const { return mConfig.isEnabled(); }
+
+        std::chrono::steady_clock::time_point getNextCollect() const { return mNextCollect; }
+        // called when stats are requested from modbus threads
+        void startCollect(const std::chrono::steady_clock::time_point& now, int pendingReplies);
+        bool isCollecting() const { return mPendingReplies > 0; }
+
+        // returns true if all requested stats are collected
+        bool addModbusStats(int networkId, const ModbusThreadStats& stats);
+        void updateQueueDepth(int networkId, std::size_t toModbus, std::size_t fromModbus);
+
+        /**
+         * Creates messages for period since last call
+         * and resets all counters.
+         * */
+        std::vector<Message> createMessages(
+            const std::vector<std::string>& networkNames,
+            uint64_t publishCount,
+            uint64_t supersededCount,
+            const std::chrono::steady_clock::time_point& now
+        );
+    private:
+        class NetworkMetrics {
+            public:
+                ModbusThreadStats mStats;
+                std::size_t mMaxToModbusQueue = 0;
+                std::size_t mMaxFromModbusQueue = 0;
+        };
+
+        MetricsConfig mConfig;
+        std::map<int, NetworkMetrics> mNetworks;
+        std::chrono::steady_clock::time_point mNextCollect;
+        std::chrono::steady_clock::time_point mLastPublish;
+        uint64_t mLastPublishCount = 0;
+        uint64_t mLastSupersededCount = 0;
+        int mPendingReplies = 0;
+};
+
+}
@@ -1,3 +1,5 @@
+#include <set>
+
 #include "common.hpp"
 #include "modbus_client.hpp"
 #include "modbus_thread.hpp"
@@ -5,20 +7,113 @@
 
 namespace modmqttd {
 
+void
+ModbusClient::init(int networkId, const ModbusNetworkConfig& config) {
+    mNetworkId = networkId;
+    mName = config.mName;
+    mConfig = config;
+    // for one connection per slave more threads
+    // are added when poll specification is set
+    int poolSize = mConfig.mPoolSize == ModbusNetworkConfig::PoolPerSlave ? 1 : mConfig.mPoolSize;
+    for(int i = 0; i < poolSize; i++)
+        addWorker();
+}
+
+void
+ModbusClient::addWorker() {
+    std::unique_ptr<Worker> worker(new Worker(*this));
+    worker->mModbusThread.reset(new std::thread(threadLoop, std::ref(*worker)));
+    worker->mToModbusQueue.enqueue(std::make_shared<const ModbusNetworkConfig>(mConfig));
+    mWorkers.push_back(std::move(worker));
+}
+
+void
+ModbusClient::sendPollSpecification(const MsgRegisterPollSpecification& spec) {
+    std::set<int> slaves;
+    for(std::vector<MsgRegisterPoll>::const_iterator it = spec.mRegisters.begin(); it != spec.mRegisters.end(); it++)
+        slaves.insert(it->mSlaveId);
+
+    if (mConfig.mPoolSize == ModbusNetworkConfig::PoolPerSlave) {
+        while(mWorkers.size() < slaves.size())
+            addWorker();
+    }
+
+    // assign slaves to workers in round robin. Assignment is static,
+    // every worker keeps its own scheduler and read planner, and
+    // a slave is always polled and written by the same connection
+    std::vector<std::shared_ptr<MsgRegisterPollSpecification>> workerSpecs;
+    for(std::size_t i = 0; i < mWorkers.size(); i++)
+        workerSpecs.push_back(std::make_shared<MsgRegisterPollSpecification>(spec.mNetworkName));
+
+    int idx = 0;
+    for(std::set<int>::const_iterator it = slaves.begin(); it != slaves.end(); it++) {
+        mSlaveWorkers[*it] = idx;
+        idx = (idx + 1) % mWorkers.size();
+    }
+
+    for(std::vector<MsgRegisterPoll>::const_iterator it = spec.mRegisters.begin(); it != spec.mRegisters.end(); it++)
+        workerSpecs[mSlaveWorkers[it->mSlaveId]]->mRegisters.push_back(*it);
+
+    for(std::size_t i = 0; i < mWorkers.size(); i++)
+        mWorkers[i]->mToModbusQueue.enqueue(std::shared_ptr<const MsgRegisterPollSpecification>(workerSpecs[i]));
+}
+
+ModbusClient::Worker&
+ModbusClient::getWorker(int slaveId) {
+    std::map<int, int>::const_iterator it = mSlaveWorkers.find(slaveId);
+    if (it != mSlaveWorkers.end())
+        return *mWorkers[it->second];
+    // slave is not polled, only written to
+    return *mWorkers[slaveId % mWorkers.size()];
+}
+
+void
+ModbusClient::sendMqttNetworkIsUp(bool up) {
+    for(std::vector<std::unique_ptr<Worker>>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++)
+        (*it)->mToModbusQueue.enqueue(MsgMqttNetworkState(up));
+}
+
+int
+ModbusClient::requestStats() {
+    for(std::vector<std::unique_ptr<Worker>>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++)
+        (*it)->mToModbusQueue.enqueue(MsgCollectStats());
+    return mWorkers.size();
+}
+
+bool
+ModbusClient::updateNetworkState(Worker& worker, bool isUp) {
+    worker.mNetworkState = isUp ? AvailableFlag::True : AvailableFlag::False;
+    // workers that did not report yet are not counted
+    AvailableFlag state = AvailableFlag::NotSet;
+    for(std::vector<std::unique_ptr<Worker>>::const_iterator it = mWorkers.begin(); it != mWorkers.end(); it++) {
+        if ((*it)->mNetworkState == AvailableFlag::False) {
+            state = AvailableFlag::False;
+            break;
+        }
+        if ((*it)->mNetworkState == AvailableFlag::True)
+            state = AvailableFlag::True;
+    }
+    bool changed = state != mNetworkState;
+    mNetworkState = state;
+    return changed;
+}
+
 void ModbusClient::stop() {
-    if (mModbusThread != nullptr) {
-        mToModbusQueue.enqueue(QueueItem::create(EndWorkMessage()));
-        mModbusThread->join();
-        mModbusThread.reset();
+    for(std::vector<std::unique_ptr<Worker>>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++) {
+        if ((*it)->mModbusThread != nullptr)
+            (*it)->mToModbusQueue.enqueue(EndWorkMessage());
+    }
+    for(std::vector<std::unique_ptr<Worker>>::iterator it = mWorkers.begin(); it != mWorkers.end(); it++) {
+        if ((*it)->mModbusThread != nullptr) {
+            (*it)->mModbusThread->join();
+            (*it)->mModbusThread.reset();
+        }
     }
 };
 
 void
-ModbusClient::threadLoop(
-    moodycamel::BlockingReaderWriterQueue<QueueItem>& toModbusQueue,
-    moodycamel::BlockingReaderWriterQueue<QueueItem>& fromModbusQueue)
-{
-    ModbusThread thread(toModbusQueue, fromModbusQueue);
+ModbusClient::threadLoop(Worker& worker) {
+    ModbusThread thread(worker.mToModbusQueue, worker.mFromModbusQueue, worker);
     thread.run();
 };
 
@@ -4,48 +4,95 @@
 #include "queue_item.hpp"
 #include "mqttobject.hpp"
 #include "modbus_messages.hpp"
+#include "queue_notifier.hpp"
 #include "../readerwriterqueue/readerwriterqueue.h"
 
 namespace modmqttd {
 /**
  * This class contains code executed in main thread context
  * Rest is in ModbusThread class.
+ *
+ * For TCP networks registers can be polled by a pool of
+ * modbus threads, each with its own connection. Slaves are
+ * assigned to threads when poll specification is set.
  * */
 class ModbusClient {
     public:
+        /**
+         * Single modbus thread with its queues. Worker is put
+         * on gQueueNotifier ready list when mFromModbusQueue
+         * has new messages
+         * */
+        class Worker : public QueueNotifier::Entry {
+            public:
+                Worker(ModbusClient& client) : mClient(&client) {}
+                ModbusClient* mClient;
+                moodycamel::BlockingReaderWriterQueue<FromModbusQueueItem> mFromModbusQueue;
+                moodycamel::BlockingReaderWriterQueue<ToModbusQueueItem> mToModbusQueue;
+                // last network state reported by this thread
+                AvailableFlag mNetworkState = AvailableFlag::NotSet;
+                std::shared_ptr<std::thread> mModbusThread;
+        };
+
         ModbusClient() {};
-        moodycamel::BlockingReaderWriterQueue<QueueItem> mFromModbusQueue;
-        moodycamel::BlockingReaderWriterQueue<QueueItem> mToModbusQueue;
 
-        void init(const ModbusNetworkConfig& config) {
-            mName = config.mName;
-            mModbusThread.reset(new std::thread(threadLoop, std::ref(mToModbusQueue), std::ref(mFromModbusQueue)));
-            mToModbusQueue.enqueue(QueueItem::create(config));
-        };
+        void init(int networkId, const ModbusNetworkConfig& config);
+        void sendPollSpecification(const MsgRegisterPollSpecification& spec);
 
         void sendCommand(const MqttObjectCommand& cmd, uint16_t value) {
             MsgRegisterValue val(
-                cmd.mRegister.mSlaveId,
-                cmd.mRegister.mRegisterType,
-                cmd.mRegister.mRegisterNumber,
+                cmd.mRegister.getSlaveId(),
+                cmd.mRegister.getRegisterType(),
+                cmd.mRegister.getRegisterNumber(),
                 value
             );
-            mToModbusQueue.enqueue(QueueItem::create(val));
+            val.mCommandTime = std::chrono::steady_clock::now();
+            getWorker(val.mSlaveId).mToModbusQueue.enqueue(val);
         }
 
-        void sendMqttNetworkIsUp(bool up) {
-            mToModbusQueue.enqueue(QueueItem::create(MsgMqttNetworkState(up)));
+        void sendCommand(const MqttObjectCommand& cmd, const std::vector<uint16_t>& values) {
+            MsgRegisterValues val(
+                cmd.mRegister.getSlaveId(),
+                cmd.mRegister.getRegisterType(),
+                cmd.mRegister.getRegisterNumber(),
+                values
+            );
+            val.mCommandTime = std::chrono::steady_clock::now();
+            getWorker(val.mSlaveId).mToModbusQueue.enqueue(val);
         }
 
+        void sendMqttNetworkIsUp(bool up);
+        // sends MsgCollectStats to all threads, returns number of requests sent
+        int requestStats();
+
+        /**
+         * Updates network state reported by a worker. Network is down
+         * if any worker is disconnected. Returns true if network state changed.
+         * */
+        bool updateNetworkState(Worker& worker, bool isUp);
+        bool isNetworkUp() const { return mNetworkState == AvailableFlag::True; }
+
+        const std::vector<std::unique_ptr<Worker>>& getWorkers() const { return mWorkers; }
+
         std::string mName;
+        // interned network name, see ModMqtt::getNetworkId()
+        int mNetworkId = -1;
 
         void stop();
         ~ModbusClient() { stop(); }
     private:
-        static void threadLoop(moodycamel::BlockingReaderWriterQueue<QueueItem>& in, moodycamel::BlockingReaderWriterQueue<QueueItem>& out);
+        static void threadLoop(Worker& worker);
 
         ModbusClient(const ModbusClient&);
-        std::shared_ptr<std::thread> mModbusThread;
+
+        ModbusNetworkConfig mConfig;
+        std::vector<std::unique_ptr<Worker>> mWorkers;
+        // slave id -> index in mWorkers
+        std::map<int, int> mSlaveWorkers;
+        AvailableFlag mNetworkState = AvailableFlag::NotSet;
+
+        void addWorker();
+        Worker& getWorker(int slaveId);
 };
 
 
@@ -1,7 +1,30 @@
+#include <algorithm>
+
 #include "modbus_context.hpp"
+#include "modbus_pipeline_context.hpp"
 
 namespace modmqttd {
 
+void
+IModbusContext::readModbusRegisters(std::vector<ModbusReadRequest>& requests) {
+    for(std::vector<ModbusReadRequest>::iterator it = requests.begin(); it != requests.end(); it++) {
+        try {
+            it->mValues = readModbusRegisters(it->mSlaveId, it->mRegisterType, it->mFirstRegister, it->mCount);
+        } catch (const ModbusReadException& ex) {
+            it->mError = ex.what();
+            it->mErrorCode = ex.getErrorCode();
+        }
+    }
+}
+
+std::shared_ptr<IModbusContext>
+ModbusFactory::getContext(const ModbusNetworkConfig& config) {
+    // libmodbus waits for response after every request
+    if (config.mType == ModbusNetworkConfig::TCPIP && config.mPipelineDepth > 1)
+        return std::shared_ptr<IModbusContext>(new ModbusPipelineContext());
+    return std::shared_ptr<IModbusContext>(new ModbusContext());
+}
+
 void
 ModbusContext::init(const ModbusNetworkConfig& config)
 {
@@ -25,8 +48,19 @@ ModbusContext::init(const ModbusNetworkConfig& config)
 
     if (mCtx == NULL)
         throw ModbusContextException("Unable to create context");
+
+    if (config.mResponseTimeoutMsec != 0)
+        setTimeout(modbus_set_response_timeout, config.mResponseTimeoutMsec);
+    if (config.mResponseDataTimeoutMsec != 0)
+        setTimeout(modbus_set_byte_timeout, config.mResponseDataTimeoutMsec);
 };
 
+void
+ModbusContext::setTimeout(int (*setter)(modbus_t*, uint32_t, uint32_t), int msec) {
+    if (setter(mCtx, msec / 1000, (msec % 1000) * 1000) == -1)
+        throw ModbusContextException("Unable to set timeout");
+}
+
 void
 ModbusContext::connect() {
     if (mCtx != nullptr)
@@ -47,36 +81,46 @@ ModbusContext::disconnect() {
 
 uint16_t
 ModbusContext::readModbusRegister(int slaveId, const RegisterPoll& regData) {
+    return readModbusRegisters(slaveId, regData.mRegisterType, regData.mRegister, 1)[0];
+}
+
+std::vector<uint16_t>
+ModbusContext::readModbusRegisters(int slaveId, RegisterType regType, int firstRegister, int count) {
     if (slaveId != 0)
         modbus_set_slave(mCtx, slaveId);
     else
         modbus_set_slave(mCtx, MODBUS_TCP_SLAVE);
 
-    uint8_t bits;
-    uint16_t value;
+    std::vector<uint16_t> values(count);
+    std::vector<uint8_t> bits;
     int retCode;
-    switch(regData.mRegisterType) {
+    switch(regType) {
         case RegisterType::COIL:
-            retCode = modbus_read_bits(mCtx, regData.mRegister, 1, &bits);
-            value = bits;
+            bits.resize(count);
+            retCode = modbus_read_bits(mCtx, firstRegister, count, bits.data());
         break;
         case RegisterType::BIT:
-            retCode = modbus_read_input_bits(mCtx, regData.mRegister, 1, &bits);
-            value = bits;
+            bits.resize(count);
+            retCode = modbus_read_input_bits(mCtx, firstRegister, count, bits.data());
         break;
         case RegisterType::HOLDING:
-            retCode = modbus_read_registers(mCtx, regData.mRegister, 1, &value);
+            retCode = modbus_read_registers(mCtx, firstRegister, count, values.data());
         break;
         case RegisterType::INPUT:
-            retCode = modbus_read_input_registers(mCtx, regData.mRegister, 1, &value);
+            retCode = modbus_read_input_registers(mCtx, firstRegister, count, values.data());
         break;
         default:
-            throw ModbusContextException(std::string("Cannot read, unknown register type ") + std::to_string(regData.mRegisterType));
+            throw ModbusContextException(std::string("Cannot read, unknown register type ") + std::to_string(regType));
     }
     if (retCode == -1)
-        throw ModbusReadException(std::string("read fn ") + std::to_string(regData.mRegister) + " failed");
+        throw ModbusReadException(std::string("read fn ") + std::to_string(firstRegister)
+            + (count > 1 ? std::string("-") + std::to_string(firstRegister + count - 1) : std::string())
+            + " failed");
+
+    if (bits.size() != 0)
+        std::copy(bits.begin(), bits.end(), values.begin());
 
-    return value;
+    return values;
 }
 
 void
@@ -101,4 +145,31 @@ ModbusContext::writeModbusRegister(const MsgRegisterValue& msg) {
         throw ModbusWriteException(std::string("write fn ") + std::to_string(msg.mRegisterNumber) + " failed");
 }
 
+void
+ModbusContext::writeModbusRegisters(const MsgRegisterValues& msg) {
+    if (msg.mSlaveId != 0)
+        modbus_set_slave(mCtx, msg.mSlaveId);
+    else
+        modbus_set_slave(mCtx, MODBUS_TCP_SLAVE);
+
+    int retCode;
+    switch(msg.mRegisterType) {
+        case RegisterType::COIL: {
+            std::vector<uint8_t> bits(msg.mValues.size());
+            for(std::size_t i = 0; i < bits.size(); i++)
+                bits[i] = msg.mValues[i] == 1 ? TRUE : FALSE;
+            retCode = modbus_write_bits(mCtx, msg.mRegisterNumber, bits.size(), bits.data());
+        }
+        break;
+        case RegisterType::HOLDING:
+            retCode = modbus_write_registers(mCtx, msg.mRegisterNumber, msg.mValues.size(), msg.mValues.data());
+        break;
+        default:
+            throw ModbusContextException(std::string("Cannot write, unknown register type ") + std::to_string(msg.mRegisterType));
+    }
+    if (retCode == -1)
+        throw ModbusWriteException(std::string("write fn ") + std::to_string(msg.mRegisterNumber)
+            + "-" + std::to_string(msg.mRegisterNumber + msg.mValues.size() - 1) + " failed");
+}
+
 } //namespace
@@ -20,29 +20,34 @@ class ModbusContext : public IModbusContext {
         virtual bool isConnected() const { return mIsConnected; }
         virtual void disconnect();
         virtual uint16_t readModbusRegister(int slaveId, const RegisterPoll& regData);
+        virtual std::vector<uint16_t> readModbusRegisters(int slaveId, RegisterType regType, int firstRegister, int count);
         virtual void writeModbusRegister(const MsgRegisterValue& msg);
+        virtual void writeModbusRegisters(const MsgRegisterValues& msg);
         virtual ~ModbusContext() {
             modbus_free(mCtx);
         };
     private:
         boost::log::sources::severity_logger<Log::severity> log;
         void handleError(const std::string& desc);
+        void setTimeout(int (*setter)(modbus_t*, uint32_t, uint32_t), int msec);
         bool mIsConnected = false;
         modbus_t* mCtx = NULL;
 };
 
 class ModbusFactory : public IModbusFactory {
     public:
-        virtual std::shared_ptr<IModbusContext> getContext(const std::string& networkName) {
-            return std::shared_ptr<IModbusContext>(new ModbusContext());
-        }
+        virtual std::shared_ptr<IModbusContext> getContext(const ModbusNetworkConfig& config);
 };
 
 class ModbusContextException : public ModMqttException {
     public:
-        ModbusContextException(const std::string& what) {
-            mWhat = std::string("libmodbus: ") + what + ": " + modbus_strerror(errno);
+        ModbusContextException(const std::string& what) : mErrorCode(errno) {
+            mWhat = std::string("libmodbus: ") + what + ": " + modbus_strerror(mErrorCode);
         }
+        // errno value when exception was created
+        int getErrorCode() const { return mErrorCode; }
+    private:
+        int mErrorCode;
 };
 
 class ModbusReadException : public ModbusContextException {
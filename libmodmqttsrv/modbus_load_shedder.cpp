@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include "modbus_load_shedder.hpp"
+
+namespace modmqttd {
+
+constexpr std::chrono::steady_clock::duration ModbusLoadShedder::MinLateness;
+
+bool
+ModbusLoadShedder::isLate(const RegisterPoll& reg) {
+    return reg.mLateness > std::max(MinLateness, reg.getEffectiveRefresh() / 2);
+}
+
+bool
+ModbusLoadShedder::cycleFinished(bool hadLateRegisters) {
+    if (hadLateRegisters) {
+        mOnTimeCycles = 0;
+        if (++mLateCycles < OverloadCycles)
+            return false;
+        mLateCycles = 0;
+        for(int priority = PollPriority::LOW; priority > PollPriority::HIGH; priority--) {
+            if (mStretch[priority] < MaxStretch) {
+                mStretch[priority] *= 2;
+                return true;
+            }
+        }
+    } else {
+        mLateCycles = 0;
+        if (++mOnTimeCycles < RecoveryCycles)
+            return false;
+        mOnTimeCycles = 0;
+        for(int priority = PollPriority::NORMAL; priority <= PollPriority::LOW; priority++) {
+            if (mStretch[priority] > 1) {
+                mStretch[priority] /= 2;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}
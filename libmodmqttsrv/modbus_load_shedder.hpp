@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include "modbus_types.hpp"
+#include "register_poll.hpp"
+
+namespace modmqttd {
+
+/**
+ * Stretches refresh of low priority registers when
+ * modbus network cannot poll registers on time.
+ *
+ * After OverloadCycles consecutive poll cycles with late registers
+ * refresh of the lowest priority class that is below MaxStretch is doubled.
+ * High priority registers are never stretched. After RecoveryCycles
+ * cycles without late registers stretch is halved, starting with
+ * the highest priority class.
+ * */
+class ModbusLoadShedder {
+    public:
+        static constexpr int OverloadCycles = 5;
+        static constexpr int RecoveryCycles = 50;
+        static constexpr int MaxStretch = 8;
+        // lateness below this value is scheduling jitter
+        static constexpr std::chrono::steady_clock::duration MinLateness = std::chrono::milliseconds(10);
+
+        // register is late if it was polled after half of its refresh period
+        static bool isLate(const RegisterPoll& reg);
+
+        /**
+         * Call after each poll cycle.
+         * Returns true if stretch of any priority class changed.
+         * */
+        bool cycleFinished(bool hadLateRegisters);
+        int getStretch(PollPriority priority) const { return mStretch[priority]; }
+        const std::array<int, 3>& getStretch() const { return mStretch; }
+    private:
+        std::array<int, 3> mStretch = {{ 1, 1, 1 }};
+        int mLateCycles = 0;
+        int mOnTimeCycles = 0;
+};
+
+}
@@ -28,10 +28,28 @@ class MsgRegisterMessageBase {
 
 class MsgRegisterValue : public MsgRegisterMessageBase {
     public:
-        MsgRegisterValue(int slaveId, RegisterType regType, int registerNumber, int16_t value)
+        MsgRegisterValue(int slaveId, RegisterType regType, int registerNumber, int16_t value, bool forcePublish = false)
             : MsgRegisterMessageBase(slaveId, regType, registerNumber),
-              mValue(value) {}
+              mValue(value), mForcePublish(forcePublish),
+              mReadTime(std::chrono::system_clock::now()) {}
         int16_t mValue;
+        // publish state even if it is the same as last published one
+        bool mForcePublish;
+        // wall clock time of modbus poll, sent as MQTT v5 user property
+        std::chrono::system_clock::time_point mReadTime;
+        // time when mqtt command was received, not set for polled values
+        std::chrono::steady_clock::time_point mCommandTime;
+};
+
+// write of consecutive registers with a single modbus request
+class MsgRegisterValues : public MsgRegisterMessageBase {
+    public:
+        MsgRegisterValues(int slaveId, RegisterType regType, int registerNumber, const std::vector<uint16_t>& values)
+            : MsgRegisterMessageBase(slaveId, regType, registerNumber),
+              mValues(values) {}
+        std::vector<uint16_t> mValues;
+        // time when mqtt command was received
+        std::chrono::steady_clock::time_point mCommandTime;
 };
 
 class MsgRegisterReadFailed : public MsgRegisterMessageBase {
@@ -49,12 +67,54 @@ class MsgRegisterWriteFailed : public MsgRegisterMessageBase {
 };
 
 
+/**
+ * Limits register values sent from modbus thread
+ * for registers that change on almost every poll
+ * */
+class RegisterChangeFilter {
+    public:
+        // minimal change of raw register value, absolute
+        // or in percent of last sent value. 0 sends every change
+        double mDeadband = 0;
+        bool mDeadbandPercent = false;
+        // compare raw values as int16
+        bool mDeadbandSigned = false;
+        // do not send changes more often than this, 0 for no limit
+        int mMinPublishMsec = 0;
+        // send unchanged value if nothing was sent for this time, 0 to disable
+        int mMaxSilenceMsec = 0;
+
+        bool isEmpty() const { return mDeadband == 0 && mMinPublishMsec == 0 && mMaxSilenceMsec == 0; }
+
+        // for registers that are parts of multi register values,
+        // only max silence is safe, other filters could publish
+        // some of value registers and hold back the others
+        void clearValueFilter() {
+            mDeadband = 0;
+            mMinPublishMsec = 0;
+        }
+
+        // register used many times in config gets the least restrictive filter
+        void merge(const RegisterChangeFilter& other) {
+            if (mDeadbandPercent != other.mDeadbandPercent || mDeadbandSigned != other.mDeadbandSigned)
+                mDeadband = 0;
+            else if (other.mDeadband < mDeadband)
+                mDeadband = other.mDeadband;
+            if (other.mMinPublishMsec < mMinPublishMsec)
+                mMinPublishMsec = other.mMinPublishMsec;
+            if (mMaxSilenceMsec == 0 || (other.mMaxSilenceMsec != 0 && other.mMaxSilenceMsec < mMaxSilenceMsec))
+                mMaxSilenceMsec = other.mMaxSilenceMsec;
+        }
+};
+
 class MsgRegisterPoll {
     public:
         int mSlaveId;
         int mRegister;
         RegisterType mRegisterType;
         int mRefreshMsec;
+        PollPriority mPriority = PollPriority::NORMAL;
+        RegisterChangeFilter mFilter;
 };
 
 class MsgRegisterPollSpecification {
@@ -81,6 +141,10 @@ class MsgMqttNetworkState {
         bool mIsUp;
 };
 
+// requests ModbusThreadStats collected since last request
+class MsgCollectStats {
+};
+
 class EndWorkMessage {
     // no fields here, thread will check type of message and exit
 };
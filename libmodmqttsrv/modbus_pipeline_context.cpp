@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "modbus_pipeline_context.hpp"
+#include "modbus_context.hpp"
+
+namespace modmqttd {
+
+constexpr std::chrono::milliseconds ModbusPipelineContext::DefaultResponseTimeout;
+
+// MBAP header length including unit id
+static constexpr int MbapHeaderSize = 7;
+static constexpr int MaxPduSize = 253;
+
+void
+ModbusPipelineContext::init(const ModbusNetworkConfig& config) {
+    mAddress = config.mAddress;
+    mPort = config.mPort;
+    mPipelineDepth = config.mPipelineDepth;
+    if (config.mResponseTimeoutMsec != 0)
+        mResponseTimeout = std::chrono::milliseconds(config.mResponseTimeoutMsec);
+    BOOST_LOG_SEV(log, Log::info) << "Connecting to " << mAddress << ":" << mPort
+        << ", up to " << mPipelineDepth << " requests in flight";
+}
+
+void
+ModbusPipelineContext::connect() {
+    disconnect();
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addresses;
+    int ret = getaddrinfo(mAddress.c_str(), std::to_string(mPort).c_str(), &hints, &addresses);
+    if (ret != 0) {
+        BOOST_LOG_SEV(log, Log::error) << "modbus connection failed: " << gai_strerror(ret);
+        return;
+    }
+
+    int timeoutMsec = std::chrono::duration_cast<std::chrono::milliseconds>(mResponseTimeout).count();
+    for(struct addrinfo* ai = addresses; ai != nullptr && mSocket == -1; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+            if (errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int error = ETIMEDOUT;
+            socklen_t len = sizeof(error);
+            if (poll(&pfd, 1, timeoutMsec) == 1)
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0) {
+                errno = error;
+                close(fd);
+                continue;
+            }
+        }
+        // requests are small and should not wait for each other
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        mSocket = fd;
+    }
+    freeaddrinfo(addresses);
+
+    if (mSocket == -1)
+        BOOST_LOG_SEV(log, Log::error) << "modbus connection failed("<< errno << ") : " << modbus_strerror(errno);
+}
+
+void
+ModbusPipelineContext::disconnect() {
+    if (mSocket != -1) {
+        close(mSocket);
+        mSocket = -1;
+    }
+    mReceiveBuffer.clear();
+    mInFlight.clear();
+}
+
+uint16_t
+ModbusPipelineContext::readModbusRegister(int slaveId, const RegisterPoll& regData) {
+    return readModbusRegisters(slaveId, regData.mRegisterType, regData.mRegister, 1)[0];
+}
+
+static uint8_t
+getReadFunction(RegisterType regType) {
+    switch(regType) {
+        case RegisterType::COIL:
+            return 0x01;
+        case RegisterType::BIT:
+            return 0x02;
+        case RegisterType::HOLDING:
+            return 0x03;
+        case RegisterType::INPUT:
+            return 0x04;
+        default:
+            throw ModbusContextException(std::string("Cannot read, unknown register type ") + std::to_string(regType));
+    }
+}
+
+std::vector<uint16_t>
+ModbusPipelineContext::readModbusRegisters(int slaveId, RegisterType regType, int firstRegister, int count) {
+    std::vector<Transaction> transactions(1);
+    initTransaction(transactions[0], slaveId, getReadFunction(regType), firstRegister, count);
+    execute(transactions);
+    if (transactions[0].mError != 0) {
+        errno = transactions[0].mError;
+        throw ModbusReadException(describe(transactions[0]));
+    }
+    return transactions[0].mValues;
+}
+
+void
+ModbusPipelineContext::readModbusRegisters(std::vector<ModbusReadRequest>& requests) {
+    std::vector<Transaction> transactions(requests.size());
+    for(std::size_t i = 0; i < requests.size(); i++) {
+        const ModbusReadRequest& req(requests[i]);
+        initTransaction(transactions[i], req.mSlaveId, getReadFunction(req.mRegisterType), req.mFirstRegister, req.mCount);
+    }
+
+    execute(transactions);
+
+    for(std::size_t i = 0; i < requests.size(); i++) {
+        Transaction& tr(transactions[i]);
+        if (tr.mError != 0) {
+            errno = tr.mError;
+            requests[i].mError = ModbusReadException(describe(tr)).what();
+            requests[i].mErrorCode = tr.mError;
+        } else {
+            requests[i].mValues.swap(tr.mValues);
+        }
+    }
+}
+
+void
+ModbusPipelineContext::writeModbusRegister(const MsgRegisterValue& msg) {
+    std::vector<Transaction> transactions(1);
+    switch(msg.mRegisterType) {
+        case RegisterType::COIL:
+            initTransaction(transactions[0], msg.mSlaveId, 0x05, msg.mRegisterNumber, msg.mValue == 1 ? 0xFF00 : 0);
+        break;
+        case RegisterType::HOLDING:
+            initTransaction(transactions[0], msg.mSlaveId, 0x06, msg.mRegisterNumber, msg.mValue);
+        break;
+        default:
+            throw ModbusContextException(std::string("Cannot write, unknown register type ") + std::to_string(msg.mRegisterType));
+    }
+    execute(transactions);
+    if (transactions[0].mError != 0) {
+        errno = transactions[0].mError;
+        throw ModbusWriteException(describe(transactions[0]));
+    }
+}
+
+void
+ModbusPipelineContext::writeModbusRegisters(const MsgRegisterValues& msg) {
+    std::vector<Transaction> transactions(1);
+    switch(msg.mRegisterType) {
+        case RegisterType::COIL:
+            initTransaction(transactions[0], msg.mSlaveId, 0x0F, msg.mRegisterNumber, msg.mValues.size());
+        break;
+        case RegisterType::HOLDING:
+            initTransaction(transactions[0], msg.mSlaveId, 0x10, msg.mRegisterNumber, msg.mValues.size());
+        break;
+        default:
+            throw ModbusContextException(std::string("Cannot write, unknown register type ") + std::to_string(msg.mRegisterType));
+    }
+    transactions[0].mValues = msg.mValues;
+    execute(transactions);
+    if (transactions[0].mError != 0) {
+        errno = transactions[0].mError;
+        throw ModbusWriteException(describe(transactions[0]));
+    }
+}
+
+void
+ModbusPipelineContext::initTransaction(Transaction& tr, int slaveId, uint8_t function, int address, uint16_t count) {
+    tr.mTransactionId = mNextTransactionId++;
+    tr.mUnitId = slaveId != 0 ? slaveId : MODBUS_TCP_SLAVE;
+    tr.mFunction = function;
+    tr.mAddress = address;
+    tr.mCount = count;
+}
+
+void
+ModbusPipelineContext::execute(std::vector<Transaction>& transactions) {
+    std::size_t next = 0;
+    std::size_t finished = 0;
+    mInFlight.clear();
+    while(finished < transactions.size()) {
+        // keep the window full
+        while(next < transactions.size() && mInFlight.size() < std::size_t(mPipelineDepth)) {
+            Transaction& tr(transactions[next]);
+            if (!isConnected()) {
+                tr.mError = ENOTCONN;
+                finished++;
+            } else if (!sendRequest(tr)) {
+                tr.mError = errno;
+                finished++;
+                failInFlight(transactions, finished, tr.mError);
+                disconnect();
+            } else {
+                tr.mDeadline = std::chrono::steady_clock::now() + mResponseTimeout;
+                mInFlight[tr.mTransactionId] = next;
+            }
+            next++;
+        }
+
+        if (!mInFlight.empty() && !receiveResponses(transactions, finished)) {
+            failInFlight(transactions, finished, errno);
+            disconnect();
+        }
+    }
+}
+
+bool
+ModbusPipelineContext::sendRequest(const Transaction& tr) {
+    // MBAP header and the longest PDU
+    uint8_t frame[7 + 253] = {
+        uint8_t(tr.mTransactionId >> 8), uint8_t(tr.mTransactionId),
+        // protocol id
+        0, 0,
+        // length of unit id and pdu, set below
+        0, 0,
+        tr.mUnitId,
+        tr.mFunction,
+        uint8_t(tr.mAddress >> 8), uint8_t(tr.mAddress),
+        uint8_t(tr.mCount >> 8), uint8_t(tr.mCount)
+    };
+    std::size_t length = 12;
+    if (tr.mFunction == 0x0F) {
+        std::size_t byteCount = (tr.mValues.size() + 7) / 8;
+        frame[length++] = byteCount;
+        std::fill(frame + length, frame + length + byteCount, 0);
+        for(std::size_t i = 0; i < tr.mValues.size(); i++)
+            if (tr.mValues[i])
+                frame[length + i / 8] |= 1 << (i % 8);
+        length += byteCount;
+    } else if (tr.mFunction == 0x10) {
+        frame[length++] = tr.mValues.size() * 2;
+        for(std::size_t i = 0; i < tr.mValues.size(); i++) {
+            frame[length++] = tr.mValues[i] >> 8;
+            frame[length++] = tr.mValues[i];
+        }
+    }
+    frame[4] = (length - 6) >> 8;
+    frame[5] = length - 6;
+
+    int timeoutMsec = std::chrono::duration_cast<std::chrono::milliseconds>(mResponseTimeout).count();
+    std::size_t sent = 0;
+    while(sent < length) {
+        ssize_t ret = send(mSocket, frame + sent, length - sent, MSG_NOSIGNAL);
+        if (ret > 0) {
+            sent += ret;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd = { mSocket, POLLOUT, 0 };
+            int pret = poll(&pfd, 1, timeoutMsec);
+            if (pret == 0)
+                errno = ETIMEDOUT;
+            if (pret <= 0)
+                return false;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+ModbusPipelineContext::receiveResponses(std::vector<Transaction>& transactions, std::size_t& finished) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    for(std::map<uint16_t, std::size_t>::const_iterator it = mInFlight.begin(); it != mInFlight.end(); it++)
+        deadline = std::min(deadline, transactions[it->second].mDeadline);
+
+    int timeoutMsec = 0;
+    if (deadline > now)
+        timeoutMsec = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+
+    struct pollfd pfd = { mSocket, POLLIN, 0 };
+    int ret = poll(&pfd, 1, timeoutMsec);
+    if (ret == -1)
+        return errno == EINTR;
+
+    if (ret == 0) {
+        now = std::chrono::steady_clock::now();
+        std::map<uint16_t, std::size_t>::iterator it = mInFlight.begin();
+        while(it != mInFlight.end()) {
+            Transaction& tr(transactions[it->second]);
+            if (tr.mDeadline <= now) {
+                tr.mError = ETIMEDOUT;
+                finished++;
+                it = mInFlight.erase(it);
+            } else {
+                it++;
+            }
+        }
+        return true;
+    }
+
+    uint8_t buf[1024];
+    ssize_t count = recv(mSocket, buf, sizeof(buf), 0);
+    if (count == 0) {
+        errno = ECONNRESET;
+        return false;
+    }
+    if (count < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    mReceiveBuffer.insert(mReceiveBuffer.end(), buf, buf + count);
+
+    std::size_t pos = 0;
+    while(mReceiveBuffer.size() - pos >= MbapHeaderSize) {
+        const uint8_t* frame = mReceiveBuffer.data() + pos;
+        uint16_t transactionId = (frame[0] << 8) | frame[1];
+        uint16_t length = (frame[4] << 8) | frame[5];
+        if (length < 2 || length > MaxPduSize + 1) {
+            // we cannot find next frame boundary
+            errno = EPROTO;
+            return false;
+        }
+        std::size_t frameSize = 6 + length;
+        if (mReceiveBuffer.size() - pos < frameSize)
+            break;
+
+        std::map<uint16_t, std::size_t>::iterator it = mInFlight.find(transactionId);
+        if (it == mInFlight.end()) {
+            BOOST_LOG_SEV(log, Log::debug) << "Dropping response with unknown transaction id " << transactionId;
+        } else {
+            Transaction& tr(transactions[it->second]);
+            if (frame[6] != tr.mUnitId)
+                tr.mError = EPROTO;
+            else
+                parseResponse(tr, frame + MbapHeaderSize, length - 1);
+            finished++;
+            mInFlight.erase(it);
+        }
+        pos += frameSize;
+    }
+    mReceiveBuffer.erase(mReceiveBuffer.begin(), mReceiveBuffer.begin() + pos);
+    return true;
+}
+
+void
+ModbusPipelineContext::parseResponse(Transaction& tr, const uint8_t* pdu, std::size_t pduLength) {
+    if (pdu[0] == (tr.mFunction | 0x80)) {
+        // modbus exception, mapped to errno like in libmodbus
+        tr.mError = pduLength > 1 ? MODBUS_ENOBASE + pdu[1] : EPROTO;
+        return;
+    }
+    if (pdu[0] != tr.mFunction) {
+        tr.mError = EPROTO;
+        return;
+    }
+
+    switch(tr.mFunction) {
+        case 0x01:
+        case 0x02: {
+            std::size_t byteCount = (tr.mCount + 7) / 8;
+            if (pduLength < 2 + byteCount || pdu[1] != byteCount) {
+                tr.mError = EPROTO;
+                return;
+            }
+            tr.mValues.resize(tr.mCount);
+            for(int i = 0; i < tr.mCount; i++)
+                tr.mValues[i] = (pdu[2 + i / 8] >> (i % 8)) & 1;
+        }
+        break;
+        case 0x03:
+        case 0x04: {
+            std::size_t byteCount = tr.mCount * 2;
+            if (pduLength < 2 + byteCount || pdu[1] != byteCount) {
+                tr.mError = EPROTO;
+                return;
+            }
+            tr.mValues.resize(tr.mCount);
+            for(int i = 0; i < tr.mCount; i++)
+                tr.mValues[i] = (pdu[2 + i * 2] << 8) | pdu[3 + i * 2];
+        }
+        break;
+        default:
+            // write responses are echo of request
+            if (pduLength < 5)
+                tr.mError = EPROTO;
+    }
+}
+
+void
+ModbusPipelineContext::failInFlight(std::vector<Transaction>& transactions, std::size_t& finished, int error) {
+    for(std::map<uint16_t, std::size_t>::const_iterator it = mInFlight.begin(); it != mInFlight.end(); it++) {
+        transactions[it->second].mError = error;
+        finished++;
+    }
+    mInFlight.clear();
+}
+
+std::string
+ModbusPipelineContext::describe(const Transaction& tr) {
+    bool isWrite = tr.mFunction == 0x05 || tr.mFunction == 0x06;
+    bool isMultipleWrite = tr.mFunction == 0x0F || tr.mFunction == 0x10;
+    std::string ret(isWrite || isMultipleWrite ? "write fn " : "read fn ");
+    ret += std::to_string(tr.mAddress);
+    if (!isWrite && tr.mCount > 1)
+        ret += std::string("-") + std::to_string(tr.mAddress + tr.mCount - 1);
+    return ret + " failed";
+}
+
+} //namespace
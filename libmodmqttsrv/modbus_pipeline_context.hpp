@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+
+#include "config.hpp"
+#include "modbus_messages.hpp"
+#include "logging.hpp"
+#include "register_poll.hpp"
+#include "imodbuscontext.hpp"
+
+namespace modmqttd {
+
+/**
+ * Modbus/TCP client that sends up to pipeline_depth requests
+ * without waiting for responses.
+ *
+ * Responses are matched to requests by MBAP transaction id,
+ * so slave can answer them in any order. Late responses for
+ * requests that timed out are dropped.
+ * */
+class ModbusPipelineContext : public IModbusContext {
+    public:
+        static constexpr std::chrono::milliseconds DefaultResponseTimeout = std::chrono::milliseconds(500);
+
+        virtual void init(const ModbusNetworkConfig& config);
+        virtual void connect();
+        virtual bool isConnected() const { return mSocket != -1; }
+        virtual void disconnect();
+        virtual uint16_t readModbusRegister(int slaveId, const RegisterPoll& regData);
+        virtual std::vector<uint16_t> readModbusRegisters(int slaveId, RegisterType regType, int firstRegister, int count);
+        virtual void readModbusRegisters(std::vector<ModbusReadRequest>& requests);
+        virtual int getMaxPendingRequests() const { return mPipelineDepth; }
+        virtual void writeModbusRegister(const MsgRegisterValue& msg);
+        virtual void writeModbusRegisters(const MsgRegisterValues& msg);
+        virtual ~ModbusPipelineContext() { disconnect(); }
+    private:
+        /**
+         * Single request with its response
+         * */
+        class Transaction {
+            public:
+                uint16_t mTransactionId;
+                uint8_t mUnitId;
+                uint8_t mFunction;
+                uint16_t mAddress;
+                // register count for reads and multiple writes, value for single writes
+                uint16_t mCount;
+                std::chrono::steady_clock::time_point mDeadline;
+                // response data for reads, request data for multiple writes
+                std::vector<uint16_t> mValues;
+                // errno value, 0 if request succeeded
+                int mError = 0;
+        };
+
+        boost::log::sources::severity_logger<Log::severity> log;
+        std::string mAddress;
+        int mPort = 0;
+        int mPipelineDepth = 1;
+        std::chrono::steady_clock::duration mResponseTimeout = DefaultResponseTimeout;
+
+        int mSocket = -1;
+        uint16_t mNextTransactionId = 0;
+        // received bytes not parsed yet
+        std::vector<uint8_t> mReceiveBuffer;
+        // transaction id -> index in executed transactions
+        std::map<uint16_t, std::size_t> mInFlight;
+
+        void initTransaction(Transaction& tr, int slaveId, uint8_t function, int address, uint16_t count);
+        void execute(std::vector<Transaction>& transactions);
+        bool sendRequest(const Transaction& tr);
+        bool receiveResponses(std::vector<Transaction>& transactions, std::size_t& finished);
+        void parseResponse(Transaction& tr, const uint8_t* pdu, std::size_t pduLength);
+        void failInFlight(std::vector<Transaction>& transactions, std::size_t& finished, int error);
+        static std::string describe(const Transaction& tr);
+};
+
+} //namespace
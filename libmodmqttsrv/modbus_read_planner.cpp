@@ -0,0 +1,48 @@
+#include "modbus_read_planner.hpp"
+
+namespace modmqttd {
+
+constexpr int ModbusReadPlanner::MaxReadRegisters;
+constexpr int ModbusReadPlanner::MaxReadBits;
+
+int
+ModbusReadPlanner::getMaxBlockSize(RegisterType regType) {
+    switch(regType) {
+        case RegisterType::COIL:
+        case RegisterType::BIT:
+            return MaxReadBits;
+        default:
+            return MaxReadRegisters;
+    }
+}
+
+std::vector<RegisterReadBlock>
+ModbusReadPlanner::planReads(const std::vector<std::shared_ptr<RegisterPoll>>& registers) const {
+    std::vector<RegisterReadBlock> ret;
+
+    for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = registers.begin();
+        reg_it != registers.end(); reg_it++)
+    {
+        const RegisterPoll& reg = **reg_it;
+        if (ret.size() != 0) {
+            RegisterReadBlock& block(ret.back());
+            int blockEnd = block.mFirstRegister + block.mCount;
+            if (block.mSlaveId == reg.mSlaveId
+                && block.mRegisterType == reg.mRegisterType
+                && reg.mRegister >= block.mFirstRegister
+                && reg.mRegister - blockEnd <= mMaxGap
+                && reg.mRegister - block.mFirstRegister < getMaxBlockSize(reg.mRegisterType))
+            {
+                if (reg.mRegister >= blockEnd)
+                    block.mCount = reg.mRegister - block.mFirstRegister + 1;
+                block.mEnd = reg_it + 1;
+                continue;
+            }
+        }
+        ret.push_back(RegisterReadBlock(reg.mSlaveId, reg.mRegisterType, reg.mRegister, reg_it));
+    }
+
+    return ret;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "modbus_types.hpp"
+#include "register_poll.hpp"
+
+namespace modmqttd {
+
+/**
+ * Range of registers of the same type that can be
+ * read from slave with a single modbus request
+ * */
+class RegisterReadBlock {
+    public:
+        RegisterReadBlock(int slaveId, RegisterType regType, int firstRegister,
+            std::vector<std::shared_ptr<RegisterPoll>>::const_iterator begin)
+            : mSlaveId(slaveId), mRegisterType(regType), mFirstRegister(firstRegister), mCount(1),
+              mBegin(begin), mEnd(begin + 1)
+        {}
+        int mSlaveId;
+        RegisterType mRegisterType;
+        int mFirstRegister;
+        int mCount;
+        // polled registers covered by this block
+        std::vector<std::shared_ptr<RegisterPoll>>::const_iterator mBegin;
+        std::vector<std::shared_ptr<RegisterPoll>>::const_iterator mEnd;
+};
+
+class ModbusReadPlanner {
+    public:
+        // protocol limits for a single read request
+        static constexpr int MaxReadRegisters = 125;
+        static constexpr int MaxReadBits = 2000;
+
+        static int getMaxBlockSize(RegisterType regType);
+
+        /**
+         * maxGap is a number of unused registers that can be
+         * read between polled registers to merge them into one block
+         * */
+        ModbusReadPlanner(int maxGap = 0) : mMaxGap(maxGap) {}
+        void setMaxGap(int maxGap) { mMaxGap = maxGap; }
+
+        /**
+         * Returns list of blocks to read.
+         *
+         * Registers should be sorted by slave id, type and register number,
+         * otherwise planner will generate more blocks than needed.
+         * */
+        std::vector<RegisterReadBlock> planReads(const std::vector<std::shared_ptr<RegisterPoll>>& registers) const;
+    private:
+        int mMaxGap;
+};
+
+}
@@ -1,47 +1,83 @@
+#include <algorithm>
+
 #include "modbus_scheduler.hpp"
 #include "modbus_types.hpp"
 
 namespace modmqttd {
 
-std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>
+void
+ModbusScheduler::push(std::chrono::steady_clock::time_point nextPoll, std::shared_ptr<RegisterPoll>&& reg) {
+    mQueue.push_back(ScheduledPoll{nextPoll, std::move(reg)});
+    std::push_heap(mQueue.begin(), mQueue.end(), LaterFirst());
+}
+
+void
+ModbusScheduler::addRegister(const std::shared_ptr<RegisterPoll>& reg) {
+    std::shared_ptr<RegisterPoll> item(reg);
+    push(reg->getNextPoll(), std::move(item));
+}
+
+void
 ModbusScheduler::getRegistersToPoll(
-    const std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>& registers,
-    std::chrono::steady_clock::duration& outDuration,
+    std::vector<std::shared_ptr<RegisterPoll>>& outRegisters,
     const std::chrono::time_point<std::chrono::steady_clock>& timePoint
 ) {
-    std::map<int, std::vector<std::shared_ptr<RegisterPoll>>> ret;
+    outRegisters.clear();
 
-    //BOOST_LOG_SEV(log, Log::debug) << "initial outduration " << std::chrono::duration_cast<std::chrono::milliseconds>(outDuration).count();
+    while(!mQueue.empty() && mQueue.front().mNextPoll <= timePoint) {
+        std::pop_heap(mQueue.begin(), mQueue.end(), LaterFirst());
+        std::shared_ptr<RegisterPoll> reg(std::move(mQueue.back().mRegister));
+        mQueue.pop_back();
 
-    for(std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::const_iterator slave = registers.begin();
-        slave != registers.end(); slave++)
-    {
-        for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = slave->second.begin();
-            reg_it != slave->second.end(); reg_it++)
-        {
-            const RegisterPoll& reg = **reg_it;
-
-            auto time_passed = timePoint - reg.mLastRead;
-            auto time_to_poll = reg.mRefresh;
-
-            //BOOST_LOG_SEV(log, Log::debug) << "time passed: " << std::chrono::duration_cast<std::chrono::milliseconds>(time_to_poll).count();
-
-            if (time_passed >= reg.mRefresh) {
-                BOOST_LOG_SEV(log, Log::debug) << "Register " << slave->first << "." << reg.mRegister << " (0x" << std::hex << slave->first << ".0x" << std::hex << reg.mRegister << ")"
-                                << " added, last read " << std::chrono::duration_cast<std::chrono::milliseconds>(time_passed).count() << "ms ago";
-                ret[slave->first].push_back(*reg_it);
-            } else {
-                time_to_poll = reg.mRefresh - time_passed;
-            }
-            if (outDuration > time_to_poll) {
-                outDuration = time_to_poll;
-                BOOST_LOG_SEV(log, Log::debug) << "Wait duration set to " << std::chrono::duration_cast<std::chrono::milliseconds>(time_to_poll).count()
-                                << "ms as next poll for register " << slave->first << "." << reg.mRegister << " (0x" << std::hex << slave->first << ".0x" << std::hex << reg.mRegister << ")";
-            }
+        // register could be refreshed by write after it was scheduled
+        auto nextPoll = reg->getNextPoll();
+        if (nextPoll > timePoint) {
+            push(nextPoll, std::move(reg));
+            continue;
         }
+
+        BOOST_LOG_SEV(log, Log::debug) << "Register " << reg->mSlaveId << "." << reg->mRegister << " (0x" << std::hex << reg->mSlaveId << ".0x" << std::hex << reg->mRegister << ")"
+                        << " added, last read " << std::dec << std::chrono::duration_cast<std::chrono::milliseconds>(timePoint - reg->mLastRead).count() << "ms ago";
+        outRegisters.push_back(std::move(reg));
     }
 
+    std::sort(outRegisters.begin(), outRegisters.end(),
+        [](const std::shared_ptr<RegisterPoll>& left, const std::shared_ptr<RegisterPoll>& right) -> bool {
+            return std::tie(left->mSlaveId, left->mRegisterType, left->mRegister)
+                < std::tie(right->mSlaveId, right->mRegisterType, right->mRegister);
+        }
+    );
+}
+
+void
+ModbusScheduler::reschedule(std::vector<std::shared_ptr<RegisterPoll>>& registers) {
+    for(std::vector<std::shared_ptr<RegisterPoll>>::iterator reg_it = registers.begin();
+        reg_it != registers.end(); reg_it++)
+    {
+        const RegisterPoll& reg(**reg_it);
+        push(reg.getNextPoll(), std::move(*reg_it));
+    }
+    registers.clear();
+}
+
+void
+ModbusScheduler::rebuild() {
+    for(std::vector<ScheduledPoll>::iterator it = mQueue.begin(); it != mQueue.end(); it++)
+        it->mNextPoll = it->mRegister->getNextPoll();
+    std::make_heap(mQueue.begin(), mQueue.end(), LaterFirst());
+}
+
+std::chrono::steady_clock::duration
+ModbusScheduler::getWaitDuration(const std::chrono::time_point<std::chrono::steady_clock>& timePoint) {
+    if (mQueue.empty())
+        return std::chrono::steady_clock::duration::max();
+
+    auto ret = mQueue.front().mNextPoll - timePoint;
+    if (ret < std::chrono::steady_clock::duration::zero())
+        return std::chrono::steady_clock::duration::zero();
 
+    BOOST_LOG_SEV(log, Log::debug) << "Wait duration set to " << std::chrono::duration_cast<std::chrono::milliseconds>(ret).count()
+                    << "ms as next poll for register " << mQueue.front().mRegister->mSlaveId << "." << mQueue.front().mRegister->mRegister;
     return ret;
 }
 
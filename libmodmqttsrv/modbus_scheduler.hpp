@@ -11,23 +11,69 @@
 
 namespace modmqttd {
 
+    /**
+     * Keeps registers in a min-heap ordered by next poll time.
+     *
+     * Registers returned by getRegistersToPoll are removed from
+     * the heap and must be returned with reschedule() after poll.
+     * */
     class ModbusScheduler {
         public:
+            void addRegister(const std::shared_ptr<RegisterPoll>& reg);
+            void clear() { mQueue.clear(); }
+            bool isEmpty() const { return mQueue.empty(); }
+
             /**
-             * Returns map of devices with list of registers, that
-             * should be polled now.
+             * Moves registers that should be polled now to outRegisters,
+             * sorted by slave id, register type and register number.
              *
-             * sets outDuration to time period that should be waited
-             * for next poll to be done.
+             * outRegisters is cleared before use, so caller can reuse
+             * the same container without reallocation.
              *
              * */
-            std::map<int, std::vector<std::shared_ptr<RegisterPoll>>> getRegistersToPoll(
-                const std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>& registers,
-                std::chrono::steady_clock::duration& outDuration,
+            void getRegistersToPoll(
+                std::vector<std::shared_ptr<RegisterPoll>>& outRegisters,
+                const std::chrono::time_point<std::chrono::steady_clock>& timePoint
+            );
+
+            /**
+             * Puts polled registers back to the heap. Register is scheduled
+             * for poll after refresh period counted from last read or
+             * last read error, or when its suspension ends.
+             *
+             * registers list is cleared.
+             * */
+            void reschedule(std::vector<std::shared_ptr<RegisterPoll>>& registers);
+
+            /**
+             * Recalculates next poll time of all registers in the heap.
+             * Needed when poll time is moved back, i.e. after
+             * suspended registers are resumed.
+             * */
+            void rebuild();
+
+            /**
+             * Returns time period that should be waited for next poll
+             * to be done. Returns duration::max() if there is nothing to poll.
+             * */
+            std::chrono::steady_clock::duration getWaitDuration(
                 const std::chrono::time_point<std::chrono::steady_clock>& timePoint
             );
         private:
+            struct ScheduledPoll {
+                std::chrono::steady_clock::time_point mNextPoll;
+                std::shared_ptr<RegisterPoll> mRegister;
+            };
+            struct LaterFirst {
+                bool operator() (const ScheduledPoll& left, const ScheduledPoll& right) const {
+                    return left.mNextPoll > right.mNextPoll;
+                }
+            };
+
             boost::log::sources::severity_logger<Log::severity> log;
+            std::vector<ScheduledPoll> mQueue;
+
+            void push(std::chrono::steady_clock::time_point nextPoll, std::shared_ptr<RegisterPoll>&& reg);
     };
 }
 
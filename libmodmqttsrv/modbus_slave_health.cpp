@@ -0,0 +1,35 @@
+#include <algorithm>
+
+#include "modbus_slave_health.hpp"
+
+namespace modmqttd {
+
+constexpr std::chrono::steady_clock::duration ModbusSlaveHealth::MinProbeInterval;
+constexpr std::chrono::steady_clock::duration ModbusSlaveHealth::MaxProbeInterval;
+
+bool
+ModbusSlaveHealth::pollTimedOut(const std::chrono::steady_clock::time_point& now) {
+    bool wasResponding = isResponding();
+    if (mFailedPolls < MaxFailedPolls)
+        mFailedPolls++;
+
+    if (isResponding())
+        return false;
+
+    if (wasResponding)
+        mProbeInterval = MinProbeInterval;
+    else
+        mProbeInterval = std::min(mProbeInterval * 2, MaxProbeInterval);
+    mNextProbe = now + mProbeInterval;
+    return wasResponding;
+}
+
+bool
+ModbusSlaveHealth::pollAnswered() {
+    bool wasResponding = isResponding();
+    mFailedPolls = 0;
+    mProbeInterval = MinProbeInterval;
+    return !wasResponding;
+}
+
+}
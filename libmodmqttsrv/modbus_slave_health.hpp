@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+
+namespace modmqttd {
+
+/**
+ * Tracks if modbus slave answers requests.
+ *
+ * After MaxFailedPolls consecutive polls where all reads timed out
+ * slave is considered dead. Dead slave is probed with a single read,
+ * with probe interval doubled after every failed probe.
+ * */
+class ModbusSlaveHealth {
+    public:
+        static constexpr int MaxFailedPolls = 3;
+        static constexpr std::chrono::steady_clock::duration MinProbeInterval = std::chrono::seconds(1);
+        static constexpr std::chrono::steady_clock::duration MaxProbeInterval = std::chrono::seconds(64);
+
+        bool isResponding() const { return mFailedPolls < MaxFailedPolls; }
+        /**
+         * Call when all reads in poll timed out.
+         * Returns true if slave stopped responding after this poll.
+         * */
+        bool pollTimedOut(const std::chrono::steady_clock::time_point& now);
+        /**
+         * Call when slave answered at least one request in poll.
+         * Returns true if slave was not responding before.
+         * */
+        bool pollAnswered();
+        const std::chrono::steady_clock::time_point& getNextProbe() const { return mNextProbe; }
+        const std::chrono::steady_clock::duration& getProbeInterval() const { return mProbeInterval; }
+    private:
+        int mFailedPolls = 0;
+        std::chrono::steady_clock::duration mProbeInterval = MinProbeInterval;
+        std::chrono::steady_clock::time_point mNextProbe;
+};
+
+}
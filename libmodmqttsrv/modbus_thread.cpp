@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <iterator>
+
 #include "modbus_thread.hpp"
 
 #include "modmqtt.hpp"
@@ -8,54 +11,147 @@
 namespace modmqttd {
 
 ModbusThread::ModbusThread(
-    moodycamel::BlockingReaderWriterQueue<QueueItem>& toModbusQueue,
-    moodycamel::BlockingReaderWriterQueue<QueueItem>& fromModbusQueue)
-    : mToModbusQueue(toModbusQueue), mFromModbusQueue(fromModbusQueue)
+    moodycamel::BlockingReaderWriterQueue<ToModbusQueueItem>& toModbusQueue,
+    moodycamel::BlockingReaderWriterQueue<FromModbusQueueItem>& fromModbusQueue,
+    QueueNotifier::Entry& readyEntry)
+    : mToModbusQueue(toModbusQueue), mFromModbusQueue(fromModbusQueue), mReadyEntry(readyEntry)
 {
 }
 
 void
 ModbusThread::configure(const ModbusNetworkConfig& config) {
     mNetworkName = config.mName;
-    mModbus = ModMqtt::getModbusFactory().getContext(config.mName);
+    mModbus = ModMqtt::getModbusFactory().getContext(config);
     mModbus->init(config);
+    mReadPlanner.setMaxGap(config.mMaxReadGap);
+    mReadAfterWrite = config.mReadAfterWrite;
 }
 
 void
-ModbusThread::pollRegisters(int slaveId, const std::vector<std::shared_ptr<RegisterPoll>>& registers, bool sendIfChanged) {
-    for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = registers.begin();
-        reg_it != registers.end(); reg_it++)
-    {
-        try {
-            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-            u_int16_t newValue;
-            RegisterPoll& reg(**reg_it);
-            newValue = mModbus->readModbusRegister(slaveId, reg);
-            reg.mLastRead = std::chrono::steady_clock::now();
+ModbusThread::pollRegisters(const std::vector<std::shared_ptr<RegisterPoll>>& registers, bool sendIfChanged) {
+    std::vector<RegisterReadBlock> blocks(mReadPlanner.planReads(registers));
+    // pipelined context gets as many blocks as it can send at once,
+    // libmodbus context gets one block at a time
+    std::size_t batchSize = mModbus->getMaxPendingRequests();
+    std::vector<ModbusReadRequest> requests;
+    // blocks are sorted by slave id, health is updated
+    // when all blocks of a slave are processed
+    int currentSlave = -1;
+    bool slaveAnswered = false;
+    bool slaveTimedOut = false;
+    for(std::size_t first = 0; first < blocks.size(); first += batchSize) {
+        //handle incoming write requests
+        //in poll loop to avoid delays
+        processCommands();
+
+        std::size_t last = std::min(first + batchSize, blocks.size());
+        requests.clear();
+        for(std::size_t i = first; i < last; i++)
+            requests.push_back(ModbusReadRequest(blocks[i].mSlaveId, blocks[i].mRegisterType, blocks[i].mFirstRegister, blocks[i].mCount));
 
-            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-            BOOST_LOG_SEV(log, Log::debug) << "Register " << slaveId << "." << reg.mRegister << " (0x" << std::hex << slaveId << ".0x" << std::hex << reg.mRegister << ")"
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mModbus->readModbusRegisters(requests);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        for(std::size_t i = first; i < last; i++) {
+            const RegisterReadBlock& block(blocks[i]);
+            const ModbusReadRequest& request(requests[i - first]);
+            int slaveId = block.mSlaveId;
+            if (mCollectStats) {
+                ModbusSlaveStats& stats(mStats.mSlaves[slaveId]);
+                stats.mReads++;
+                if (!request.mError.empty())
+                    stats.mErrors++;
+                stats.mReadLatency.add(end - start);
+            }
+            if (slaveId != currentSlave) {
+                if (currentSlave != -1)
+                    updateSlaveHealth(currentSlave, slaveAnswered, slaveTimedOut, end);
+                currentSlave = slaveId;
+                slaveAnswered = false;
+                slaveTimedOut = false;
+            }
+            if (!request.mError.empty()) {
+                // exception response means that slave is alive
+                if (request.mErrorCode == ETIMEDOUT)
+                    slaveTimedOut = true;
+                else if (request.mErrorCode >= MODBUS_ENOBASE)
+                    slaveAnswered = true;
+                for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = block.mBegin;
+                    reg_it != block.mEnd; reg_it++)
+                {
+                    handleRegisterReadError(slaveId, **reg_it, request.mError.c_str());
+                }
+                continue;
+            }
+            slaveAnswered = true;
+            BOOST_LOG_SEV(log, Log::debug) << "Registers " << slaveId << "." << block.mFirstRegister
+                            << " (0x" << std::hex << slaveId << ".0x" << std::hex << block.mFirstRegister << ")"
+                            << std::dec << " count " << block.mCount
                             << " polled in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms";
 
-            if ((reg.mLastValue != newValue) || !sendIfChanged || (reg.mReadErrors != 0)) {
-                MsgRegisterValue val(slaveId, reg.mRegisterType, reg.mRegister, newValue);
-                sendMessage(QueueItem::create(val));
-                reg.mLastValue = newValue;
-                reg.mReadErrors = 0;
-                BOOST_LOG_SEV(log, Log::debug) << "Register " << slaveId << "." << reg.mRegister
-                    << " value sent, data=" << reg.mLastValue;
-            };
-            //handle incoming write requests
-            //in poll loop to avoid delays
-            processCommands();
-        } catch (const ModbusReadException& ex) {
-            handleRegisterReadError(slaveId, **reg_it, ex.what());
-        };
+            for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = block.mBegin;
+                reg_it != block.mEnd; reg_it++)
+            {
+                RegisterPoll& reg(**reg_it);
+                u_int16_t newValue = request.mValues[reg.mRegister - block.mFirstRegister];
+                reg.mLastRead = end;
+
+                bool forcePublish = !sendIfChanged;
+                if (!sendIfChanged || reg.shouldPublish(newValue, end, forcePublish)) {
+                    MsgRegisterValue val(slaveId, reg.mRegisterType, reg.mRegister, newValue, forcePublish);
+                    sendMessage(val);
+                    reg.mLastValue = newValue;
+                    reg.mHasLastValue = true;
+                    reg.mLastPublish = end;
+                    reg.mReadErrors = 0;
+                    BOOST_LOG_SEV(log, Log::debug) << "Register " << slaveId << "." << reg.mRegister
+                        << " value sent, data=" << reg.mLastValue;
+                };
+            }
+        }
     };
+    if (currentSlave != -1)
+        updateSlaveHealth(currentSlave, slaveAnswered, slaveTimedOut, std::chrono::steady_clock::now());
 };
 
+void
+ModbusThread::updateSlaveHealth(int slaveId, bool answered, bool timedOut, const std::chrono::steady_clock::time_point& now) {
+    std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::iterator slave = mRegisters.find(slaveId);
+    if (slave == mRegisters.end() || slave->second.empty())
+        return;
+    std::vector<std::shared_ptr<RegisterPoll>>& registers(slave->second);
+    ModbusSlaveHealth& health(mSlaveHealth[slaveId]);
+
+    if (answered) {
+        if (health.pollAnswered()) {
+            BOOST_LOG_SEV(log, Log::info) << "Slave " << slaveId << " is responding again, resuming poll";
+            for(std::vector<std::shared_ptr<RegisterPoll>>::iterator reg_it = registers.begin(); reg_it != registers.end(); reg_it++)
+                (*reg_it)->mSuspendedUntil = std::chrono::steady_clock::time_point();
+            mScheduler.rebuild();
+        }
+    } else if (timedOut) {
+        if (health.pollTimedOut(now)) {
+            BOOST_LOG_SEV(log, Log::error) << "Slave " << slaveId << " is not responding, suspending poll";
+            for(std::vector<std::shared_ptr<RegisterPoll>>::iterator reg_it = registers.begin(); reg_it != registers.end(); reg_it++) {
+                RegisterPoll& reg(**reg_it);
+                reg.mSuspendedUntil = std::chrono::steady_clock::time_point::max();
+                MsgRegisterReadFailed msg(slaveId, reg.mRegisterType, reg.mRegister);
+                sendMessage(msg);
+            }
+        }
+        if (!health.isResponding()) {
+            // single register is used to check if slave is back
+            registers.front()->mSuspendedUntil = health.getNextProbe();
+            BOOST_LOG_SEV(log, Log::debug) << "Next probe of slave " << slaveId << " in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(health.getProbeInterval()).count() << "ms";
+        }
+    }
+}
+
 void
 ModbusThread::handleRegisterReadError(int slaveId, RegisterPoll& regPoll, const char* errorMessage) {
+    regPoll.mLastReadError = std::chrono::steady_clock::now();
     // avoid flooding logs with register read error messages - log last error every 5 minutes
     regPoll.mReadErrors++;
     if (regPoll.mReadErrors == 1 || (std::chrono::steady_clock::now() - regPoll.mFirstErrorTime > RegisterPoll::DurationBetweenLogError)) {
@@ -69,7 +165,7 @@ ModbusThread::handleRegisterReadError(int slaveId, RegisterPoll& regPoll, const
     // start sending MsgRegisterReadFailed if we cannot read register DefaultReadErrorCount times
     if (regPoll.mReadErrors > RegisterPoll::DefaultReadErrorCount) {
         MsgRegisterReadFailed msg(slaveId, regPoll.mRegisterType, regPoll.mRegister);
-        sendMessage(QueueItem::create(msg));
+        sendMessage(msg);
     }
 }
 
@@ -78,8 +174,23 @@ ModbusThread::setPollSpecification(const MsgRegisterPollSpecification& spec) {
     for(std::vector<MsgRegisterPoll>::const_iterator it = spec.mRegisters.begin();
         it != spec.mRegisters.end(); it++)
     {
-        std::shared_ptr<RegisterPoll> reg(new RegisterPoll(it->mRegister, it->mRegisterType, it->mRefreshMsec));
+        std::shared_ptr<RegisterPoll> reg(new RegisterPoll(it->mSlaveId, it->mRegister, it->mRegisterType, it->mRefreshMsec));
+        reg->mPriority = it->mPriority;
+        reg->mRefreshStretch = mLoadShedder.getStretch(reg->mPriority);
+        reg->mFilter = it->mFilter;
         mRegisters[it->mSlaveId].push_back(reg);
+        mScheduler.addRegister(reg);
+    }
+    // keep registers ordered by type and number, so
+    // read planner can merge them into blocks
+    for(std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::iterator slave = mRegisters.begin();
+        slave != mRegisters.end(); slave++)
+    {
+        std::sort(slave->second.begin(), slave->second.end(),
+            [](const std::shared_ptr<RegisterPoll>& left, const std::shared_ptr<RegisterPoll>& right) -> bool {
+                return std::tie(left->mRegisterType, left->mRegister) < std::tie(right->mRegisterType, right->mRegister);
+            }
+        );
     }
     BOOST_LOG_SEV(log, Log::debug) << "Poll specification set, got " << mRegisters.size() << " slaves," << spec.mRegisters.size() << " registers to poll";
 
@@ -90,10 +201,17 @@ void
 ModbusThread::doInitialPoll() {
     BOOST_LOG_SEV(log, Log::debug) << "starting initial poll";
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<RegisterPoll>> registers;
     for(std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::const_iterator slave = mRegisters.begin();
         slave != mRegisters.end(); slave++)
     {
-        pollRegisters(slave->first, slave->second, false);
+        // dead slave is not polled until its probe register is due
+        registers.clear();
+        std::copy_if(slave->second.begin(), slave->second.end(), std::back_inserter(registers),
+            [&start](const std::shared_ptr<RegisterPoll>& reg) -> bool { return reg->mSuspendedUntil <= start; }
+        );
+        if (!registers.empty())
+            pollRegisters(registers, false);
     }
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     BOOST_LOG_SEV(log, Log::info) << "Initial poll done in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms";
@@ -112,73 +230,261 @@ ModbusThread::hasRegisters() const {
     return false;
 }
 
+// register range of a queued write
+static const MsgRegisterMessageBase&
+getWriteTarget(const ToModbusQueueItem& item, std::size_t& count) {
+    if (const MsgRegisterValues* values = std::get_if<MsgRegisterValues>(&item)) {
+        count = values->mValues.size();
+        return *values;
+    }
+    count = 1;
+    return std::get<MsgRegisterValue>(item);
+}
+
+void
+ModbusThread::queueWrite(const ToModbusQueueItem& item) {
+    std::size_t count;
+    const MsgRegisterMessageBase& msg(getWriteTarget(item, count));
+    // older write of the same registers is dropped and new one
+    // is queued last, so writes are sent in order of arrival.
+    // Search stops at overlapping write of other registers
+    for(std::vector<ToModbusQueueItem>::reverse_iterator it = mPendingWrites.rbegin(); it != mPendingWrites.rend(); it++) {
+        std::size_t pendingCount;
+        const MsgRegisterMessageBase& pending(getWriteTarget(*it, pendingCount));
+        if (pending.mSlaveId != msg.mSlaveId || pending.mRegisterType != msg.mRegisterType)
+            continue;
+        if (pending.mRegisterNumber == msg.mRegisterNumber && pendingCount == count) {
+            mPendingWrites.erase(std::next(it).base());
+            mPendingWrites.push_back(item);
+            if (mCollectStats)
+                mStats.mCollapsedWrites++;
+            return;
+        }
+        if (pending.mRegisterNumber < msg.mRegisterNumber + int(count)
+            && msg.mRegisterNumber < pending.mRegisterNumber + int(pendingCount))
+            break;
+    }
+    mPendingWrites.push_back(item);
+}
+
+void
+ModbusThread::processWrites() {
+    for(std::vector<ToModbusQueueItem>::const_iterator it = mPendingWrites.begin(); it != mPendingWrites.end(); it++) {
+        if (const MsgRegisterValues* values = std::get_if<MsgRegisterValues>(&*it))
+            processWrite(*values);
+        else
+            processWrite(std::get<MsgRegisterValue>(*it));
+    }
+    mPendingWrites.clear();
+}
+
+void
+ModbusThread::updateWrittenRegister(int slaveId, RegisterType regType, int regNumber, uint16_t value) {
+    std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::iterator slave = mRegisters.find(slaveId);
+    if (slave == mRegisters.end())
+        return;
+    std::vector<std::shared_ptr<RegisterPoll>>::iterator reg_it = std::find_if(
+        slave->second.begin(), slave->second.end(),
+        [regNumber, regType](const std::shared_ptr<RegisterPoll>& item) -> bool {
+            return regNumber == item->mRegister && regType == item->mRegisterType;
+        }
+    );
+    if (reg_it != slave->second.end()) {
+        RegisterPoll& reg = **reg_it;
+        reg.mLastValue = value;
+        reg.mHasLastValue = true;
+        reg.mLastRead = std::chrono::steady_clock::now();
+        reg.mLastPublish = reg.mLastRead;
+        if (mReadAfterWrite) {
+            // value is sent by readWrittenRegisters()
+            mWrittenRegisters.push_back(*reg_it);
+        } else {
+            MsgRegisterValue val(slaveId, regType, regNumber, value);
+            sendMessage(val);
+        }
+    }
+}
+
+void
+ModbusThread::readWrittenRegisters() {
+    if (mWrittenRegisters.empty())
+        return;
+    std::sort(mWrittenRegisters.begin(), mWrittenRegisters.end(),
+        [](const std::shared_ptr<RegisterPoll>& left, const std::shared_ptr<RegisterPoll>& right) -> bool {
+            return std::tie(left->mSlaveId, left->mRegisterType, left->mRegister) < std::tie(right->mSlaveId, right->mRegisterType, right->mRegister);
+        }
+    );
+    mWrittenRegisters.erase(std::unique(mWrittenRegisters.begin(), mWrittenRegisters.end()), mWrittenRegisters.end());
+
+    std::vector<RegisterReadBlock> blocks(mReadPlanner.planReads(mWrittenRegisters));
+    std::vector<ModbusReadRequest> requests;
+    for(std::vector<RegisterReadBlock>::const_iterator block = blocks.begin(); block != blocks.end(); block++) {
+        requests.assign(1, ModbusReadRequest(block->mSlaveId, block->mRegisterType, block->mFirstRegister, block->mCount));
+        mModbus->readModbusRegisters(requests);
+        const ModbusReadRequest& request(requests.front());
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        // written value is sent if device cannot be read
+        if (!request.mError.empty())
+            BOOST_LOG_SEV(log, Log::error) << "error reading back registers " << block->mSlaveId << "."
+                << block->mFirstRegister << ": " << request.mError;
+        for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = block->mBegin;
+            reg_it != block->mEnd; reg_it++)
+        {
+            RegisterPoll& reg(**reg_it);
+            if (request.mError.empty()) {
+                reg.mLastValue = request.mValues[reg.mRegister - block->mFirstRegister];
+                reg.mLastRead = end;
+                reg.mLastPublish = end;
+            }
+            MsgRegisterValue val(reg.mSlaveId, reg.mRegisterType, reg.mRegister, reg.mLastValue);
+            sendMessage(val);
+        }
+    }
+    mWrittenRegisters.clear();
+}
+
+void
+ModbusThread::addCommandLatency(const std::chrono::steady_clock::time_point& commandTime) {
+    if (!mCollectStats || commandTime == std::chrono::steady_clock::time_point())
+        return;
+    mStats.mCommandLatency.add(std::chrono::steady_clock::now() - commandTime);
+}
+
 void
 ModbusThread::processWrite(const MsgRegisterValue& msg) {
     try {
+        if (mCollectStats)
+            mStats.mWrites++;
         mModbus->writeModbusRegister(msg);
+        addCommandLatency(msg.mCommandTime);
         //send state change immediately if we
         //are polling this register
-        std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::iterator slave = mRegisters.find(msg.mSlaveId);
-        if (slave != mRegisters.end()) {
-            int regNumber = msg.mRegisterNumber;
-            std::vector<std::shared_ptr<RegisterPoll>>::iterator reg_it = std::find_if(
-                slave->second.begin(), slave->second.end(),
-                [&regNumber](const std::shared_ptr<RegisterPoll>& item) -> bool { return regNumber == item->mRegister; }
-            );
-            if (reg_it != slave->second.end()) {
-                RegisterPoll& reg = **reg_it;
-                reg.mLastValue = msg.mValue;
-                reg.mLastRead = std::chrono::steady_clock::now();
-                MsgRegisterValue val(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber, msg.mValue);
-                sendMessage(QueueItem::create(val));
-            }
-        }
+        updateWrittenRegister(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber, msg.mValue);
     } catch (const ModbusWriteException& ex) {
+        addCommandLatency(msg.mCommandTime);
         BOOST_LOG_SEV(log, Log::error) << "error writing register "
             << msg.mSlaveId << "." << msg.mRegisterNumber << ": " << ex.what();
         MsgRegisterWriteFailed msg(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber);
-        sendMessage(QueueItem::create(msg));
+        sendMessage(msg);
     }
 }
 
 void
-ModbusThread::dispatchMessages(const QueueItem& readed) {
-    QueueItem item(readed);
-    bool gotItem = true;
-    // WARNING: dispatch loop can be run from inside pollRegisters loop
-    // when processing commands
-    // do not call pollRegisters when handing incoming messages!
-    do {
-        if (item.isSameAs(typeid(ModbusNetworkConfig))) {
-            configure(*item.getData<ModbusNetworkConfig>());
-        } else if (item.isSameAs(typeid(MsgRegisterPollSpecification))) {
-            setPollSpecification(*item.getData<MsgRegisterPollSpecification>());
-        } else if (item.isSameAs(typeid(EndWorkMessage))) {
+ModbusThread::processWrite(const MsgRegisterValues& msg) {
+    try {
+        if (mCollectStats)
+            mStats.mWrites++;
+        mModbus->writeModbusRegisters(msg);
+        addCommandLatency(msg.mCommandTime);
+        for(std::size_t i = 0; i < msg.mValues.size(); i++)
+            updateWrittenRegister(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber + i, msg.mValues[i]);
+    } catch (const ModbusWriteException& ex) {
+        addCommandLatency(msg.mCommandTime);
+        BOOST_LOG_SEV(log, Log::error) << "error writing registers "
+            << msg.mSlaveId << "." << msg.mRegisterNumber << "-" << msg.mRegisterNumber + msg.mValues.size() - 1
+            << ": " << ex.what();
+        for(std::size_t i = 0; i < msg.mValues.size(); i++)
+            sendMessage(MsgRegisterWriteFailed(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber + i));
+    }
+}
+
+void
+ModbusThread::sendStats() {
+    mCollectStats = true;
+    mStats.mRefreshStretch = mLoadShedder.getStretch();
+    std::shared_ptr<const ModbusThreadStats> stats(new ModbusThreadStats(mStats));
+    mStats = ModbusThreadStats();
+    sendMessage(stats);
+}
+
+bool
+ModbusThread::updateLateness(const std::chrono::steady_clock::time_point& start) {
+    bool hasLateRegisters = false;
+    std::chrono::steady_clock::duration maxLateness = std::chrono::steady_clock::duration::zero();
+    for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = mRegistersToPoll.begin();
+        reg_it != mRegistersToPoll.end(); reg_it++)
+    {
+        RegisterPoll& reg(**reg_it);
+        // registers retried after read error
+        // are not counted
+        if (!reg.mHasLastValue || reg.mReadErrors != 0) {
+            reg.mLateness = std::chrono::steady_clock::duration::zero();
+            continue;
+        }
+        reg.mLateness = std::max(start - reg.getNextPoll(), std::chrono::steady_clock::duration::zero());
+        if (reg.mLateness > maxLateness)
+            maxLateness = reg.mLateness;
+        if (ModbusLoadShedder::isLate(reg))
+            hasLateRegisters = true;
+    }
+    if (mCollectStats)
+        mStats.mLateness.add(maxLateness);
+    return hasLateRegisters;
+}
+
+void
+ModbusThread::applyRefreshStretch() {
+    BOOST_LOG_SEV(log, Log::warn) << "Refresh stretch changed for network " << mNetworkName
+        << ", normal priority x" << mLoadShedder.getStretch(PollPriority::NORMAL)
+        << ", low priority x" << mLoadShedder.getStretch(PollPriority::LOW);
+    for(std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::const_iterator slave = mRegisters.begin();
+        slave != mRegisters.end(); slave++)
+    {
+        for(std::vector<std::shared_ptr<RegisterPoll>>::const_iterator reg_it = slave->second.begin();
+            reg_it != slave->second.end(); reg_it++)
+        {
+            RegisterPoll& reg(**reg_it);
+            reg.mRefreshStretch = mLoadShedder.getStretch(reg.mPriority);
+            BOOST_LOG_SEV(log, Log::debug) << "Register " << reg.mSlaveId << "." << reg.mRegister << " effective refresh "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(reg.getEffectiveRefresh()).count() << "ms";
+        }
+    }
+    mScheduler.rebuild();
+}
+
+void
+ModbusThread::dispatchMessage(const ToModbusQueueItem& item) {
+    std::visit(QueueItemVisitor {
+        [this](const std::shared_ptr<const ModbusNetworkConfig>& config) { configure(*config); },
+        [this](const std::shared_ptr<const MsgRegisterPollSpecification>& spec) { setPollSpecification(*spec); },
+        [this](const EndWorkMessage&) {
             BOOST_LOG_SEV(log, Log::debug) << "Got exit command";
             mShouldRun = false;
-        } else if (item.isSameAs(typeid(MsgRegisterValue))) {
-            processWrite(*item.getData<MsgRegisterValue>());
-        } else if (item.isSameAs(typeid(MsgMqttNetworkState))) {
-            std::unique_ptr<MsgMqttNetworkState> netstate(item.getData<MsgMqttNetworkState>());
-            mShouldPoll = netstate->mIsUp;
-        } else {
-            BOOST_LOG_SEV(log, Log::error) << "Unknown messsage received, ignoring";
+        },
+        // writes are sent after all queued messages are read,
+        // see processCommands()
+        [this, &item](const MsgRegisterValue&) { queueWrite(item); },
+        [this, &item](const MsgRegisterValues&) { queueWrite(item); },
+        [this](const MsgMqttNetworkState& netstate) { mShouldPoll = netstate.mIsUp; },
+        [this](const MsgCollectStats&) { sendStats(); },
+        [this](const std::monostate&) {
+            BOOST_LOG_SEV(log, Log::error) << "Empty messsage received, ignoring";
         }
-        gotItem = mToModbusQueue.try_dequeue(item);
-    } while(gotItem);
+    }, item);
+}
+
+void
+ModbusThread::dispatchMessages(const ToModbusQueueItem& readed) {
+    // WARNING: dispatch loop can be run from inside pollRegisters loop
+    // when processing commands
+    // do not call pollRegisters when handing incoming messages!
+    dispatchMessage(readed);
+    processCommands();
 }
 
 void
 ModbusThread::processCommands() {
-    QueueItem item;
+    ToModbusQueueItem item;
     while(mToModbusQueue.try_dequeue(item))
-        dispatchMessages(item);
+        dispatchMessage(item);
+    processWrites();
+    readWrittenRegisters();
 }
 
 void
-ModbusThread::sendMessage(const QueueItem& item) {
+ModbusThread::sendMessage(const FromModbusQueueItem& item) {
     mFromModbusQueue.enqueue(item);
-    modmqttd::notifyQueues();
+    gQueueNotifier.notify(mReadyEntry);
 }
 
 void
@@ -196,7 +502,7 @@ ModbusThread::run() {
                     mModbus->connect();
                     if (mModbus->isConnected()) {
                         BOOST_LOG_SEV(log, Log::info) << "modbus: connected";
-                        sendMessage(QueueItem::create(MsgModbusNetworkState(mNetworkName, true)));
+                        sendMessage(MsgModbusNetworkState(mNetworkName, true));
                         mNeedInitialPoll = true;
                     }
                 }
@@ -211,34 +517,32 @@ ModbusThread::run() {
                         if (mNeedInitialPoll)
                             doInitialPoll();
 
-                        //initial wait set to infinity, scheduler will adjust this value
-                        //to time period for next poll
-                        waitDuration = std::chrono::steady_clock::duration::max();
-
                         // note start time and find registers that need a refresh now
                         auto start = std::chrono::steady_clock::now();
-                        std::map<int, std::vector<std::shared_ptr<RegisterPoll>>> toRefresh = mScheduler.getRegistersToPoll(mRegisters, waitDuration, start);
-                        for(std::map<int, std::vector<std::shared_ptr<RegisterPoll>>>::const_iterator slave = toRefresh.begin();
-                            slave != toRefresh.end(); slave++)
-                        {
+                        mScheduler.getRegistersToPoll(mRegistersToPoll, start);
+                        bool polled = mRegistersToPoll.size() != 0;
+                        if (polled) {
+                            bool hasLateRegisters = updateLateness(start);
                             //this may call processCommands
-                            pollRegisters(slave->first, slave->second);
+                            pollRegisters(mRegistersToPoll);
+                            mScheduler.reschedule(mRegistersToPoll);
+                            if (mLoadShedder.cycleFinished(hasLateRegisters))
+                                applyRefreshStretch();
                         }
-                        //decrease time to next poll by last poll time
-                        if (toRefresh.size() != 0) {
-                            auto pollDuration = std::chrono::steady_clock::now() - start;
-                            waitDuration -= pollDuration;
-                            if (waitDuration < std::chrono::steady_clock::duration::zero()) {
-                                BOOST_LOG_SEV(log, Log::debug) << "Next poll is eariler than current poll time (" <<  std::chrono::duration_cast<std::chrono::milliseconds>(waitDuration).count() << "ms)";
-                                waitDuration = std::chrono::steady_clock::duration::zero();
-                            }
+
+                        auto end = std::chrono::steady_clock::now();
+                        if (mCollectStats && polled)
+                            mStats.mPollCycleTime.add(end - start);
+                        waitDuration = mScheduler.getWaitDuration(end);
+                        if (waitDuration == std::chrono::steady_clock::duration::zero()) {
+                            BOOST_LOG_SEV(log, Log::debug) << "Next poll is eariler than current poll time";
                         }
                     } else {
                         BOOST_LOG_SEV(log, Log::info) << "Waiting for mqtt network to become online";
                         waitDuration = std::chrono::steady_clock::duration::max();
                     }
                 } else {
-                    sendMessage(QueueItem::create(MsgModbusNetworkState(mNetworkName, false)));
+                    sendMessage(MsgModbusNetworkState(mNetworkName, false));
                     if (waitDuration < std::chrono::seconds(maxReconnectTime))
                         waitDuration += std::chrono::seconds(5);
                 };
@@ -250,7 +554,7 @@ ModbusThread::run() {
             //register polling can change mShouldRun flag, do not wait
             //for next poll if we are exiting
             if (mShouldRun) {
-                QueueItem item;
+                ToModbusQueueItem item;
                 BOOST_LOG_SEV(log, Log::debug) << "Waiting " <<  std::chrono::duration_cast<std::chrono::milliseconds>(waitDuration).count() << "ms for messages";
                 if (!mToModbusQueue.wait_dequeue_timed(item, waitDuration))
                     continue;
@@ -6,23 +6,34 @@
 #include "queue_item.hpp"
 #include "modbus_messages.hpp"
 #include "modbus_scheduler.hpp"
+#include "modbus_read_planner.hpp"
+#include "modbus_slave_health.hpp"
+#include "modbus_load_shedder.hpp"
+#include "metrics.hpp"
 #include "imodbuscontext.hpp"
+#include "queue_notifier.hpp"
 
 namespace modmqttd {
 
 class ModbusThread {
     public:
         ModbusThread(
-            moodycamel::BlockingReaderWriterQueue<QueueItem>& toModbusQueue,
-            moodycamel::BlockingReaderWriterQueue<QueueItem>& fromModbusQueue);
+            moodycamel::BlockingReaderWriterQueue<ToModbusQueueItem>& toModbusQueue,
+            moodycamel::BlockingReaderWriterQueue<FromModbusQueueItem>& fromModbusQueue,
+            QueueNotifier::Entry& readyEntry);
         void run();
     private:
         boost::log::sources::severity_logger<Log::severity> log;
-        moodycamel::BlockingReaderWriterQueue<QueueItem>& mToModbusQueue;
-        moodycamel::BlockingReaderWriterQueue<QueueItem>& mFromModbusQueue;
+        moodycamel::BlockingReaderWriterQueue<ToModbusQueueItem>& mToModbusQueue;
+        moodycamel::BlockingReaderWriterQueue<FromModbusQueueItem>& mFromModbusQueue;
+        // main thread is notified only when it took messages sent before
+        QueueNotifier::Entry& mReadyEntry;
 
         std::string mNetworkName;
         std::map<int, std::vector<std::shared_ptr<RegisterPoll>>> mRegisters;
+        // registers from scheduler that should be polled now,
+        // reused between polls to avoid reallocation
+        std::vector<std::shared_ptr<RegisterPoll>> mRegistersToPoll;
         bool mShouldRun = true;
         // true if mqtt becomes online
         // and we need to refresh all registers
@@ -33,27 +44,55 @@ class ModbusThread {
 
         std::shared_ptr<IModbusContext> mModbus;
         ModbusScheduler mScheduler;
+        ModbusReadPlanner mReadPlanner;
+        std::map<int, ModbusSlaveHealth> mSlaveHealth;
+        ModbusLoadShedder mLoadShedder;
+        // statistics are collected after first MsgCollectStats
+        // to avoid overhead when metrics are disabled
+        bool mCollectStats = false;
+        ModbusThreadStats mStats;
+        // writes received since last processWrites(). Newer write
+        // of the same registers replaces the queued one
+        std::vector<ToModbusQueueItem> mPendingWrites;
+        bool mReadAfterWrite = false;
+        // polled registers written by processWrites(), to be read back
+        std::vector<std::shared_ptr<RegisterPoll>> mWrittenRegisters;
 
         void configure(const ModbusNetworkConfig& config);
         void setPollSpecification(const MsgRegisterPollSpecification& spec);
-        void pollRegisters(int slaveId, const std::vector<std::shared_ptr<RegisterPoll>>& registers, bool sendIfChanged = true);
+        void pollRegisters(const std::vector<std::shared_ptr<RegisterPoll>>& registers, bool sendIfChanged = true);
         void doInitialPoll();
 
         bool hasRegisters() const;
 
-        void dispatchMessages(const QueueItem& readed);
-        void sendMessage(const QueueItem& item);
+        void dispatchMessages(const ToModbusQueueItem& readed);
+        void dispatchMessage(const ToModbusQueueItem& item);
+        void sendMessage(const FromModbusQueueItem& item);
 
         void handleRegisterReadError(int slaveId, RegisterPoll& regPoll, const char* errorMessage);
+        // suspends or resumes slave registers poll depending on slave health
+        void updateSlaveHealth(int slaveId, bool answered, bool timedOut, const std::chrono::steady_clock::time_point& now);
 
+        void queueWrite(const ToModbusQueueItem& item);
+        void processWrites();
         void processWrite(const MsgRegisterValue& msg);
+        void processWrite(const MsgRegisterValues& msg);
+        // sends written value if register is polled
+        void updateWrittenRegister(int slaveId, RegisterType regType, int regNumber, uint16_t value);
+        void readWrittenRegisters();
+        void addCommandLatency(const std::chrono::steady_clock::time_point& commandTime);
+        void sendStats();
+        // sets lateness of registers to poll, returns true if any of them is late
+        bool updateLateness(const std::chrono::steady_clock::time_point& start);
+        void applyRefreshStretch();
 
+        /**
+         * Priority lane: handles queued messages, then sends
+         * pending writes and read back of written registers.
+         * Called before every poll request, so commands wait
+         * at most for a single request already on the wire.
+         * */
         void processCommands();
-
-        std::map<int, std::vector<std::shared_ptr<RegisterPoll>>> getListToRefresh(
-            std::chrono::steady_clock::duration& outDuration,
-            const std::chrono::time_point<std::chrono::steady_clock>& timePoint
-        );
 };
 
 }
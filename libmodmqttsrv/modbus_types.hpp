@@ -9,4 +9,12 @@ enum RegisterType {
     INPUT = 4
 };
 
+// refresh of lower priority registers is
+// stretched first when network is overloaded
+enum PollPriority {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2
+};
+
 }
@@ -13,6 +13,7 @@
 #include "modbus_messages.hpp"
 #include "modbus_context.hpp"
 #include "conv_name_parser.hpp"
+#include "converter_adapter.hpp"
 
 #include <csignal>
 #include <iostream>
@@ -30,9 +31,6 @@ void signal_handler(int signal)
 
 namespace modmqttd {
 
-std::mutex gQueueMutex;
-std::condition_variable gHasMessagesCondition;
-bool gHasMessages = false;
 std::shared_ptr<IModbusFactory> ModMqtt::mModbusFactory;
 
 
@@ -77,9 +75,7 @@ class RegisterConfigName {
 
 void
 notifyQueues() {
-    std::unique_lock<std::mutex> lock(gQueueMutex);
-    gHasMessages = true;
-	gHasMessagesCondition.notify_one();
+    gQueueNotifier.notify();
 }
 
 RegisterType
@@ -108,21 +104,33 @@ parsePayloadType(const YAML::Node& data) {
 }
 
 MqttObjectCommand
-readCommand(const YAML::Node& node, const std::string& default_network, int default_slave) {
+ModMqtt::readCommand(const YAML::Node& node, const std::string& default_network, int default_slave, int default_qos) {
     std::string name = ConfigTools::readRequiredString(node, "name");
     RegisterConfigName rname(node, default_network, default_slave);
     RegisterType rType = parseRegisterType(node);
     MqttObjectCommand::PayloadType pType = parsePayloadType(node);
-    return MqttObjectCommand(
+    MqttObjectCommand cmd(
         name,
         MqttObjectRegisterIdent(
-            rname.mNetworkName,
+            getNetworkId(rname.mNetworkName),
             rname.mSlaveId,
             rType,
             rname.mRegisterNumber
             ),
         pType
     );
+    cmd.mQos = default_qos;
+    if (ConfigTools::readOptionalValue<int>(cmd.mQos, node, "qos") && (cmd.mQos < 0 || cmd.mQos > 2))
+        throw ConfigurationException(node["qos"].Mark(), "qos must be 0, 1 or 2");
+    if (ConfigTools::readOptionalValue<int>(cmd.mCount, node, "count")) {
+        // modbus limits for write multiple coils and registers
+        int maxCount = (rType == RegisterType::COIL) ? 1968 : 123;
+        if (rType != RegisterType::COIL && rType != RegisterType::HOLDING)
+            throw ConfigurationException(node["count"].Mark(), "count can be set only for coil and holding registers");
+        if (cmd.mCount < 1 || cmd.mCount > maxCount)
+            throw ConfigurationException(node["count"].Mark(), "count must be between 1 and " + std::to_string(maxCount));
+    }
+    return cmd;
 }
 
 ModMqtt::ModMqtt()
@@ -130,6 +138,7 @@ ModMqtt::ModMqtt()
     // unit tests create main class multiple times
     // reset global flag at each creation
     gSignalStatus = -1;
+    gQueueNotifier.reset();
     Mosquitto::libInit();
     mMqtt.reset(new MqttClient(*this));
     mModbusFactory.reset(new ModbusFactory());
@@ -163,7 +172,7 @@ ModMqtt::init(const YAML::Node& config) {
             BOOST_LOG_SEV(log, Log::error) << "Modbus client for " << netname << " not initailized, ignoring specification";
         } else {
             BOOST_LOG_SEV(log, Log::debug) << "Sending register specification to modbus thread for network " << netname;
-            (*client)->mToModbusQueue.enqueue(QueueItem::create(*sit));
+            (*client)->sendPollSpecification(*sit);
         }
     };
 }
@@ -174,6 +183,13 @@ ModMqtt::initServer(const YAML::Node& config) {
     if (!server.IsDefined())
         return;
 
+    int conversionThreads = 0;
+    if (ConfigTools::readOptionalValue<int>(conversionThreads, server, "conversion_threads")) {
+        if (conversionThreads < 0)
+            throw ConfigurationException(server["conversion_threads"].Mark(), "conversion_threads cannot be negative");
+        mMqtt->setConversionThreads(conversionThreads);
+    }
+
     const YAML::Node& conv_paths = server["converter_search_path"];
     if (conv_paths.IsDefined()) {
         if (conv_paths.IsSequence()) {
@@ -264,6 +280,27 @@ void ModMqtt::initBroker(const YAML::Node& config) {
 
     mMqtt->setBrokerConfig(brokerConfig);
     BOOST_LOG_SEV(log, Log::debug) << "Broker configuration initialized";
+
+    const YAML::Node& subscriptions = mqtt["command_subscriptions"];
+    if (subscriptions.IsDefined()) {
+        if (!subscriptions.IsSequence())
+            throw ConfigurationException(subscriptions.Mark(), "mqtt.command_subscriptions must be a list");
+        std::vector<std::string> filters;
+        for(std::size_t i = 0; i < subscriptions.size(); i++)
+            filters.push_back(ConfigTools::readRequiredValue<std::string>(subscriptions[i]));
+        mMqtt->setCommandSubscriptions(filters);
+    }
+
+    const YAML::Node& metrics = mqtt["metrics"];
+    if (metrics.IsDefined()) {
+        MetricsConfig metricsConfig;
+        metricsConfig.mTopic = ConfigTools::readRequiredString(metrics, "topic");
+        ConfigTools::readOptionalTimespan(metricsConfig.mIntervalMsec, metrics, "interval");
+        if (metricsConfig.mIntervalMsec <= 0)
+            throw ConfigurationException(metrics.Mark(), "metrics interval must be greater than zero");
+        mMetrics.setConfig(metricsConfig);
+        BOOST_LOG_SEV(log, Log::info) << "Publishing metrics on " << metricsConfig.mTopic << " every " << metricsConfig.mIntervalMsec << "ms";
+    }
 }
 
 void ModMqtt::initModbusClients(const YAML::Node& config) {
@@ -284,7 +321,7 @@ void ModMqtt::initModbusClients(const YAML::Node& config) {
         ModbusNetworkConfig modbus_config(networks[i]);
 
         std::shared_ptr<ModbusClient> modbus(new ModbusClient());
-        modbus->init(modbus_config);
+        modbus->init(getNetworkId(modbus_config.mName), modbus_config);
         mModbusClients.push_back(modbus);
     }
     mMqtt->setModbusClients(mModbusClients);
@@ -292,26 +329,67 @@ void ModMqtt::initModbusClients(const YAML::Node& config) {
 }
 
 bool
-ModMqtt::parseAndAddRefresh(std::stack<int>& values, const YAML::Node& data) {
-    std::string str;
-    if (!ConfigTools::readOptionalValue<std::string>(str, data, "refresh"))
-        return false;
+ModMqtt::parseAndAddPollSettings(std::stack<RegisterPollSettings>& values, const YAML::Node& data) {
+    RegisterPollSettings settings(values.top());
+    bool hasSettings = false;
+
+    if (ConfigTools::readOptionalTimespan(settings.mRefreshMsec, data, "refresh"))
+        hasSettings = true;
+
+    std::string priority;
+    if (ConfigTools::readOptionalValue<std::string>(priority, data, "priority")) {
+        if (priority == "high")
+            settings.mPriority = PollPriority::HIGH;
+        else if (priority == "normal")
+            settings.mPriority = PollPriority::NORMAL;
+        else if (priority == "low")
+            settings.mPriority = PollPriority::LOW;
+        else
+            throw ConfigurationException(data["priority"].Mark(), std::string("Unknown priority ") + priority);
+        hasSettings = true;
+    }
 
-    std::regex re("([0-9]+)(ms|s|min)");
-    std::cmatch matches;
+    std::string deadband;
+    if (ConfigTools::readOptionalValue<std::string>(deadband, data, "deadband")) {
+        boost::trim(deadband);
+        settings.mFilter.mDeadbandPercent = !deadband.empty() && deadband.back() == '%';
+        if (settings.mFilter.mDeadbandPercent)
+            deadband.pop_back();
+        try {
+            std::size_t pos;
+            settings.mFilter.mDeadband = std::stod(deadband, &pos);
+            if (pos != deadband.size())
+                throw std::invalid_argument(deadband);
+        } catch (const std::logic_error&) {
+            throw ConfigurationException(data["deadband"].Mark(), "Invalid deadband value");
+        }
+        if (settings.mFilter.mDeadband < 0)
+            throw ConfigurationException(data["deadband"].Mark(), "deadband cannot be negative");
+        hasSettings = true;
+    }
 
-    if (!std::regex_match(str.c_str(), matches, re))
-        throw ConfigurationException(data["refresh"].Mark(), "Invalid refresh time");
+    if (ConfigTools::readOptionalValue<bool>(settings.mFilter.mDeadbandSigned, data, "deadband_signed"))
+        hasSettings = true;
+    if (ConfigTools::readOptionalTimespan(settings.mFilter.mMinPublishMsec, data, "min_publish_interval"))
+        hasSettings = true;
+    if (ConfigTools::readOptionalTimespan(settings.mFilter.mMaxSilenceMsec, data, "max_silence"))
+        hasSettings = true;
 
-    int value = std::stoi(matches[1]);
-    std::string unit = matches[2];
-    if (unit == "s")
-        value *= 1000;
-    else if (unit == "min")
-        value *= 1000 * 60;
+    if (hasSettings)
+        values.push(settings);
+    return hasSettings;
+}
 
-    values.push(value);
-    return true;
+void
+ModMqtt::readPublishProps(MqttPublishProps& props, const YAML::Node& data) {
+    if (ConfigTools::readOptionalValue<int>(props.mQos, data, "qos") && (props.mQos < 0 || props.mQos > 2))
+        throw ConfigurationException(data["qos"].Mark(), "qos must be 0, 1 or 2");
+    ConfigTools::readOptionalValue<bool>(props.mRetain, data, "retain");
+
+    int expiryMsec = 0;
+    // MQTT expiry interval is in seconds, round up
+    if (ConfigTools::readOptionalTimespan(expiryMsec, data, "message_expiry"))
+        props.mMessageExpirySec = (expiryMsec + 999) / 1000;
 }
 
 void
@@ -320,12 +398,15 @@ ModMqtt::readObjectState(
     const std::string& default_network,
     int default_slave,
     std::vector<MsgRegisterPollSpecification>& specs_out,
-    std::stack<int>& currentRefresh,
+    std::stack<RegisterPollSettings>& currentSettings,
     const YAML::Node& state)
 {
     if (!state.IsDefined())
         return;
 
+    // converter instances are shared only inside a single object,
+    // objects can be converted by different conversion threads
+    std::map<std::string, std::shared_ptr<IStateConverterV2>> converters;
     bool is_unnamed = true;
     if (state.IsMap()) {
         //a map can contain name, converter and one or more registers
@@ -340,13 +421,16 @@ ModMqtt::readObjectState(
         if (node.IsDefined()) {
             if (!node.IsSequence())
                 throw ConfigurationException(node.Mark(), "registers content should be a list");
+            // converter creates a single value from all registers,
+            // e.g. int32 or float, so they must be published together
+            bool isMultiRegisterValue = converter.IsDefined() && node.size() > 1;
             for(size_t i = 0; i < node.size(); i++) {
                 const YAML::Node& regdata = node[i];
-                readObjectStateNode(object, default_network, default_slave, specs_out, currentRefresh, name, regdata);
+                readObjectStateNode(object, default_network, default_slave, specs_out, currentSettings, converters, name, regdata, isMultiRegisterValue);
             };
         } else {
             //single named register
-            readObjectStateNode(object, default_network, default_slave, specs_out, currentRefresh, name, state);
+            readObjectStateNode(object, default_network, default_slave, specs_out, currentSettings, converters, name, state);
         }
     } else if (state.IsSequence()) {
         std::string name;
@@ -357,12 +441,12 @@ ModMqtt::readObjectState(
             else if (!is_unnamed)
                 throw ConfigurationException(regdata.Mark(), "missing name attribute");
             const YAML::Node& converter = state["converter"];
-            readObjectStateNode(object, default_network, default_slave, specs_out, currentRefresh, name, regdata);
+            readObjectStateNode(object, default_network, default_slave, specs_out, currentSettings, converters, name, regdata);
         }
     }
 }
 
-std::shared_ptr<IStateConverter>
+std::shared_ptr<IStateConverterV2>
 ModMqtt::createConverter(const YAML::Node& node) const {
     if (!node.IsScalar())
         throw ConfigurationException(node.Mark(), "converter must be a string");
@@ -371,7 +455,7 @@ ModMqtt::createConverter(const YAML::Node& node) const {
     try {
         ConverterSpecification spec(ConverterNameParser::parse(line));
 
-        std::shared_ptr<IStateConverter> conv = createConverterInstance(spec.plugin, spec.converter);
+        std::shared_ptr<IStateConverterV2> conv = createConverterInstance(spec.plugin, spec.converter);
         if (conv == nullptr)
             throw ConfigurationException(node.Mark(), "Converter " + spec.plugin + "." + spec.converter + " not found");
         try {
@@ -385,7 +469,7 @@ ModMqtt::createConverter(const YAML::Node& node) const {
     }
 }
 
-std::shared_ptr<IStateConverter>
+std::shared_ptr<IStateConverterV2>
 ModMqtt::createConverterInstance(const std::string pluginName, const std::string& converter) const {
     auto it = std::find_if(
         mConverterPlugins.begin(),
@@ -398,8 +482,13 @@ ModMqtt::createConverterInstance(const std::string pluginName, const std::string
         return nullptr;
     }
 
-    std::shared_ptr<IStateConverter> ret((*it)->getStateConverter(converter));
-    return ret;
+    IStateConverter* conv = (*it)->getStateConverter(converter);
+    if (conv == nullptr)
+        return nullptr;
+    IStateConverterV2* convV2 = dynamic_cast<IStateConverterV2*>(conv);
+    if (convV2 != nullptr)
+        return std::shared_ptr<IStateConverterV2>(convV2);
+    return std::make_shared<LegacyConverterAdapter>(std::shared_ptr<IStateConverter>(conv));
 }
 
 void
@@ -408,15 +497,26 @@ ModMqtt::readObjectStateNode(
     const std::string& default_network,
     int default_slave,
     std::vector<MsgRegisterPollSpecification>& specs_out,
-    std::stack<int>& currentRefresh,
+    std::stack<RegisterPollSettings>& currentSettings,
+    std::map<std::string, std::shared_ptr<IStateConverterV2>>& converters,
     const std::string& stateName,
-    const YAML::Node& node
+    const YAML::Node& node,
+    bool isMultiRegisterValue
 ) {
-    MqttObjectRegisterIdent ident = updateSpecification(currentRefresh, default_network, default_slave, specs_out, node);
+    MqttObjectRegisterIdent ident = updateSpecification(currentSettings, default_network, default_slave, specs_out, node, isMultiRegisterValue);
     const YAML::Node& converter = node["converter"];
-    std::shared_ptr<IStateConverter> conv;
+    std::shared_ptr<IStateConverterV2> conv;
     if (converter.IsDefined()) {
-        conv = createConverter(converter);
+        // registers of this object with the same converter specification
+        // share converter instance, so values can be converted in one batch
+        auto it = converter.IsScalar() ? converters.find(converter.Scalar()) : converters.end();
+        if (it != converters.end()) {
+            conv = it->second;
+        } else {
+            // createConverter throws if converter is not a string
+            conv = createConverter(converter);
+            converters[converter.Scalar()] = conv;
+        }
     }
     object.mState.addRegister(stateName, ident, conv);
 }
@@ -427,19 +527,19 @@ ModMqtt::readObjectAvailability(
     const std::string& default_network,
     int default_slave,
     std::vector<MsgRegisterPollSpecification>& specs_out,
-    std::stack<int>& currentRefresh,
+    std::stack<RegisterPollSettings>& currentSettings,
     const YAML::Node& availability)
 {
     if (!availability.IsDefined())
         return;
     if (availability.IsMap()) {
-        MqttObjectRegisterIdent ident = updateSpecification(currentRefresh, default_network, default_slave, specs_out, availability);
+        MqttObjectRegisterIdent ident = updateSpecification(currentSettings, default_network, default_slave, specs_out, availability);
         uint16_t availValue = ConfigTools::readRequiredValue<uint16_t>(availability, "available_value");
         object.mAvailability.addRegister(ident, availValue);
     } else if (availability.IsSequence()) {
         for(size_t i = 0; i < availability.size(); i++) {
             const YAML::Node& regdata = availability[i];
-            MqttObjectRegisterIdent ident = updateSpecification(currentRefresh, default_network, default_slave, specs_out, regdata);
+            MqttObjectRegisterIdent ident = updateSpecification(currentSettings, default_network, default_slave, specs_out, regdata);
             uint16_t availValue = ConfigTools::readRequiredValue<uint16_t>(availability, "available_value");
             object.mAvailability.addRegister(ident, availValue);
         }
@@ -457,11 +557,11 @@ ModMqtt::readObjectCommands(
     if (!commands.IsDefined())
         return;
     if (commands.IsMap()) {
-        object.mCommands.push_back(readCommand(commands, default_network, default_slave));
+        object.mCommands.push_back(readCommand(commands, default_network, default_slave, object.mPublishProps.mQos));
     } else if (commands.IsSequence()) {
         for(size_t i = 0; i < commands.size(); i++) {
             const YAML::Node& cmddata = commands[i];
-            object.mCommands.push_back(readCommand(cmddata, default_network, default_slave));
+            object.mCommands.push_back(readCommand(cmddata, default_network, default_slave, object.mPublishProps.mQos));
         }
     }
 }
@@ -473,15 +573,18 @@ ModMqtt::initObjects(const YAML::Node& config)
     std::vector<MqttObjectCommand> commands;
     std::vector<MqttObject> objects;
 
-    int defaultRefresh = 5000;
-    std::stack<int> currentRefresh;
-    currentRefresh.push(defaultRefresh);
+    RegisterPollSettings defaultSettings;
+    defaultSettings.mRefreshMsec = 5000;
+    std::stack<RegisterPollSettings> currentSettings;
+    currentSettings.push(defaultSettings);
 
     const YAML::Node& mqtt = config["mqtt"];
     if (!mqtt.IsDefined())
         throw ConfigurationException(config.Mark(), "mqtt section is missing");
 
-    bool hasGlobalRefresh = parseAndAddRefresh(currentRefresh, mqtt);
+    bool hasGlobalSettings = parseAndAddPollSettings(currentSettings, mqtt);
+    MqttPublishProps defaultProps;
+    readPublishProps(defaultProps, mqtt);
 
     const YAML::Node& config_objects = mqtt["objects"];
     if (!config_objects.IsDefined())
@@ -501,20 +604,22 @@ ModMqtt::initObjects(const YAML::Node& config)
         ConfigTools::readOptionalValue<std::string>(default_network, objdata, "network");
         ConfigTools::readOptionalValue<int>(default_slave, objdata, "slave");
 
-        bool hasObjectRefresh = parseAndAddRefresh(currentRefresh, objdata);
+        bool hasObjectSettings = parseAndAddPollSettings(currentSettings, objdata);
+        object.mPublishProps = defaultProps;
+        readPublishProps(object.mPublishProps, objdata);
 
-        readObjectState(object, default_network, default_slave, specs_out, currentRefresh, objdata["state"]);
-        readObjectAvailability(object, default_network, default_slave, specs_out, currentRefresh, objdata["availability"]);
+        readObjectState(object, default_network, default_slave, specs_out, currentSettings, objdata["state"]);
+        readObjectAvailability(object, default_network, default_slave, specs_out, currentSettings, objdata["availability"]);
         readObjectCommands(object, default_network, default_slave, objdata["commands"]);
 
-        if (hasObjectRefresh)
-            currentRefresh.pop();
+        if (hasObjectSettings)
+            currentSettings.pop();
 
         objects.push_back(object);
         BOOST_LOG_SEV(log, Log::debug) << "object for topic " << object.getTopic() << " created";
     }
-    if (hasGlobalRefresh)
-        currentRefresh.pop();
+    if (hasGlobalSettings)
+        currentSettings.pop();
 
     mMqtt->setObjects(objects);
     BOOST_LOG_SEV(log, Log::debug) << "Finished reading config_objects specification";
@@ -523,21 +628,26 @@ ModMqtt::initObjects(const YAML::Node& config)
 
 MqttObjectRegisterIdent
 ModMqtt::updateSpecification(
-    std::stack<int>& currentRefresh,
+    std::stack<RegisterPollSettings>& currentSettings,
     const std::string& default_network,
     int default_slave,
     std::vector<MsgRegisterPollSpecification>& specs,
-    const YAML::Node& data)
+    const YAML::Node& data,
+    bool isMultiRegisterValue)
 {
     const RegisterConfigName rname(data, default_network, default_slave);
 
-    bool hasRefresh = parseAndAddRefresh(currentRefresh, data);
+    bool hasSettings = parseAndAddPollSettings(currentSettings, data);
 
     MsgRegisterPoll poll;
     poll.mRegister = rname.mRegisterNumber;
     poll.mRegisterType = parseRegisterType(data);
     poll.mSlaveId = rname.mSlaveId;
-    poll.mRefreshMsec = currentRefresh.top();
+    poll.mRefreshMsec = currentSettings.top().mRefreshMsec;
+    poll.mPriority = currentSettings.top().mPriority;
+    poll.mFilter = currentSettings.top().mFilter;
+    if (isMultiRegisterValue)
+        poll.mFilter.clearValueFilter();
 
     // find network poll specification or create one
     std::vector<MsgRegisterPollSpecification>::iterator spec_it = std::find_if(
@@ -572,12 +682,24 @@ ModMqtt::updateSpecification(
             reg_it->mRefreshMsec = poll.mRefreshMsec;
             BOOST_LOG_SEV(log, Log::debug) << "Setting refresh " << poll.mRefreshMsec << " on existing register " << poll.mRegister;
         }
+        if (reg_it->mPriority > poll.mPriority)
+            reg_it->mPriority = poll.mPriority;
+        reg_it->mFilter.merge(poll.mFilter);
     }
 
-    if (hasRefresh)
-        currentRefresh.pop();
+    if (hasSettings)
+        currentSettings.pop();
+
+    return MqttObjectRegisterIdent(getNetworkId(rname.mNetworkName), rname.mSlaveId, poll.mRegisterType, poll.mRegister);
+}
 
-    return MqttObjectRegisterIdent(rname.mNetworkName, rname.mSlaveId, poll.mRegisterType, poll.mRegister);
+int
+ModMqtt::getNetworkId(const std::string& networkName) {
+    std::vector<std::string>::const_iterator it = std::find(mNetworkNames.begin(), mNetworkNames.end(), networkName);
+    if (it != mNetworkNames.end())
+        return it - mNetworkNames.begin();
+    mNetworkNames.push_back(networkName);
+    return mNetworkNames.size() - 1;
 }
 
 void ModMqtt::start() {
@@ -588,8 +710,9 @@ void ModMqtt::start() {
     // process queues before connection to mqtt broker is
     // estabilished - this will cause availability messages to be dropped.
 
-    // TODO if broker is down and modbus is up then mQueues will grow forever and
-    // memory allocated by queues will never be released. Add MsgStartPolling?
+    // After initial connection modbus queues are processed even if
+    // broker is down. Mqtt publisher keeps only the last value of every
+    // topic, so memory used during broker outage is bounded.
     BOOST_LOG_SEV(log, Log::debug) << "Performing initial connection to mqtt broker";
     do {
         mMqtt->start();
@@ -602,9 +725,14 @@ void ModMqtt::start() {
 
     while(mMqtt->isStarted()) {
         if (gSignalStatus == -1) {
-            waitForQueues();
+            if (mMetrics.isEnabled())
+                waitForQueues(mMetrics.getNextCollect());
+            else
+                waitForQueues();
             //BOOST_LOG_SEV(log, Log::debug) << "Processing modbus queues";
             processModbusMessages();
+            if (mMetrics.isEnabled() && std::chrono::steady_clock::now() >= mMetrics.getNextCollect())
+                collectMetrics();
         } else if (gSignalStatus > 0) {
             int currentSignal = gSignalStatus;
             gSignalStatus = -1;
@@ -634,8 +762,9 @@ void ModMqtt::start() {
         for(std::vector<std::shared_ptr<ModbusClient>>::iterator client = mModbusClients.begin();
             client < mModbusClients.end(); client++)
         {
-            mMqtt->processModbusNetworkState((*client)->mName, false);
+            mMqtt->processModbusNetworkState((*client)->mNetworkId, false);
         }
+        mMqtt->publishChanges();
     }
     BOOST_LOG_SEV(log, Log::debug) << "Shutting down mosquitto client";
     // If connected, then shutdown()
@@ -659,29 +788,72 @@ ModMqtt::stop() {
 
 void
 ModMqtt::processModbusMessages() {
-    QueueItem item;
+    // only queues with new messages are drained
+    gQueueNotifier.drainReady([this](QueueNotifier::Entry& entry) {
+        processWorkerMessages(static_cast<ModbusClient::Worker&>(entry));
+    });
+    // serialize and publish every changed object once per batch
+    mMqtt->publishChanges();
+}
+
+void
+ModMqtt::processWorkerMessages(ModbusClient::Worker& worker) {
+    ModbusClient& client(*worker.mClient);
+    int networkId = client.mNetworkId;
+    if (mMetrics.isEnabled())
+        mMetrics.updateQueueDepth(networkId, worker.mToModbusQueue.size_approx(), worker.mFromModbusQueue.size_approx());
+    FromModbusQueueItem item;
+    while (worker.mFromModbusQueue.try_dequeue(item)) {
+        std::visit(QueueItemVisitor {
+            [this, networkId](const MsgRegisterValue& val) {
+                MqttObjectRegisterIdent ident(networkId, val.mSlaveId, val.mRegisterType, val.mRegisterNumber);
+                mMqtt->processRegisterValue(ident, val.mValue, val.mForcePublish, val.mReadTime);
+            },
+            [this, networkId](const MsgRegisterReadFailed& val) {
+                MqttObjectRegisterIdent ident(networkId, val.mSlaveId, val.mRegisterType, val.mRegisterNumber);
+                mMqtt->processRegisterOperationFailed(ident);
+            },
+            [this, networkId](const MsgRegisterWriteFailed& val) {
+                MqttObjectRegisterIdent ident(networkId, val.mSlaveId, val.mRegisterType, val.mRegisterNumber);
+                mMqtt->processRegisterOperationFailed(ident);
+            },
+            [this, networkId, &client, &worker](const MsgModbusNetworkState& val) {
+                if (client.updateNetworkState(worker, val.mIsUp))
+                    mMqtt->processModbusNetworkState(networkId, client.isNetworkUp());
+            },
+            [this, networkId](const std::shared_ptr<const ModbusThreadStats>& stats) {
+                if (mMetrics.addModbusStats(networkId, *stats))
+                    publishMetrics();
+            },
+            [](const std::monostate&) {}
+        }, item);
+    }
+}
+
+void
+ModMqtt::collectMetrics() {
+    // modbus thread that did not answer last request is busy
+    // with a long poll, publish metrics without its stats
+    if (mMetrics.isCollecting())
+        publishMetrics();
+
+    int requests = 0;
     for(std::vector<std::shared_ptr<ModbusClient>>::iterator client = mModbusClients.begin();
         client < mModbusClients.end(); client++)
     {
-        while ((*client)->mFromModbusQueue.try_dequeue(item)) {
-            if (item.isSameAs(typeid(MsgRegisterValue))) {
-                std::unique_ptr<MsgRegisterValue> val(item.getData<MsgRegisterValue>());
-                MqttObjectRegisterIdent ident((*client)->mName, val->mSlaveId, val->mRegisterType, val->mRegisterNumber);
-                mMqtt->processRegisterValue(ident, val->mValue);
-            } else if (item.isSameAs(typeid(MsgRegisterReadFailed))) {
-                std::unique_ptr<MsgRegisterReadFailed> val(item.getData<MsgRegisterReadFailed>());
-                MqttObjectRegisterIdent ident((*client)->mName, val->mSlaveId, val->mRegisterType, val->mRegisterNumber);
-                mMqtt->processRegisterOperationFailed(ident);
-            } else if (item.isSameAs(typeid(MsgRegisterWriteFailed))) {
-                std::unique_ptr<MsgRegisterWriteFailed> val(item.getData<MsgRegisterWriteFailed>());
-                MqttObjectRegisterIdent ident((*client)->mName, val->mSlaveId, val->mRegisterType, val->mRegisterNumber);
-                mMqtt->processRegisterOperationFailed(ident);
-            } else if (item.isSameAs(typeid(MsgModbusNetworkState))) {
-                std::unique_ptr<MsgModbusNetworkState> val(item.getData<MsgModbusNetworkState>());
-                mMqtt->processModbusNetworkState(val->mNetworkName, val->mIsUp);
-            }
-        }
+        requests += (*client)->requestStats();
     }
+    mMetrics.startCollect(std::chrono::steady_clock::now(), requests);
+}
+
+void
+ModMqtt::publishMetrics() {
+    std::vector<MetricsCollector::Message> messages(
+        mMetrics.createMessages(mNetworkNames, mMqtt->getPublishCount(), mMqtt->getSupersededCount(), std::chrono::steady_clock::now())
+    );
+    for(std::vector<MetricsCollector::Message>::const_iterator it = messages.begin(); it != messages.end(); it++)
+        mMqtt->publishMetric(it->mTopic, it->mPayload);
+    mMqtt->commitPublishes();
 }
 
 bool
@@ -700,17 +872,17 @@ ModMqtt::hasConverterPlugin(const std::string& name) const {
 
 void
 ModMqtt::waitForSignal() {
-    std::unique_lock<std::mutex> lock(gQueueMutex);
-    gHasMessagesCondition.wait_for(lock, std::chrono::seconds(5));
+    gQueueNotifier.wait(std::chrono::steady_clock::now() + std::chrono::seconds(5));
 }
 
 void
 ModMqtt::waitForQueues() {
-    std::unique_lock<std::mutex> lock(gQueueMutex);
-    while(!gHasMessages)
-        gHasMessagesCondition.wait(lock);
-    gHasMessages = false;
-    lock.unlock();
+    gQueueNotifier.wait();
+}
+
+void
+ModMqtt::waitForQueues(const std::chrono::steady_clock::time_point& until) {
+    gQueueNotifier.wait(until);
 }
 
 void
@@ -1,8 +1,7 @@
 #pragma once
+#include <map>
 #include <vector>
 #include <stack>
-#include <mutex>
-#include <condition_variable>
 
 #include "libmodmqttconv/converterplugin.hpp"
 
@@ -12,17 +11,24 @@
 #include "modbus_messages.hpp"
 #include "mqttobject.hpp"
 #include "imodbuscontext.hpp"
+#include "metrics.hpp"
+#include "queue_notifier.hpp"
 
 
 namespace modmqttd {
 
-// global shared lock for modbus threads and main loop
-// to wait on empty queues and posix singals processing
-extern std::mutex gQueueMutex;
-extern std::condition_variable gHasMessagesCondition;
-extern bool gHasMessagesFlag;
+// wakes up main loop without queue data,
+// for posix signals and mqtt events
 void notifyQueues();
 
+// register poll settings inherited from parent config nodes
+class RegisterPollSettings {
+    public:
+        int mRefreshMsec;
+        PollPriority mPriority = PollPriority::NORMAL;
+        RegisterChangeFilter mFilter;
+};
+
 class ModMqtt {
     public:
         static void setModbusContextFactory(const std::shared_ptr<IModbusFactory>& factory);
@@ -40,9 +46,17 @@ class ModMqtt {
         */
         void stop();
         void waitForQueues();
+        void waitForQueues(const std::chrono::steady_clock::time_point& until);
         void setMqttFinished() { mMqttFinished = true; }
 
         void setMqttImplementation(const std::shared_ptr<IMqttImpl>& impl);
+
+        /**
+            Returns small integer id for modbus network name.
+            New id is assigned when name is used for the first time.
+        */
+        int getNetworkId(const std::string& networkName);
+        const std::string& getNetworkName(int networkId) const { return mNetworkNames[networkId]; }
         ~ModMqtt();
     private:
         static std::shared_ptr<IModbusFactory> mModbusFactory;
@@ -52,24 +66,35 @@ class ModMqtt {
 
         std::vector<boost::shared_ptr<ConverterPlugin>> mConverterPlugins;
 
+        // index is a network id
+        std::vector<std::string> mNetworkNames;
+
+        MetricsCollector mMetrics;
+
         void initServer(const YAML::Node& config);
         void initBroker(const YAML::Node& config);
         void initModbusClients(const YAML::Node& config);
         std::vector<MsgRegisterPollSpecification> initObjects(const YAML::Node& config);
         void waitForSignal();
 
-        MqttObjectRegisterIdent updateSpecification(std::stack<int>& currentRefresh, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs, const YAML::Node& data);
-        bool parseAndAddRefresh(std::stack<int>& values, const YAML::Node& data);
-        void readObjectState(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<int>& currentRefresh, const YAML::Node& state);
-        void readObjectStateNode(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<int>& currentRefresh, const std::string& stateName, const YAML::Node& node);
-        void readObjectAvailability(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<int>& currentRefresh, const YAML::Node& availability);
+        MqttObjectRegisterIdent updateSpecification(std::stack<RegisterPollSettings>& currentSettings, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs, const YAML::Node& data, bool isMultiRegisterValue = false);
+        bool parseAndAddPollSettings(std::stack<RegisterPollSettings>& values, const YAML::Node& data);
+        void readPublishProps(MqttPublishProps& props, const YAML::Node& data);
+        void readObjectState(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<RegisterPollSettings>& currentSettings, const YAML::Node& state);
+        // converters holds converter instances of object state by specification
+        void readObjectStateNode(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<RegisterPollSettings>& currentSettings, std::map<std::string, std::shared_ptr<IStateConverterV2>>& converters, const std::string& stateName, const YAML::Node& node, bool isMultiRegisterValue = false);
+        void readObjectAvailability(MqttObject& object, const std::string& default_network, int default_slave, std::vector<MsgRegisterPollSpecification>& specs_out, std::stack<RegisterPollSettings>& currentSettings, const YAML::Node& availability);
+        MqttObjectCommand readCommand(const YAML::Node& node, const std::string& default_network, int default_slave, int default_qos);
         void readObjectCommands(MqttObject& object, const std::string& default_network, int default_slave, const YAML::Node& commands);
         void processModbusMessages();
+        void processWorkerMessages(ModbusClient::Worker& worker);
+        void collectMetrics();
+        void publishMetrics();
 
         bool hasConverterPlugin(const std::string& name) const;
         boost::shared_ptr<ConverterPlugin> initConverterPlugin(const std::string& name);
-        std::shared_ptr<IStateConverter> createConverterInstance(const std::string plugin, const std::string& converter) const;
-        std::shared_ptr<IStateConverter> createConverter(const YAML::Node& data) const;
+        std::shared_ptr<IStateConverterV2> createConverterInstance(const std::string plugin, const std::string& converter) const;
+        std::shared_ptr<IStateConverterV2> createConverter(const YAML::Node& data) const;
 
 
         bool mMqttFinished = false;
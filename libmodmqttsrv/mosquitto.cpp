@@ -1,5 +1,7 @@
 #include <cstring>
 
+#include <mqtt_protocol.h>
+
 #include "mosquitto.hpp"
 #include "exceptions.hpp"
 #include "mqttclient.hpp"
@@ -13,6 +15,13 @@ static void on_connect_wrapper(struct mosquitto *mosq, void *userdata, int rc)
 }
 
 
+static void on_connect_v5_wrapper(struct mosquitto *mosq, void *userdata, int rc, int flags, const mosquitto_property *props)
+{
+	class Mosquitto *m = (class Mosquitto *)userdata;
+	m->on_connect_v5(rc, props);
+}
+
+
 static void on_connect_with_flags_wrapper(struct mosquitto *mosq, void *userdata, int rc, int flags)
 {
 	class Mosquitto *m = (class Mosquitto *)userdata;
@@ -97,6 +106,9 @@ Mosquitto::Mosquitto() {
 void
 Mosquitto::connect(const MqttBrokerConfig& config) {
     BOOST_LOG_SEV(log, Log::info) << "Connecting to " << config.mHost << ":" << config.mPort;
+    mIsV5 = config.mProtocolVersion == MQTT_PROTOCOL_V5;
+    if (mIsV5)
+        mosquitto_int_option(mMosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
     int rc = mosquitto_connect_async(mMosq, config.mHost.c_str(),
             config.mPort,
             config.mKeepalive);
@@ -109,7 +121,10 @@ Mosquitto::connect(const MqttBrokerConfig& config) {
         BOOST_LOG_SEV(log, Log::error) << "Error connecting to mqtt broker: " << returnCodeToStr(rc);
     } else {
         mosquitto_reconnect_delay_set(mMosq, 3,60, true);
-        mosquitto_connect_callback_set(mMosq, on_connect_wrapper);
+        if (mIsV5)
+            mosquitto_connect_v5_callback_set(mMosq, on_connect_v5_wrapper);
+        else
+            mosquitto_connect_callback_set(mMosq, on_connect_wrapper);
         mosquitto_connect_with_flags_callback_set(mMosq, on_connect_with_flags_wrapper);
         mosquitto_disconnect_callback_set(mMosq, on_disconnect_wrapper);
         //mosquitto_publish_callback_set(mMosq, on_publish_wrapper);
@@ -149,15 +164,48 @@ void Mosquitto::init(MqttClient* owner, const char* clientId) {
 }
 
 void
-Mosquitto::subscribe(const char* topic) {
+Mosquitto::subscribe(const char* topic, int qos) {
     int msgId;
-    mosquitto_subscribe(mMosq, &msgId, topic, 0);
+    mosquitto_subscribe(mMosq, &msgId, topic, qos);
 }
 
 void
-Mosquitto::publish(const char* topic, int len, const void* data) {
+Mosquitto::publish(const char* topic, int len, const void* data, const MqttPublishProps& props) {
     int msgId;
-    mosquitto_publish(mMosq, &msgId, topic, len, data, 0, true);
+    if (!mIsV5) {
+        mosquitto_publish(mMosq, &msgId, topic, len, data, props.mQos, props.mRetain);
+        return;
+    }
+
+    mosquitto_property* properties = NULL;
+    const char* sentTopic = topic;
+    bool isNewAlias = false;
+    // QoS>0 messages can be resent by libmosquitto after reconnect,
+    // when aliases from previous connection are no longer valid
+    if (props.mQos == 0) {
+        uint16_t alias = mTopicAliases.getAlias(topic, isNewAlias);
+        if (alias != 0) {
+            mosquitto_property_add_int16(&properties, MQTT_PROP_TOPIC_ALIAS, alias);
+            // broker knows this alias, send empty topic
+            if (!isNewAlias)
+                sentTopic = NULL;
+        }
+    }
+    if (props.mMessageExpirySec > 0)
+        mosquitto_property_add_int32(&properties, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, props.mMessageExpirySec);
+    if (props.mPollTime.time_since_epoch().count() != 0) {
+        std::string pollTime(std::to_string(
+            std::chrono::duration_cast<std::chrono::milliseconds>(props.mPollTime.time_since_epoch()).count()
+        ));
+        mosquitto_property_add_string_pair(&properties, MQTT_PROP_USER_PROPERTY, "poll_time", pollTime.c_str());
+    }
+
+    int rc = mosquitto_publish_v5(mMosq, &msgId, sentTopic, len, data, props.mQos, props.mRetain, properties);
+    mosquitto_property_free_all(&properties);
+    if (rc != MOSQ_ERR_SUCCESS && isNewAlias) {
+        // broker did not get topic for this alias
+        mTopicAliases.remove(topic);
+    }
 }
 
 
@@ -173,6 +221,16 @@ Mosquitto::on_connect(int rc) {
     mOwner->onConnect();
 }
 
+void
+Mosquitto::on_connect_v5(int rc, const mosquitto_property* props) {
+    // broker does not accept aliases if property is missing
+    uint16_t aliasMaximum = 0;
+    mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &aliasMaximum, false);
+    mTopicAliases.reset(aliasMaximum);
+    BOOST_LOG_SEV(log, Log::debug) << "Broker accepts " << aliasMaximum << " topic aliases";
+    on_connect(rc);
+}
+
 void
 Mosquitto::on_log(int level, const char* message) {
     switch(level) {
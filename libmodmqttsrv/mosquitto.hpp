@@ -6,6 +6,7 @@
 #include "mqttobject.hpp"
 #include "modbus_client.hpp"
 #include "imqttimpl.hpp"
+#include "topic_alias_table.hpp"
 
 namespace modmqttd {
 
@@ -24,11 +25,12 @@ class Mosquitto : public IMqttImpl {
         virtual void reconnect();
         virtual void disconnect();
 
-        virtual void subscribe(const char* topic);
-        virtual void publish(const char* topic, int len, const void* data);
+        virtual void subscribe(const char* topic, int qos);
+        virtual void publish(const char* topic, int len, const void* data, const MqttPublishProps& props);
 
         virtual void on_disconnect(int rc);
         virtual void on_connect(int rc);
+        virtual void on_connect_v5(int rc, const mosquitto_property* props);
         virtual void on_log(int level, const char* message);
         virtual void on_message(const struct mosquitto_message *message);
         virtual ~Mosquitto();
@@ -36,6 +38,10 @@ class Mosquitto : public IMqttImpl {
         mosquitto *mMosq = NULL;
         MqttClient* mOwner;
         boost::log::sources::severity_logger<Log::severity> log;
+        bool mIsV5 = false;
+
+        // reset in on_connect_v5
+        TopicAliasTable mTopicAliases;
 
         const char* returnCodeToStr(int code);
         void throwOnCriticalError(int code);
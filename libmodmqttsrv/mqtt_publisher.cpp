@@ -0,0 +1,143 @@
+#include "mqtt_publisher.hpp"
+
+namespace modmqttd {
+
+void
+MqttPublisher::start(const std::shared_ptr<IMqttImpl>& impl) {
+    if (isStarted())
+        return;
+    mMqttImpl = impl;
+    mShouldRun = true;
+    mThread.reset(new std::thread(&MqttPublisher::run, this));
+}
+
+void
+MqttPublisher::setConnected(bool connected) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mConnected = connected;
+    if (connected) {
+        for(std::size_t idx = 0; idx < mSlots.size(); idx++) {
+            Slot& slot(mSlots[idx]);
+            if (slot.mHasValue && !slot.mPending) {
+                slot.mPending = true;
+                mPendingSlots.push_back(idx);
+            }
+        }
+    }
+    lock.unlock();
+    mHasMessages.notify_one();
+    mSent.notify_all();
+}
+
+void
+MqttPublisher::publish(const std::string& topic, const char* payload, int len, const MqttPublishProps& props) {
+    std::unique_lock<std::mutex> lock(mBatchMutex);
+    if (mBatchSize == mBatch.size())
+        mBatch.resize(mBatch.size() + 1);
+    Message& msg(mBatch[mBatchSize++]);
+    msg.mTopic.assign(topic);
+    msg.mPayload.assign(payload, len);
+    msg.mProps = props;
+}
+
+void
+MqttPublisher::commit() {
+    std::unique_lock<std::mutex> batchLock(mBatchMutex);
+    if (mBatchSize == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(std::size_t i = 0; i < mBatchSize; i++) {
+        Message& msg(mBatch[i]);
+        std::unordered_map<std::string, std::size_t>::const_iterator it = mTopicSlots.find(msg.mTopic);
+        std::size_t idx;
+        if (it == mTopicSlots.end()) {
+            idx = mSlots.size();
+            mSlots.resize(idx + 1);
+            mSlots[idx].mTopic = msg.mTopic;
+            mTopicSlots[msg.mTopic] = idx;
+        } else {
+            idx = it->second;
+        }
+        Slot& slot(mSlots[idx]);
+        if (slot.mPending) {
+            mSupersededCount++;
+        } else {
+            slot.mPending = true;
+            mPendingSlots.push_back(idx);
+        }
+        slot.mPayload.swap(msg.mPayload);
+        slot.mProps = msg.mProps;
+        slot.mHasValue = true;
+    }
+    mBatchSize = 0;
+    lock.unlock();
+    mHasMessages.notify_one();
+}
+
+void
+MqttPublisher::flush() {
+    commit();
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(isStarted() && mConnected && (!mPendingSlots.empty() || mSending))
+        mSent.wait(lock);
+}
+
+void
+MqttPublisher::stop() {
+    if (!isStarted())
+        return;
+    commit();
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mShouldRun = false;
+    }
+    mHasMessages.notify_one();
+    mThread->join();
+    mThread.reset();
+    mSent.notify_all();
+}
+
+uint64_t
+MqttPublisher::getSupersededCount() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mSupersededCount;
+}
+
+void
+MqttPublisher::run() {
+    std::vector<Message> sending;
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(true) {
+        while(mShouldRun && (mPendingSlots.empty() || !mConnected))
+            mHasMessages.wait(lock);
+        // all committed messages are sent before exit
+        if (mPendingSlots.empty() || !mConnected)
+            break;
+
+        if (sending.size() < mPendingSlots.size())
+            sending.resize(mPendingSlots.size());
+        std::size_t count = mPendingSlots.size();
+        for(std::size_t i = 0; i < count; i++) {
+            Slot& slot(mSlots[mPendingSlots[i]]);
+            sending[i].mTopic.assign(slot.mTopic);
+            // slot keeps its value for republish after reconnect
+            sending[i].mPayload.assign(slot.mPayload);
+            sending[i].mProps = slot.mProps;
+            slot.mPending = false;
+        }
+        mPendingSlots.clear();
+        mSending = true;
+        lock.unlock();
+
+        for(std::size_t i = 0; i < count; i++)
+            mMqttImpl->publish(sending[i].mTopic.c_str(), sending[i].mPayload.length(), sending[i].mPayload.c_str(), sending[i].mProps);
+
+        lock.lock();
+        mSending = false;
+        mSent.notify_all();
+    }
+    BOOST_LOG_SEV(log, Log::debug) << "Mqtt publisher thread ended";
+}
+
+}
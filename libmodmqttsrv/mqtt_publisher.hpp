@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "logging.hpp"
+#include "imqttimpl.hpp"
+
+namespace modmqttd {
+
+/**
+ * Sends mqtt messages from a dedicated thread.
+ *
+ * Messages are collected into a batch and handed to publisher
+ * thread with commit(). Every topic has a single slot, so if
+ * previous value of a topic was not sent yet, it is replaced
+ * with the new one. Slow or disconnected broker never blocks caller
+ * and queued data is limited to the last value of every topic.
+ *
+ * Slots keep last value after it is sent. When broker connection
+ * is restored, last value of every topic is sent again, because
+ * restarted broker may have lost retained messages.
+ *
+ * Payload buffers are swapped between batch, slots and publisher
+ * thread, so no memory is allocated when message sizes are stable.
+ * */
+class MqttPublisher {
+    public:
+        class Message {
+            public:
+                std::string mTopic;
+                std::string mPayload;
+                MqttPublishProps mProps;
+        };
+
+        void start(const std::shared_ptr<IMqttImpl>& impl);
+        bool isStarted() const { return mThread != nullptr; }
+        // messages are held until broker is connected
+        void setConnected(bool connected);
+
+        // adds message to current batch
+        void publish(const std::string& topic, const char* payload, int len, const MqttPublishProps& props = MqttPublishProps());
+        // hands current batch to publisher thread
+        void commit();
+        // waits until all committed messages are sent or broker is disconnected
+        void flush();
+        // sends committed messages if connected and stops publisher thread
+        void stop();
+
+        // number of messages replaced by newer value before they were sent
+        uint64_t getSupersededCount() const;
+
+        ~MqttPublisher() { stop(); }
+    private:
+        class Slot {
+            public:
+                std::string mTopic;
+                std::string mPayload;
+                MqttPublishProps mProps;
+                bool mHasValue = false;
+                bool mPending = false;
+        };
+
+        boost::log::sources::severity_logger<Log::severity> log;
+        std::shared_ptr<IMqttImpl> mMqttImpl;
+        std::unique_ptr<std::thread> mThread;
+
+        // locked before mMutex if both are needed
+        std::mutex mBatchMutex;
+        // messages are reused, only first mBatchSize are valid
+        std::vector<Message> mBatch;
+        std::size_t mBatchSize = 0;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mHasMessages;
+        std::condition_variable mSent;
+        std::unordered_map<std::string, std::size_t> mTopicSlots;
+        std::vector<Slot> mSlots;
+        // slot indexes in order of first change
+        std::vector<std::size_t> mPendingSlots;
+        bool mSending = false;
+        bool mConnected = false;
+        bool mShouldRun = false;
+        uint64_t mSupersededCount = 0;
+
+        void run();
+};
+
+}
@@ -18,6 +18,138 @@ MqttClient::setBrokerConfig(const MqttBrokerConfig& config) {
     }
 };
 
+void
+MqttClient::setObjects(const std::vector<MqttObject>& objects) {
+    mObjects = objects;
+    buildRegisterIndex();
+    buildCommandIndex();
+}
+
+void
+MqttClient::setConversionThreads(int count) {
+    if (count == 0)
+        return;
+    mConversionPool.start(count, [this](MqttObject& object, ConversionPool::Worker& worker) {
+        publishChanges(object, worker.mStateBuilder, worker.log);
+    });
+}
+
+void
+MqttClient::setModbusClients(const std::vector<std::shared_ptr<ModbusClient>>& clients) {
+    mModbusClients = clients;
+    buildCommandIndex();
+}
+
+void
+MqttClient::setCommandSubscriptions(const std::vector<std::string>& filters) {
+    mCommandFilters = filters;
+    buildCommandIndex();
+}
+
+void
+MqttClient::buildCommandIndex() {
+    mCommandIndex.clear();
+    mCommandTopics.clear();
+    mSubscriptions.clear();
+
+    std::size_t count = 0;
+    for(std::vector<MqttObject>::const_iterator obj = mObjects.begin(); obj != mObjects.end(); obj++)
+        count += obj->mCommands.size();
+    // index keys point to strings in this vector, it must not be reallocated
+    mCommandTopics.reserve(count);
+
+    for(std::vector<std::string>::const_iterator filter = mCommandFilters.begin(); filter != mCommandFilters.end(); filter++)
+        mSubscriptions.push_back(Subscription{*filter, -1});
+
+    for(std::vector<MqttObject>::const_iterator obj = mObjects.begin(); obj != mObjects.end(); obj++) {
+        for(std::vector<MqttObjectCommand>::const_iterator cmd = obj->mCommands.begin(); cmd != obj->mCommands.end(); cmd++) {
+            mCommandTopics.push_back(obj->getTopic() + "/" + cmd->mName);
+            const std::string& topic(mCommandTopics.back());
+
+            int networkId = cmd->mRegister.getNetworkId();
+            std::vector<std::shared_ptr<ModbusClient>>::const_iterator client = std::find_if(
+                mModbusClients.begin(), mModbusClients.end(),
+                [networkId](const std::shared_ptr<ModbusClient>& client) -> bool { return client->mNetworkId == networkId; }
+            );
+            CommandTarget target;
+            target.mCommand = &(*cmd);
+            target.mClient = client == mModbusClients.end() ? nullptr : client->get();
+            mCommandIndex[topic] = target;
+
+            // use the highest command qos for wildcard subscription
+            bool subscribed = false;
+            for(std::size_t i = 0; i < mCommandFilters.size(); i++) {
+                if (topicMatches(mSubscriptions[i].mTopic.c_str(), topic.c_str())) {
+                    if (cmd->mQos > mSubscriptions[i].mQos)
+                        mSubscriptions[i].mQos = cmd->mQos;
+                    subscribed = true;
+                    break;
+                }
+            }
+            if (!subscribed)
+                mSubscriptions.push_back(Subscription{topic, cmd->mQos});
+        }
+    }
+
+    for(std::vector<Subscription>::iterator sub = mSubscriptions.begin(); sub != mSubscriptions.end(); sub++) {
+        if (sub->mQos == -1) {
+            BOOST_LOG_SEV(log, Log::warn) << "No commands match subscription " << sub->mTopic;
+            sub->mQos = 0;
+        }
+    }
+}
+
+bool
+MqttClient::topicMatches(const char* filter, const char* topic) {
+    while(true) {
+        if (*filter == '#')
+            return true;
+        if (*filter == '+') {
+            while(*topic && *topic != '/')
+                topic++;
+            filter++;
+        } else {
+            while(*filter && *filter != '/') {
+                if (*filter != *topic)
+                    return false;
+                filter++;
+                topic++;
+            }
+        }
+        // both are at the end of level
+        if (*filter == 0)
+            return *topic == 0;
+        if (*topic == 0)
+            // "a/#" matches "a"
+            return std::strcmp(filter, "/#") == 0;
+        if (*topic != '/')
+            return false;
+        filter++;
+        topic++;
+    }
+}
+
+void
+MqttClient::buildRegisterIndex() {
+    mRegisterIndex.clear();
+    for(std::vector<MqttObject>::iterator obj = mObjects.begin(); obj != mObjects.end(); obj++) {
+        std::vector<MqttObjectRegisterIdent> idents;
+        for(auto val = obj->mState.getValues().begin(); val != obj->mState.getValues().end(); val++)
+            for(auto reg = val->getValues().begin(); reg != val->getValues().end(); reg++)
+                idents.push_back(reg->first);
+        for(auto reg = obj->mAvailability.getValues().begin(); reg != obj->mAvailability.getValues().end(); reg++)
+            idents.push_back(reg->first);
+
+        for(std::vector<MqttObjectRegisterIdent>::const_iterator ident = idents.begin(); ident != idents.end(); ident++) {
+            std::vector<MqttObjectRegisterSlot>& slots(mRegisterIndex[*ident]);
+            // register can be used many times in a single object
+            if (slots.size() != 0 && slots.back().mObject == &(*obj))
+                continue;
+            slots.push_back(obj->getRegisterSlot(*ident));
+        }
+    }
+}
+
 void
 MqttClient::setClientId(const std::string& clientId) {
     if (isStarted())
@@ -33,6 +165,7 @@ MqttClient::start() /*throw(MosquittoException)*/ {
 			return;
 	}
     mIsStarted = true;
+    mPublisher.start(mMqttImpl);
     mConnectionState = State::CONNECTING;
     mMqttImpl->connect(mBrokerConfig);
 }
@@ -42,6 +175,8 @@ MqttClient::shutdown() {
     switch(mConnectionState) {
         case State::CONNECTED:
             BOOST_LOG_SEV(log, Log::info) << "Disconnecting from mqtt broker";
+            // send last state and availability before disconnect
+            mPublisher.flush();
             mConnectionState = State::DISCONNECTING;
             mMqttImpl->disconnect();
         break;
@@ -61,9 +196,9 @@ MqttClient::shutdown() {
 
 void
 MqttClient::onDisconnect() {
-    for(std::vector<std::shared_ptr<ModbusClient>>::iterator it = mModbusClients.begin(); it != mModbusClients.end(); it++) {
-        (*it)->sendMqttNetworkIsUp(false);
-    }
+    // modbus threads are still polling, publisher keeps
+    // last value of every topic until broker is back
+    mPublisher.setConnected(false);
     switch(mConnectionState) {
         case State::CONNECTED:
         case State::CONNECTING:
@@ -75,7 +210,7 @@ MqttClient::onDisconnect() {
             mConnectionState = State::DISCONNECTED;
             mMqttImpl->stop();
             mIsStarted = false;
-            // signal modmqttd that is waiting on queues mutex
+            // wake up modmqttd that is waiting
             // for us to disconnect
             modmqttd::notifyQueues();
     };
@@ -85,18 +220,17 @@ void
 MqttClient::onConnect() {
 	BOOST_LOG_SEV(log, Log::info) << "Mqtt conected, sending subscriptions...";
 
-    for(std::vector<MqttObject>::const_iterator obj = mObjects.begin(); obj != mObjects.end(); obj++)
-        for(std::vector<MqttObjectCommand>::const_iterator it = obj->mCommands.begin(); it != obj->mCommands.end(); it++)
-            subscribeToCommandTopic(obj->getTopic(), *it);
+    for(std::vector<Subscription>::const_iterator it = mSubscriptions.begin(); it != mSubscriptions.end(); it++)
+        mMqttImpl->subscribe(it->mTopic.c_str(), it->mQos);
 
     mConnectionState = State::CONNECTED;
 
     // if broker was restarted
     // then all published information is gone until
-    // modbus register data is changed
-    // republish current object state and availability to
-    // for subscribed clients
-    publishAll();
+    // modbus register data is changed.
+    // Publisher sends last value of every topic,
+    // including changes made when we were offline
+    mPublisher.setConnected(true);
 
     for(std::vector<std::shared_ptr<ModbusClient>>::iterator it = mModbusClients.begin(); it != mModbusClients.end(); it++) {
         (*it)->sendMqttNetworkIsUp(true);
@@ -106,66 +240,134 @@ MqttClient::onConnect() {
 }
 
 void
-MqttClient::subscribeToCommandTopic(const std::string& objectTopic, const MqttObjectCommand& cmd) {
-    std::string topic = objectTopic + "/" + cmd.mName;
-    mMqttImpl->subscribe(topic.c_str());
+MqttClient::processRegisterValue(
+    const MqttObjectRegisterIdent& ident,
+    uint16_t value,
+    bool forcePublish,
+    const std::chrono::system_clock::time_point& readTime
+) {
+    auto slots = mRegisterIndex.find(ident);
+    if (slots == mRegisterIndex.end())
+        return;
+
+    for(std::vector<MqttObjectRegisterSlot>::const_iterator it = slots->second.begin();
+        it != slots->second.end(); it++)
+    {
+        MqttObject& object(*it->mObject);
+        AvailableFlag oldAvail = object.getAvailableFlag();
+        object.updateRegisterValue(*it, value);
+        AvailableFlag newAvail = object.getAvailableFlag();
+
+        if (it->mIsStateRegister) {
+            object.mLastPollTime = readTime;
+            setStateChanged(object, forcePublish);
+        }
+
+        if (oldAvail != newAvail)
+            setAvailabilityChanged(object);
+    }
 }
 
 void
-MqttClient::processRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value) {
-    if (!isConnected()) {
-        // we drop changes when there is no connection
-        // retain flag is set so
-        // broker will send last known value for us.
-        return;
-    }
+MqttClient::setStateChanged(MqttObject& object, bool forcePublish) {
+    if (!object.hasChanges())
+        mChangedObjects.push_back(&object);
+    object.mStateChanged = true;
+    if (forcePublish)
+        object.mForceStatePublish = true;
+}
 
-    for(std::vector<MqttObject>::iterator it = mObjects.begin();
-        it != mObjects.end(); it++)
-    {
-        AvailableFlag oldAvail = it->getAvailableFlag();
-        it->updateRegisterValue(ident, value);
-        AvailableFlag newAvail = it->getAvailableFlag();
+void
+MqttClient::setAvailabilityChanged(MqttObject& object) {
+    if (!object.hasChanges())
+        mChangedObjects.push_back(&object);
+    object.mAvailabilityChanged = true;
+}
 
-        if (it->mState.hasRegister(ident) && it->mState.hasValues()) {
-            publishState(*it);
+void
+MqttClient::publishChanges() {
+    if (mConversionPool.isStarted()) {
+        // object index is used as a key, so every object
+        // is always converted by the same thread
+        for(std::vector<MqttObject*>::iterator it = mChangedObjects.begin();
+            it != mChangedObjects.end(); it++)
+        {
+            mConversionPool.add(*it - mObjects.data(), **it);
         }
-
-        if (oldAvail != newAvail) {
-            publishAvailabilityChange(*it);
+        mConversionPool.run();
+    } else {
+        for(std::vector<MqttObject*>::iterator it = mChangedObjects.begin();
+            it != mChangedObjects.end(); it++)
+        {
+            publishChanges(**it, mStateBuilder, log);
         }
     }
+    mChangedObjects.clear();
+    mPublisher.commit();
 }
 
 void
-MqttClient::publishState(const MqttObject& obj) {
-    int msgId;
-    std::string messageData(obj.mState.createMessage());
-    BOOST_LOG_SEV(log, Log::debug) << "Publish on topic " << obj.getStateTopic() << ": " << messageData;
-    mMqttImpl->publish(obj.getStateTopic().c_str(), messageData.length(), messageData.c_str());
+MqttClient::publishChanges(MqttObject& object, StateMessageBuilder& builder, boost::log::sources::severity_logger<Log::severity>& logger) {
+    // when there is no connection publisher
+    // keeps only the last value of every topic
+    // state is published before availability
+    if (object.mStateChanged && object.mState.hasValues())
+        publishState(object, object.mForceStatePublish, builder, logger);
+    if (object.mAvailabilityChanged)
+        publishAvailabilityChange(object);
+    object.mStateChanged = false;
+    object.mForceStatePublish = false;
+    object.mAvailabilityChanged = false;
+}
+
+void
+MqttClient::publishState(MqttObject& obj, bool force) {
+    publishState(obj, force, mStateBuilder, log);
+}
+
+void
+MqttClient::publishState(MqttObject& obj, bool force, StateMessageBuilder& builder, boost::log::sources::severity_logger<Log::severity>& logger) {
+    obj.mState.createMessage(builder);
+    const std::string& messageData(builder.mPayload);
+    if (!force && messageData == obj.mPublishedState) {
+        BOOST_LOG_SEV(logger, Log::debug) << "State on topic " << obj.getStateTopic() << " not changed, skipping publish";
+        return;
+    }
+    BOOST_LOG_SEV(logger, Log::debug) << "Publish on topic " << obj.getStateTopic() << ": " << messageData;
+    MqttPublishProps props(obj.mPublishProps);
+    props.mPollTime = obj.mLastPollTime;
+    mPublisher.publish(obj.getStateTopic(), messageData.c_str(), messageData.length(), props);
+    mPublishCount++;
+    // reuses capacity of previous state
+    obj.mPublishedState.assign(messageData);
 }
 
 void
 MqttClient::processRegisterOperationFailed(const MqttObjectRegisterIdent& ident) {
-    for(std::vector<MqttObject>::iterator it = mObjects.begin();
-        it != mObjects.end(); it++)
+    auto slots = mRegisterIndex.find(ident);
+    if (slots == mRegisterIndex.end())
+        return;
+
+    for(std::vector<MqttObjectRegisterSlot>::const_iterator it = slots->second.begin();
+        it != slots->second.end(); it++)
     {
-        AvailableFlag oldAvail = it->getAvailableFlag();
-        it->updateRegisterReadFailed(ident);
-        if (oldAvail != it->getAvailableFlag())
-            publishAvailabilityChange(*it);
+        MqttObject& object(*it->mObject);
+        AvailableFlag oldAvail = object.getAvailableFlag();
+        object.updateRegisterReadFailed(*it);
+        if (oldAvail != object.getAvailableFlag())
+            setAvailabilityChanged(object);
     }
 }
 
 void
-MqttClient::processModbusNetworkState(const std::string& networkName, bool isUp) {
+MqttClient::processModbusNetworkState(int networkId, bool isUp) {
     for(std::vector<MqttObject>::iterator it = mObjects.begin();
         it != mObjects.end(); it++)
     {
         AvailableFlag oldAvail = it->getAvailableFlag();
-        it->setModbusNetworkState(networkName, isUp);
+        it->setModbusNetworkState(networkId, isUp);
         if (oldAvail != it->getAvailableFlag())
-            publishAvailabilityChange(*it);
+            setAvailabilityChanged(*it);
     }
 }
 
@@ -175,29 +377,22 @@ MqttClient::publishAvailabilityChange(const MqttObject& obj) {
         return;
     char msg = obj.getAvailableFlag() == AvailableFlag::True ? '1' : '0';
     int msgId;
-    mMqttImpl->publish(obj.getAvailabilityTopic().c_str(), 1, &msg);
+    mPublisher.publish(obj.getAvailabilityTopic(), &msg, 1, obj.mPublishProps);
+    mPublishCount++;
 }
 
 void
-MqttClient::publishAll() {
-    for(auto object = mObjects.begin(); object != mObjects.end(); object++) {
-        if (object->getAvailableFlag() == AvailableFlag::True)
-            publishState(*object);
-        publishAvailabilityChange(*object);
-    }
+MqttClient::publishMetric(const std::string& topic, const std::string& payload) {
+    mPublisher.publish(topic, payload.c_str(), payload.length());
 }
 
 static const int MAX_DATA_LEN = 32;
 
-uint16_t
-convertMqttPayload(const MqttObjectCommand& command, const void* data, int datalen) {
+static uint16_t
+convertRegisterValue(const MqttObjectCommand& command, const std::string& value) {
     uint16_t ret(0);
-    if (datalen > MAX_DATA_LEN)
-        throw MqttPayloadConversionException(std::string("Conversion failed, payload too big (size:") + std::to_string(datalen) + ")");
-
     switch(command.mPayloadType) {
         case MqttObjectCommand::PayloadType::STRING: {
-            std::string value((const char*)data, datalen);
             try {
                 int temp(std::stoi(value.c_str()));
                 if (temp <= static_cast<int>(UINT16_MAX) && temp >=0) {
@@ -215,7 +410,7 @@ convertMqttPayload(const MqttObjectCommand& command, const void* data, int datal
           throw MqttPayloadConversionException("Conversion failed, unknown payload type" + std::to_string(command.mPayloadType));
     }
 
-    switch(command.mRegister.mRegisterType) {
+    switch(command.mRegister.getRegisterType()) {
         case RegisterType::BIT:
         case RegisterType::COIL:
             if ((ret != 0) && (ret != 1)) {
@@ -226,57 +421,97 @@ convertMqttPayload(const MqttObjectCommand& command, const void* data, int datal
     return ret;
 }
 
+uint16_t
+convertMqttPayload(const MqttObjectCommand& command, const void* data, int datalen) {
+    if (datalen > MAX_DATA_LEN)
+        throw MqttPayloadConversionException(std::string("Conversion failed, payload too big (size:") + std::to_string(datalen) + ")");
+
+    return convertRegisterValue(command, std::string((const char*)data, datalen));
+}
+
+/**
+ * Converts payload of command with multiple registers.
+ * Payload is a list of register values "[1,2,3]" or, for holding
+ * registers, a single integer split into 16-bit words, high word first
+ * */
+std::vector<uint16_t>
+convertMqttPayloadValues(const MqttObjectCommand& command, const void* data, int datalen) {
+    // up to 6 characters and separator for every value
+    if (datalen > MAX_DATA_LEN + command.mCount * 7)
+        throw MqttPayloadConversionException(std::string("Conversion failed, payload too big (size:") + std::to_string(datalen) + ")");
+
+    static const char* whitespace = " \t\r\n";
+    std::string value((const char*)data, datalen);
+    std::vector<uint16_t> ret;
+    std::size_t start = value.find_first_not_of(whitespace);
+    if (start != std::string::npos && value[start] == '[') {
+        std::size_t end = value.find_last_not_of(whitespace);
+        if (value[end] != ']')
+            throw MqttPayloadConversionException("Conversion failed, list of values is not closed");
+        std::size_t pos = start + 1;
+        while(pos < end) {
+            std::size_t next = value.find(',', pos);
+            if (next == std::string::npos || next > end)
+                next = end;
+            ret.push_back(convertRegisterValue(command, value.substr(pos, next - pos)));
+            pos = next + 1;
+        }
+    } else {
+        RegisterType regType = command.mRegister.getRegisterType();
+        if (regType != RegisterType::HOLDING || command.mCount > 4)
+            throw MqttPayloadConversionException("Conversion failed, list of " + std::to_string(command.mCount) + " values expected");
+        long long temp;
+        try {
+            temp = std::stoll(value);
+        } catch (const std::invalid_argument& ex) {
+            throw MqttPayloadConversionException("Failed to convert mqtt value to int");
+        } catch (const std::out_of_range& ex) {
+            throw MqttPayloadConversionException("mqtt value if out of range");
+        }
+        int bits = command.mCount * 16;
+        if (bits < 64 && (temp >= (1LL << bits) || temp < -(1LL << (bits - 1))))
+            throw MqttPayloadConversionException(std::string("Conversion failed, value " + std::to_string(temp) + " out of range"));
+        for(int i = command.mCount - 1; i >= 0; i--)
+            ret.push_back(static_cast<uint16_t>(static_cast<unsigned long long>(temp) >> (i * 16)));
+    }
+    if (ret.size() != static_cast<std::size_t>(command.mCount))
+        throw MqttPayloadConversionException("Conversion failed, " + std::to_string(command.mCount) + " values expected, got " + std::to_string(ret.size()));
+    return ret;
+}
+
 void
 MqttClient::onMessage(const char* topic, const void* payload, int payloadlen) {
     try {
-        const MqttObjectCommand& command = findCommand(topic);
-        const std::string network = command.mRegister.mNetworkName;
-
-        //TODO is is thread safe to iterate on modbus clients from mosquitto callback?
-        std::vector<std::shared_ptr<ModbusClient>>::const_iterator it = std::find_if(
-            mModbusClients.begin(), mModbusClients.end(),
-            [&network](const std::shared_ptr<ModbusClient>& client) -> bool { return client->mName == network; }
-        );
-        if (it == mModbusClients.end()) {
-            BOOST_LOG_SEV(log, Log::error) << "Modbus network " << network << " not found for command  " << topic << ", dropping message";
+        // command index is not modified after start,
+        // so it is safe to use it from mosquitto callback
+        const CommandTarget& target = findCommand(topic);
+        const MqttObjectCommand& command(*target.mCommand);
+        if (target.mClient == nullptr) {
+            BOOST_LOG_SEV(log, Log::error) << "Modbus network " << mOwner.getNetworkName(command.mRegister.getNetworkId()) << " not found for command  " << topic << ", dropping message";
+        } else if (command.mCount > 1) {
+            std::vector<uint16_t> values = convertMqttPayloadValues(command, payload, payloadlen);
+            target.mClient->sendCommand(command, values);
         } else {
             uint16_t value = convertMqttPayload(command, payload, payloadlen);
-            (*it)->sendCommand(command, value);
+            target.mClient->sendCommand(command, value);
         }
     } catch (const MqttPayloadConversionException& ex) {
         BOOST_LOG_SEV(log, Log::error) << "Value error for " << topic << ":" << ex.what();
     } catch (const ObjectCommandNotFoundException&) {
-        BOOST_LOG_SEV(log, Log::error) << "No command for topic " << topic << ", dropping message";
+        // wildcard subscription can match topics that are not commands
+        if (mCommandFilters.empty())
+            BOOST_LOG_SEV(log, Log::error) << "No command for topic " << topic << ", dropping message";
+        else
+            BOOST_LOG_SEV(log, Log::debug) << "No command for topic " << topic << ", dropping message";
     }
 }
 
-const MqttObjectCommand&
+const MqttClient::CommandTarget&
 MqttClient::findCommand(const char* topic) const {
-    std::string objectName;
-    std::string commandName;
-    const char *ptr = strrchr(topic, '/');
-    if(ptr) {
-       objectName = std::string(topic, ptr);
-       commandName = std::string(ptr+1);
-    } else {
-        //should never happen because we force commands to have a name
-        objectName = topic;
-    }
-
-
-    std::vector<MqttObject>::const_iterator obj = std::find_if(
-        mObjects.begin(), mObjects.end(),
-        [&objectName](const MqttObject& item) -> bool { return item.getTopic() == objectName; }
-    );
-    if (obj != mObjects.end()) {
-        std::vector<MqttObjectCommand>::const_iterator cmd = std::find_if(
-            obj->mCommands.begin(), obj->mCommands.end(),
-            [&commandName](const MqttObjectCommand& item) -> bool { return item.mName == commandName; }
-        );
-        if (cmd != obj->mCommands.end())
-            return *cmd;
-    }
-    throw ObjectCommandNotFoundException(topic);
+    std::unordered_map<std::string_view, CommandTarget>::const_iterator it = mCommandIndex.find(topic);
+    if (it == mCommandIndex.end())
+        throw ObjectCommandNotFoundException(topic);
+    return it->second;
 }
 
 }
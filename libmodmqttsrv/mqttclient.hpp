@@ -1,10 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <string_view>
+#include <unordered_map>
+
 #include "config.hpp"
 #include "common.hpp"
 #include "mqttobject.hpp"
 #include "modbus_client.hpp"
 #include "imqttimpl.hpp"
+#include "mqtt_publisher.hpp"
+#include "conversion_pool.hpp"
 
 namespace modmqttd {
 
@@ -22,41 +28,85 @@ class MqttClient {
         MqttClient(ModMqtt& modmqttd);
         void setClientId(const std::string& clientId);
         void setBrokerConfig(const MqttBrokerConfig& config);
-        void setModbusClients(const std::vector<std::shared_ptr<ModbusClient>>& clients) { mModbusClients = clients; }
+        void setModbusClients(const std::vector<std::shared_ptr<ModbusClient>>& clients);
+        // topic filters with wildcards used instead of
+        // subscribing to every command topic
+        void setCommandSubscriptions(const std::vector<std::string>& filters);
         void start() ;//TODO throw(MosquittoException) - depreciated?;
         bool isStarted() { return mIsStarted; }
         void shutdown();
         bool isConnected() const { return mConnectionState == State::CONNECTED; }
         void reconnect() { mMqttImpl->reconnect(); }
-        void setObjects(const std::vector<MqttObject> objects) { mObjects = objects; };
+        void setObjects(const std::vector<MqttObject>& objects);
+        // starts threads that convert and serialize changed objects,
+        // if count is 0 then it is done in caller thread
+        void setConversionThreads(int count);
 
-        //publish all data after broker is reconnected
-        void publishAll();
-        void publishState(const MqttObject& obj);
+        //publish objects changed since last call
+        void publishChanges();
+        void publishState(MqttObject& obj, bool force = false);
 
-        void processRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value);
+        void processRegisterValue(
+            const MqttObjectRegisterIdent& ident,
+            uint16_t value,
+            bool forcePublish = false,
+            const std::chrono::system_clock::time_point& readTime = std::chrono::system_clock::time_point()
+        );
         void processRegisterOperationFailed(const MqttObjectRegisterIdent& ident);
-        void processModbusNetworkState(const std::string& networkName, bool isUp);
+        void processModbusNetworkState(int networkId, bool isUp);
         void publishAvailabilityChange(const MqttObject& obj);
+        // publishes data not related to mqtt objects, i.e. metrics
+        void publishMetric(const std::string& topic, const std::string& payload);
+        // hands messages published since last call to publisher thread
+        void commitPublishes() { mPublisher.commit(); }
+        // number of object state and availability publishes
+        uint64_t getPublishCount() const { return mPublishCount.load(std::memory_order_relaxed); }
+        // number of publishes replaced by newer value of the same topic
+        uint64_t getSupersededCount() const { return mPublisher.getSupersededCount(); }
 
         //mqtt communication callbacks
         void onDisconnect();
         void onConnect();
         void onMessage(const char* topic, const void* payload, int payload_len);
 
+        // checks if topic matches subscription filter with + and # wildcards
+        static bool topicMatches(const char* filter, const char* topic);
+
         //for unit tests
         void setMqttImplementation(const std::shared_ptr<IMqttImpl>& impl) { mMqttImpl = impl; }
     private:
         std::shared_ptr<IMqttImpl> mMqttImpl;
+        // sends messages from its own thread, so slow broker does not
+        // block main loop. Holds last value of every topic when disconnected
+        MqttPublisher mPublisher;
+
+        class CommandTarget {
+            public:
+                const MqttObjectCommand* mCommand;
+                // null if command network is not defined
+                ModbusClient* mClient;
+        };
 
-        void subscribeToCommandTopic(const std::string& objectName, const MqttObjectCommand& cmd);
+        class Subscription {
+            public:
+                std::string mTopic;
+                int mQos;
+        };
 
         boost::log::sources::severity_logger<Log::severity> log;
         ModMqtt& mOwner;
         MqttBrokerConfig mBrokerConfig;
 
         void checkAvailabilityChange(MqttObject& object, const MqttObjectRegisterIdent& ident, uint16_t value);
-        const MqttObjectCommand& findCommand(const char* topic) const;
+        // objects with mStateChanged or mAvailabilityChanged set, in order of change
+        std::vector<MqttObject*> mChangedObjects;
+        // state payloads are built here to avoid allocation on every publish
+        StateMessageBuilder mStateBuilder;
+        void setStateChanged(MqttObject& object, bool forcePublish);
+        void setAvailabilityChanged(MqttObject& object);
+        void publishChanges(MqttObject& object, StateMessageBuilder& builder, boost::log::sources::severity_logger<Log::severity>& logger);
+        void publishState(MqttObject& obj, bool force, StateMessageBuilder& builder, boost::log::sources::severity_logger<Log::severity>& logger);
+        const CommandTarget& findCommand(const char* topic) const;
 
         std::vector<std::shared_ptr<ModbusClient>> mModbusClients;
 
@@ -64,7 +114,30 @@ class MqttClient {
         // Now it looks like callbacks use mosquitto internal thread and ModMqtt main thread.
         State mConnectionState = State::DISCONNECTED;
         bool mIsStarted = false;
+        // updated by conversion threads
+        std::atomic<uint64_t> mPublishCount{0};
         std::vector<MqttObject> mObjects;
+
+        // maps modbus register to all objects that use it
+        // slots point to mObjects items, rebuilt in setObjects()
+        std::unordered_map<
+            MqttObjectRegisterIdent,
+            std::vector<MqttObjectRegisterSlot>,
+            MqttObjectRegisterIdent::Hash
+        > mRegisterIndex;
+        void buildRegisterIndex();
+
+        // maps full command topic to command and modbus client.
+        // Keys point to mCommandTopics, rebuilt in buildCommandIndex()
+        std::vector<std::string> mCommandTopics;
+        std::unordered_map<std::string_view, CommandTarget> mCommandIndex;
+        std::vector<std::string> mCommandFilters;
+        // sent after every connect
+        std::vector<Subscription> mSubscriptions;
+        void buildCommandIndex();
+
+        // declared last, so threads are stopped before objects are destroyed
+        ConversionPool mConversionPool;
 };
 
 }
@@ -1,20 +1,11 @@
 #include <algorithm>
 #include <iostream>
 
-#include <rapidjson/stringbuffer.h>
-#include <rapidjson/writer.h>
-
 #include "mqttobject.hpp"
 #include "config.hpp"
 
 namespace modmqttd {
 
-MqttValue
-MqttObjectRegisterValue::getConvertedValue() const {
-    ModbusRegisters data(mValue);
-    return mConverter->toMqtt(data);
-}
-
 AvailableFlag
 MqttObjectAvailabilityValue::getAvailabilityFlag() const {
     if (!mReadOk || !mHasValue)
@@ -24,7 +15,7 @@ MqttObjectAvailabilityValue::getAvailabilityFlag() const {
 
 template <typename T>
 void
-MqttObjectRegisterHolder<T>::addRegister(const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverter>& conv) {
+MqttObjectRegisterHolder<T>::addRegister(const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverterV2>& conv) {
     auto it = mRegisterValues.find(regIdent);
     if (it == mRegisterValues.end()) {
         mRegisterValues[regIdent] = T();
@@ -38,6 +29,15 @@ MqttObjectRegisterHolder<T>::hasRegister(const MqttObjectRegisterIdent& regIdent
     return mRegisterValues.find(regIdent) != mRegisterValues.end();
 }
 
+template <typename T>
+T*
+MqttObjectRegisterHolder<T>::getRegisterValue(const MqttObjectRegisterIdent& regIdent) {
+    auto reg = mRegisterValues.find(regIdent);
+    if (reg == mRegisterValues.end())
+        return nullptr;
+    return &(reg->second);
+}
+
 template <typename T>
 bool
 MqttObjectRegisterHolder<T>::updateRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value) {
@@ -63,10 +63,10 @@ MqttObjectRegisterHolder<T>::updateRegisterReadFailed(const MqttObjectRegisterId
 
 template <typename T>
 bool
-MqttObjectRegisterHolder<T>::setModbusNetworkState(const std::string& networkName, bool isUp) {
+MqttObjectRegisterHolder<T>::setModbusNetworkState(int networkId, bool isUp) {
     bool ret = false;
     for(auto it = mRegisterValues.begin(); it != mRegisterValues.end(); it++) {
-        if (it->first.mNetworkName == networkName) {
+        if (it->first.getNetworkId() == networkId) {
             it->second.setReadError(!isUp);
             ret = true;
         }
@@ -95,14 +95,16 @@ MqttObjectRegisterHolder<T>::isPolling() const {
 }
 
 template <typename T>
-ModbusRegisters
+RegisterSpan
 MqttObjectRegisterHolder<T>::getRawArray() const {
-    ModbusRegisters ret;
-
-    for(auto it = mRegisterValues.begin(); it != mRegisterValues.end(); it++)
-        ret.addValue(it->second.getRawValue());
-
-    return ret;
+    // size does not change after configuration is loaded,
+    // so buffer is allocated only once
+    mRawValues.resize(mRegisterValues.size());
+    auto out = mRawValues.begin();
+    for(auto it = mRegisterValues.begin(); it != mRegisterValues.end(); it++, out++)
+        *out = it->second.getRawValue();
+
+    return RegisterSpan(mRawValues.data(), mRawValues.size());
 }
 
 void
@@ -129,7 +131,7 @@ MqttObjectAvailability::getAvailableFlag() const {
 }
 
 void
-MqttObjectState::addRegister(const std::string& name, const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverter>& conv) {
+MqttObjectState::addRegister(const std::string& name, const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverterV2>& conv) {
     std::vector<MqttObjectStateValue>::iterator existing = std::find_if(
         mValues.begin(),
         mValues.end(),
@@ -142,114 +144,142 @@ MqttObjectState::addRegister(const std::string& name, const MqttObjectRegisterId
     }
 };
 
-void
-createConvertedValue(
-    rapidjson::Writer<rapidjson::StringBuffer>& writer,
-    const MqttValue& value
-) {
-    switch(value.getSourceType()) {
-        case MqttValue::SourceType::INT:
-            writer.Int(value.getInt());
-            break;
-        case MqttValue::SourceType::DOUBLE:
-            writer.Double(value.getDouble());
-            break;
-        case MqttValue::SourceType::BINARY:
-            writer.String(static_cast<const char*>(value.getBinaryPtr()), value.getBinarySize());
-            break;
-    }
-}
+/**
+ * Writes converted value as JSON value
+ * */
+class JsonValueSink : public IMqttValueSink {
+    public:
+        JsonValueSink(rapidjson::Writer<StringOutputStream>& writer) : mWriter(writer) {}
+        virtual void setInt(int32_t val) { mWriter.Int(val); }
+        virtual void setDouble(double val) { mWriter.Double(val); }
+        virtual void setString(const char* data, size_t len) { mWriter.String(data, len); }
+    private:
+        rapidjson::Writer<StringOutputStream>& mWriter;
+};
+
+/**
+ * Appends converted value as plain text. Output is the same
+ * as MqttValue::getString()
+ * */
+class StringValueSink : public IMqttValueSink {
+    public:
+        StringValueSink(std::string& out) : mOut(out) {}
+
+        virtual void setInt(int32_t val) {
+            char buf[MqttValue::MaxCharsLength];
+            mOut.append(buf, MqttValue::toChars(buf, buf + sizeof(buf), val));
+        }
+
+        virtual void setDouble(double val) {
+            char buf[MqttValue::MaxCharsLength];
+            mOut.append(buf, MqttValue::toChars(buf, buf + sizeof(buf), val));
+        }
+
+        virtual void setString(const char* data, size_t len) { mOut.append(data, len); }
+    private:
+        std::string& mOut;
+};
 
 void
 createRegisterValuesArray(
-    rapidjson::Writer<rapidjson::StringBuffer>& writer,
-    const std::map<MqttObjectRegisterIdent,
-                    MqttObjectRegisterValue,
-                    MqttObjectRegisterIdent::Compare>
-                mRegisterValues)
+    JsonValueSink& sink,
+    rapidjson::Writer<StringOutputStream>& writer,
+    const MqttObjectStateValue& stateValue)
 {
+    const auto& registerValues(stateValue.getValues());
+    RegisterSpan raw(stateValue.getRawArray());
+    MqttValue* converted = stateValue.getConversionBuffer();
+
     writer.StartArray();
-    for(auto regValue = mRegisterValues.begin();
-        regValue != mRegisterValues.end(); regValue++)
-    {
-        if (regValue->second.hasConverter()) {
-            createConvertedValue(writer, regValue->second.getConvertedValue());
+    int idx = 0;
+    auto regValue = registerValues.begin();
+    while(regValue != registerValues.end()) {
+        // consecutive registers with the same converter
+        // are converted in one call
+        const IStateConverterV2* converter = regValue->second.getConverter();
+        int count = 0;
+        do {
+            regValue++;
+            count++;
+        } while(regValue != registerValues.end() && regValue->second.getConverter() == converter);
+
+        if (converter != nullptr) {
+            converter->convertBatch(RegisterSpan(raw.begin() + idx, count), converted);
+            for(int i = 0; i < count; i++)
+                sink.setValue(converted[i]);
         } else {
-            writer.Uint(regValue->second.getRawValue());
+            for(int i = 0; i < count; i++)
+                writer.Uint(raw.getValue(idx + i));
         }
+        idx += count;
     }
     writer.EndArray();
 }
 
 void
 createConvertedValue(
-    rapidjson::Writer<rapidjson::StringBuffer>& writer,
-    const ModbusRegisters& registers,
-    const IStateConverter& converter
-) {
-    MqttValue v = converter.toMqtt(registers);
-    createConvertedValue(writer, v);
-}
-
-void
-createConvertedValue(
-    rapidjson::Writer<rapidjson::StringBuffer>& writer,
+    JsonValueSink& sink,
+    rapidjson::Writer<StringOutputStream>& writer,
     const MqttObjectStateValue& stateValue,
-    const std::shared_ptr<IStateConverter>& converter
+    const IStateConverterV2* converter
 ) {
     if (stateValue.isScalar()) {
         //single value
         const MqttObjectRegisterValue& val(stateValue.getValues().begin()->second);
-        if (converter != nullptr)
-            createConvertedValue(writer, converter->toMqtt(val.getRawValue()));
-        else {
+        if (converter != nullptr) {
+            uint16_t raw = val.getRawValue();
+            converter->convert(RegisterSpan(&raw, 1), sink);
+        } else {
             if (val.hasConverter())
-                createConvertedValue(writer, val.getConvertedValue());
+                val.getConvertedValue(sink);
             else
                 writer.Uint(val.getRawValue());
         }
     } else {
         //array of values
         if (converter != nullptr)
-            createConvertedValue(writer, stateValue.getRawArray(), *converter);
+            converter->convert(stateValue.getRawArray(), sink);
         else
-            createRegisterValuesArray(writer, stateValue.getValues());
+            createRegisterValuesArray(sink, writer, stateValue);
     }
 }
 
-std::string
-MqttObjectState::createMessage() const {
+void
+MqttObjectState::createMessage(StateMessageBuilder& builder) const {
+    builder.reset();
     // return mqtt value without rapidjson
     // processing
     if (mValues.size() == 1) {
         const MqttObjectStateValue& single(mValues[0]);
         if (single.isUnnamed() && single.isScalar()) {
+            StringValueSink sink(builder.mPayload);
             if (mConverter != nullptr) {
-                MqttValue v = mConverter->toMqtt(single.getRawArray());
-                return v.getString();
+                mConverter->convert(single.getRawArray(), sink);
             } else {
-                return std::to_string(single.getFirstRawValue());
+                sink.setInt(single.getFirstRawValue());
             }
+            return;
         }
     }
 
     //in all other cases we output json string
     {
         const MqttObjectStateValue& first(mValues[0]);
-        rapidjson::StringBuffer ret;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(ret);
+        rapidjson::Writer<StringOutputStream>& writer(builder.mWriter);
+        JsonValueSink sink(writer);
+        const IStateConverterV2* converter = mConverter.get();
         if (mValues.size() == 1) {
             if (first.isUnnamed()) {
                 //unnamed array, single value is handled above
-                if (mConverter != nullptr)
-                    createConvertedValue(writer, first.getRawArray(), *mConverter);
+                if (converter != nullptr)
+                    converter->convert(first.getRawArray(), sink);
                 else
-                    createRegisterValuesArray(writer, first.getValues());
+                    createRegisterValuesArray(sink, writer, first);
             } else {
                 writer.StartObject();
                 writer.Key(first.mName.c_str());
                 //for named scalar or named array
-                createConvertedValue(writer, first, mConverter);
+                createConvertedValue(sink, writer, first, converter);
                 writer.EndObject();
             }
         } else {
@@ -257,7 +287,7 @@ MqttObjectState::createMessage() const {
                 //unnamed array, assume all StateValue objects are unnamed
                 writer.StartArray();
                 for(auto it = mValues.begin(); it != mValues.end(); it++) {
-                    createConvertedValue(writer, *it, mConverter);
+                    createConvertedValue(sink, writer, *it, converter);
                 }
                 writer.EndArray();
             } else {
@@ -265,12 +295,11 @@ MqttObjectState::createMessage() const {
                 writer.StartObject();
                 for(auto it = mValues.begin(); it != mValues.end(); it++) {
                     writer.Key(it->mName.c_str());
-                    createConvertedValue(writer, *it, mConverter);
+                    createConvertedValue(sink, writer, *it, converter);
                 }
                 writer.EndObject();
             };
         }
-        return ret.GetString();
     }
 }
 
@@ -284,6 +313,15 @@ MqttObjectState::hasRegister(const MqttObjectRegisterIdent& regIdent) const {
 }
 
 
+void
+MqttObjectState::getRegisterValues(const MqttObjectRegisterIdent& regIdent, std::vector<MqttObjectRegisterValue*>& values) {
+    for(std::vector<MqttObjectStateValue>::iterator it = mValues.begin(); it != mValues.end(); it++) {
+        MqttObjectRegisterValue* value = it->getRegisterValue(regIdent);
+        if (value != nullptr)
+            values.push_back(value);
+    }
+}
+
 bool
 MqttObjectState::updateRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value) {
     bool ret = false;
@@ -305,10 +343,10 @@ MqttObjectState::updateRegisterReadFailed(const MqttObjectRegisterIdent& regIden
 }
 
 bool
-MqttObjectState::setModbusNetworkState(const std::string& networkName, bool isUp) {
+MqttObjectState::setModbusNetworkState(int networkId, bool isUp) {
     bool ret = false;
     for(std::vector<MqttObjectStateValue>::iterator it = mValues.begin(); it != mValues.end(); it++) {
-        if (it->setModbusNetworkState(networkName, isUp))
+        if (it->setModbusNetworkState(networkId, isUp))
             ret = true;
     }
     return ret;
@@ -354,10 +392,37 @@ MqttObject::updateRegisterReadFailed(const MqttObjectRegisterIdent& regIdent) {
         updateAvailablityFlag();
 }
 
+MqttObjectRegisterSlot
+MqttObject::getRegisterSlot(const MqttObjectRegisterIdent& regIdent) {
+    MqttObjectRegisterSlot ret(*this);
+    mState.getRegisterValues(regIdent, ret.mValues);
+    ret.mIsStateRegister = ret.mValues.size() != 0;
+    MqttObjectAvailabilityValue* avail = mAvailability.getRegisterValue(regIdent);
+    if (avail != nullptr)
+        ret.mValues.push_back(avail);
+    return ret;
+}
+
+void
+MqttObject::updateRegisterValue(const MqttObjectRegisterSlot& slot, uint16_t value) {
+    for(std::vector<MqttObjectRegisterValue*>::const_iterator it = slot.mValues.begin(); it != slot.mValues.end(); it++) {
+        (*it)->setReadError(false);
+        (*it)->setValue(value);
+    }
+    updateAvailablityFlag();
+}
+
+void
+MqttObject::updateRegisterReadFailed(const MqttObjectRegisterSlot& slot) {
+    for(std::vector<MqttObjectRegisterValue*>::const_iterator it = slot.mValues.begin(); it != slot.mValues.end(); it++)
+        (*it)->setReadError(true);
+    updateAvailablityFlag();
+}
+
 void
-MqttObject::setModbusNetworkState(const std::string& networkName, bool isUp) {
-    bool stateChanged = mState.setModbusNetworkState(networkName, isUp);
-    bool availChanged = mAvailability.setModbusNetworkState(networkName, isUp);
+MqttObject::setModbusNetworkState(int networkId, bool isUp) {
+    bool stateChanged = mState.setModbusNetworkState(networkId, isUp);
+    bool availChanged = mAvailability.setModbusNetworkState(networkId, isUp);
     if (stateChanged || availChanged)
         updateAvailablityFlag();
 }
@@ -1,12 +1,17 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <map>
+#include <vector>
+#include <functional>
 #include <iostream>
 
 #include <yaml-cpp/yaml.h>
+#include <rapidjson/writer.h>
 
 #include "modbus_messages.hpp"
+#include "imqttimpl.hpp"
 #include "libmodmqttconv/converter.hpp"
 
 namespace modmqttd {
@@ -17,28 +22,46 @@ enum AvailableFlag {
     True = 1
 };
 
+/**
+ * Identifies modbus register used by mqtt object
+ *
+ * Network name is interned to small integer id when config is loaded.
+ * All parts are packed into single 64-bit key, ordered by
+ * network id, slave id, register number and register type
+ * */
 class MqttObjectRegisterIdent {
     public:
         struct Compare {
             bool operator() (const MqttObjectRegisterIdent& left, const MqttObjectRegisterIdent& right) const {
-                return std::tie(left.mNetworkName, left.mSlaveId, left.mRegisterNumber, left.mRegisterType)
-                        < std::tie(right.mNetworkName, right.mSlaveId, right.mRegisterNumber, right.mRegisterType);
+                return left.mKey < right.mKey;
             }
         };
+        struct Hash {
+            std::size_t operator() (const MqttObjectRegisterIdent& ident) const {
+                return std::hash<uint64_t>()(ident.mKey);
+            }
+        };
+        bool operator==(const MqttObjectRegisterIdent& other) const { return mKey == other.mKey; }
+
         MqttObjectRegisterIdent(
-            const std::string& network,
+            int networkId,
             int slaveId,
             RegisterType regType,
             int registerNumber
-        ) : mNetworkName(network),
-            mSlaveId(slaveId),
-            mRegisterNumber(registerNumber),
-            mRegisterType(regType)
+        ) : mKey(
+                (uint64_t(uint16_t(networkId)) << 48)
+                | (uint64_t(uint16_t(slaveId)) << 32)
+                | (uint64_t(uint16_t(registerNumber)) << 16)
+                | uint64_t(uint16_t(regType))
+            )
         {}
-        std::string mNetworkName;
-        int mSlaveId;
-        int mRegisterNumber;
-        RegisterType mRegisterType;
+        int getNetworkId() const { return uint16_t(mKey >> 48); }
+        int getSlaveId() const { return uint16_t(mKey >> 32); }
+        int getRegisterNumber() const { return uint16_t(mKey >> 16); }
+        RegisterType getRegisterType() const { return RegisterType(uint16_t(mKey)); }
+        uint64_t getKey() const { return mKey; }
+    private:
+        uint64_t mKey;
 };
 
 class MqttObjectCommand {
@@ -51,6 +74,42 @@ class MqttObjectCommand {
         std::string mName;
         PayloadType mPayloadType;
         MqttObjectRegisterIdent mRegister;
+        // subscription QoS
+        int mQos = 0;
+        // number of registers written, starting from mRegister
+        int mCount = 1;
+};
+
+/**
+ * rapidjson output stream that appends to std::string
+ * */
+class StringOutputStream {
+    public:
+        typedef char Ch;
+        StringOutputStream(std::string& out) : mOut(out) {}
+        void Put(char c) { mOut.push_back(c); }
+        void Flush() {}
+    private:
+        std::string& mOut;
+};
+
+/**
+ * Reusable buffers for state payloads. Memory is allocated only
+ * when payload is longer or JSON is deeper than any previous one.
+ * */
+class StateMessageBuilder {
+    public:
+        StateMessageBuilder() : mStream(mPayload), mWriter(mStream) {}
+        StateMessageBuilder(const StateMessageBuilder&) = delete;
+
+        void reset() {
+            mPayload.clear();
+            mWriter.Reset(mStream);
+        }
+
+        std::string mPayload;
+        StringOutputStream mStream;
+        rapidjson::Writer<StringOutputStream> mWriter;
 };
 
 class MqttObjectRegisterValue {
@@ -60,17 +119,18 @@ class MqttObjectRegisterValue {
         MqttObjectRegisterValue() : mHasValue(false), mReadOk(true) {}
         void setValue(uint16_t val) { mValue = val; mHasValue = true; }
         void setReadError(bool pFlag) { mReadOk = !pFlag; }
-        void setConverter(std::shared_ptr<IStateConverter> conv) { mConverter = conv; }
+        void setConverter(std::shared_ptr<IStateConverterV2> conv) { mConverter = conv; }
         bool hasConverter() const { return mConverter != nullptr; }
+        const IStateConverterV2* getConverter() const { return mConverter.get(); }
         uint16_t getRawValue() const { return mValue; }
-        MqttValue getConvertedValue() const;
+        void getConvertedValue(IMqttValueSink& out) const { mConverter->convert(RegisterSpan(&mValue, 1), out); }
         bool hasValue() const { return mHasValue; }
         bool isPolling() const { return mReadOk; }
     protected:
         bool mReadOk = false;
         bool mHasValue = false;
         uint16_t mValue;
-        std::shared_ptr<IStateConverter> mConverter;
+        std::shared_ptr<IStateConverterV2> mConverter;
 };
 
 class MqttObjectAvailabilityValue : public MqttObjectRegisterValue {
@@ -84,50 +144,61 @@ class MqttObjectAvailabilityValue : public MqttObjectRegisterValue {
 template <typename T>
 class MqttObjectRegisterHolder {
     public:
-        void addRegister(const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverter>& conv);
+        void addRegister(const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverterV2>& conv);
         bool hasRegister(const MqttObjectRegisterIdent& regIdent) const;
+        T* getRegisterValue(const MqttObjectRegisterIdent& regIdent);
         bool updateRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value);
         bool updateRegisterReadFailed(const MqttObjectRegisterIdent& regIdent);
-        bool setModbusNetworkState(const std::string& networkName, bool isUp);
+        bool setModbusNetworkState(int networkId, bool isUp);
         bool hasValue() const;
         bool isPolling() const;
-        MqttValue getFirstConvertedValue() const { return mRegisterValues.begin()->second.getConvertedValue(); }
         uint16_t getFirstRawValue() const { return mRegisterValues.begin()->second.getRawValue(); }
         const std::map<MqttObjectRegisterIdent, T, MqttObjectRegisterIdent::Compare>& getValues() const { return mRegisterValues; }
-        ModbusRegisters getRawArray() const;
+        // returned view is valid until next call
+        RegisterSpan getRawArray() const;
     protected:
         std::map<MqttObjectRegisterIdent, T, MqttObjectRegisterIdent::Compare> mRegisterValues;
+        // contiguous copy of register values for converters
+        mutable std::vector<uint16_t> mRawValues;
 };
 
 class MqttObjectStateValue : public MqttObjectRegisterHolder<MqttObjectRegisterValue> {
     public:
-        MqttObjectStateValue(const std::string& name, const MqttObjectRegisterIdent& ident, const std::shared_ptr<IStateConverter>& conv)
+        MqttObjectStateValue(const std::string& name, const MqttObjectRegisterIdent& ident, const std::shared_ptr<IStateConverterV2>& conv)
             : mName(name)
         {
             addRegister(ident, conv);
         }
         bool isUnnamed() const { return mName.empty(); }
         bool isScalar() const { return mRegisterValues.size() == 1; }
+        // output buffer for IStateConverterV2::convertBatch() with
+        // one element for every register
+        MqttValue* getConversionBuffer() const {
+            mConvertedValues.resize(mRegisterValues.size());
+            return mConvertedValues.data();
+        }
         std::string mName;
     private:
-        std::shared_ptr<IStateConverter> mConverter;
+        mutable std::vector<MqttValue> mConvertedValues;
 };
 
 class MqttObjectState {
     public:
-        void addRegister(const std::string& name, const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverter>& conv);
+        void addRegister(const std::string& name, const MqttObjectRegisterIdent& regIdent, const std::shared_ptr<IStateConverterV2>& conv);
         bool hasRegister(const MqttObjectRegisterIdent& regIdent) const;
-        bool usesModbusNetwork(const std::string& networkName) const;
+        void getRegisterValues(const MqttObjectRegisterIdent& regIdent, std::vector<MqttObjectRegisterValue*>& values);
         bool updateRegisterValue(const MqttObjectRegisterIdent& ident, uint16_t value);
         bool updateRegisterReadFailed(const MqttObjectRegisterIdent& regIdent);
-        bool setModbusNetworkState(const std::string& networkName, bool isUp);
-        void setConverter(std::shared_ptr<IStateConverter> conv) { mConverter = conv; }
-        std::string createMessage() const;
+        bool setModbusNetworkState(int networkId, bool isUp);
+        void setConverter(std::shared_ptr<IStateConverterV2> conv) { mConverter = conv; }
+        // creates payload in builder.mPayload
+        void createMessage(StateMessageBuilder& builder) const;
+        const std::vector<MqttObjectStateValue>& getValues() const { return mValues; }
         bool hasValues() const;
         bool isPolling() const;
     private:
         std::vector<MqttObjectStateValue> mValues;
-        std::shared_ptr<IStateConverter> mConverter;
+        std::shared_ptr<IStateConverterV2> mConverter;
 };
 
 class MqttObjectAvailability : public MqttObjectRegisterHolder<MqttObjectAvailabilityValue> {
@@ -136,6 +207,20 @@ class MqttObjectAvailability : public MqttObjectRegisterHolder<MqttObjectAvailab
         AvailableFlag getAvailableFlag() const;
 };
 
+class MqttObject;
+
+/**
+ * All register values in single MqttObject that
+ * should be updated when modbus register value is read
+ * */
+class MqttObjectRegisterSlot {
+    public:
+        MqttObjectRegisterSlot(MqttObject& object) : mObject(&object) {}
+        MqttObject* mObject;
+        bool mIsStateRegister = false;
+        std::vector<MqttObjectRegisterValue*> mValues;
+};
+
 class MqttObject {
     public:
         MqttObject(const YAML::Node& data);
@@ -144,8 +229,13 @@ class MqttObject {
         const std::string& getAvailabilityTopic() const { return mAvailabilityTopic; }
         void updateRegisterValue(const MqttObjectRegisterIdent& regIdent, uint16_t value);
         void updateRegisterReadFailed(const MqttObjectRegisterIdent& regIdent);
-        void setModbusNetworkState(const std::string& networkName, bool isUp);
-        std::string createStateMessage();
+        // fast path for values found with getRegisterSlot()
+        void updateRegisterValue(const MqttObjectRegisterSlot& slot, uint16_t value);
+        void updateRegisterReadFailed(const MqttObjectRegisterSlot& slot);
+        // returned slot contains pointers to this object values
+        // it is valid as long as object is not copied or destroyed
+        MqttObjectRegisterSlot getRegisterSlot(const MqttObjectRegisterIdent& regIdent);
+        void setModbusNetworkState(int networkId, bool isUp);
         AvailableFlag getAvailableFlag() const { return mIsAvailable; }
         bool hasCommand(const std::string& name) const;
 
@@ -153,6 +243,19 @@ class MqttObject {
         MqttObjectState mState;
         MqttObjectAvailability mAvailability;
 
+        // changes waiting for MqttClient::publishChanges()
+        bool mStateChanged = false;
+        // publish state even if payload did not change
+        bool mForceStatePublish = false;
+        bool mAvailabilityChanged = false;
+        bool hasChanges() const { return mStateChanged || mAvailabilityChanged; }
+        // last state payload sent to broker
+        std::string mPublishedState;
+        // qos, retain and expiry of state and availability messages
+        MqttPublishProps mPublishProps;
+        // time of the last poll of state register
+        std::chrono::system_clock::time_point mLastPollTime;
+
         void dump() const;
     private:
         std::string mTopic;
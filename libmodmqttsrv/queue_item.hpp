@@ -1,48 +1,48 @@
 #pragma once
 
+#include <memory>
+#include <variant>
+
 #include "config.hpp"
+#include "modbus_messages.hpp"
+#include "metrics.hpp"
 
 namespace modmqttd {
 
 /**
- * Simple class for encapsulating data sent between modbus and main thread
- * Thread-safe if you use classes without references and pointers
+ * Messages sent between modbus and main thread
+ *
+ * Frequent messages are stored by value inside queue slots,
+ * so sending them does not allocate memory. Big and rare ones
+ * (configuration, poll specification, statistics) are passed as shared pointers
+ * to keep queue slots small.
+ *
+ * std::monostate is used for default constructed items only
  * */
-class QueueItem {
-    public:
-        QueueItem() {
-            mTypeHash = 0;
-            mItem = NULL;
-        }
-        /**
-         * Prepare data for inserting into queue
-         * */
-        template<typename T> static QueueItem create(const T& data) {
-            return QueueItem(typeid(T).hash_code(), new T(data));
-        }
-
-        /**
-         * Get data from queue item. Once called QueueItem releases its data.
-         * */
-        template<typename T> std::unique_ptr<T> getData() {
-            if (mItem == NULL)
-                throw ModMqttProgramException("Tried to get data from queue item twice");
-            const std::type_info& destType(typeid(T));
-            if (!isSameAs(destType))
-                throw ModMqttProgramException(std::string("Trying to get ") + destType.name() + " from wrong item");
+typedef std::variant<
+    std::monostate,
+    std::shared_ptr<const ModbusNetworkConfig>,
+    std::shared_ptr<const MsgRegisterPollSpecification>,
+    MsgRegisterValue,
+    MsgRegisterValues,
+    MsgMqttNetworkState,
+    MsgCollectStats,
+    EndWorkMessage
+> ToModbusQueueItem;
 
-            std::unique_ptr<T> ret((T*)mItem);
-            mItem = NULL;
-            return ret;
-        }
-        bool isSameAs(const std::type_info& type) const {
-            return type.hash_code() == mTypeHash;
-        }
+typedef std::variant<
+    std::monostate,
+    MsgRegisterValue,
+    MsgRegisterReadFailed,
+    MsgRegisterWriteFailed,
+    MsgModbusNetworkState,
+    std::shared_ptr<const ModbusThreadStats>
+> FromModbusQueueItem;
 
-    private:
-        QueueItem(size_t typeHash,  void* item) : mTypeHash(typeHash), mItem(item) {}
-        size_t mTypeHash;
-        void* mItem;
-};
+/**
+ * Helper for building std::visit visitors from lambdas
+ * */
+template<class... Ts> struct QueueItemVisitor : Ts... { using Ts::operator()...; };
+template<class... Ts> QueueItemVisitor(Ts...) -> QueueItemVisitor<Ts...>;
 
 }
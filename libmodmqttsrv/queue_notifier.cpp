@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "queue_notifier.hpp"
+#include "exceptions.hpp"
+
+namespace modmqttd {
+
+QueueNotifier gQueueNotifier;
+
+QueueNotifier::QueueNotifier() {
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEventFd == -1)
+        throw ModMqttProgramException("Cannot create eventfd for queue notifications");
+}
+
+QueueNotifier::~QueueNotifier() {
+    close(mEventFd);
+}
+
+void
+QueueNotifier::notify(Entry& entry) {
+    if (entry.mReady.exchange(true, std::memory_order_acq_rel))
+        return;
+    Entry* head = mReadyList.load(std::memory_order_relaxed);
+    do {
+        entry.mNextReady = head;
+    } while(!mReadyList.compare_exchange_weak(head, &entry, std::memory_order_release, std::memory_order_relaxed));
+    notify();
+}
+
+void
+QueueNotifier::notify() {
+    uint64_t value = 1;
+    // counter overflow is not possible, main thread resets it
+    // on every wakeup
+    ssize_t ret = write(mEventFd, &value, sizeof(value));
+    (void)ret;
+}
+
+bool
+QueueNotifier::wait(const std::chrono::steady_clock::time_point& until) {
+    struct pollfd fd;
+    fd.fd = mEventFd;
+    fd.events = POLLIN;
+    int ret;
+    do {
+        int timeout = -1;
+        if (until != std::chrono::steady_clock::time_point::max()) {
+            std::chrono::steady_clock::duration left = until - std::chrono::steady_clock::now();
+            // round up to avoid busy loop before deadline
+            int64_t msec = std::chrono::ceil<std::chrono::milliseconds>(left).count();
+            timeout = std::clamp<int64_t>(msec, 0, INT_MAX);
+        }
+        ret = poll(&fd, 1, timeout);
+    } while(ret == -1 && errno == EINTR);
+
+    if (ret <= 0)
+        return false;
+    uint64_t value;
+    ssize_t readed = read(mEventFd, &value, sizeof(value));
+    (void)readed;
+    return true;
+}
+
+void
+QueueNotifier::reset() {
+    mReadyList.store(nullptr);
+    uint64_t value;
+    ssize_t readed = read(mEventFd, &value, sizeof(value));
+    (void)readed;
+}
+
+QueueNotifier::Entry*
+QueueNotifier::reverse(Entry* list) {
+    Entry* ret = nullptr;
+    while(list != nullptr) {
+        Entry* next = list->mNextReady;
+        list->mNextReady = ret;
+        ret = list;
+        list = next;
+    }
+    return ret;
+}
+
+}
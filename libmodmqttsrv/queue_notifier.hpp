@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace modmqttd {
+
+/**
+ * Wakes up main thread when modbus threads send messages
+ *
+ * Every queue read by main thread has an entry with ready flag.
+ * First message sent after main thread took the entry puts it on
+ * a lock-free ready list and signals eventfd. Next messages only
+ * check the flag, so busy modbus threads do not contend on a shared
+ * lock. Main thread drains only queues from the ready list.
+ *
+ * notify() without entry is async-signal-safe, it is used
+ * to wake up main thread for posix signals and mqtt events.
+ * */
+class QueueNotifier {
+    public:
+        class Entry {
+            public:
+                // true if entry is on the ready list
+                std::atomic<bool> mReady{false};
+                Entry* mNextReady = nullptr;
+        };
+
+        QueueNotifier();
+        ~QueueNotifier();
+
+        // called by producer after message is enqueued
+        void notify(Entry& entry);
+        void notify();
+
+        // waits for notification, returns false on timeout
+        bool wait(const std::chrono::steady_clock::time_point& until = std::chrono::steady_clock::time_point::max());
+
+        /**
+         * Calls fn for every ready entry in order of notification.
+         * Ready flag is cleared before fn is called, so messages
+         * enqueued while entry is drained put it on the list again.
+         * */
+        template<typename F> void drainReady(F&& fn) {
+            Entry* entry = reverse(mReadyList.exchange(nullptr, std::memory_order_acquire));
+            while(entry != nullptr) {
+                // entry can be added to list again after
+                // its flag is cleared
+                Entry* next = entry->mNextReady;
+                entry->mReady.exchange(false, std::memory_order_acq_rel);
+                fn(*entry);
+                entry = next;
+            }
+        }
+
+        // forgets entries of previous server instance, used by unit tests
+        void reset();
+    private:
+        int mEventFd;
+        std::atomic<Entry*> mReadyList{nullptr};
+
+        static Entry* reverse(Entry* list);
+};
+
+// shared by modbus threads, mqtt client and main loop
+extern QueueNotifier gQueueNotifier;
+
+}
@@ -1,17 +1,53 @@
+#include <cstdlib>
+
 #include "register_poll.hpp"
 
 namespace modmqttd {
 
 constexpr std::chrono::steady_clock::duration RegisterPoll::DurationBetweenLogError;
 
-RegisterPoll::RegisterPoll(int regNum, RegisterType regType, int refreshMsec)
-    : mLastRead(std::chrono::steady_clock::now() - std::chrono::hours(24)),
+RegisterPoll::RegisterPoll(int slaveId, int regNum, RegisterType regType, int refreshMsec)
+    : mSlaveId(slaveId),
     mRegister(regNum),
-    mRegisterType(regType)
+    mRegisterType(regType),
+    mLastRead(std::chrono::steady_clock::now() - std::chrono::hours(24))
 {
     mRefresh = std::chrono::milliseconds(refreshMsec);
     mReadErrors = 0;
     mFirstErrorTime = std::chrono::steady_clock::now();
+    mLastPublish = mLastRead;
 };
 
+bool
+RegisterPoll::shouldPublish(uint16_t newValue, const std::chrono::steady_clock::time_point& now, bool& forcePublish) const {
+    forcePublish = false;
+    // filters compare with last sent value, so the first value
+    // and value of register readable again after errors are always sent
+    if (!mHasLastValue || mReadErrors != 0)
+        return true;
+
+    std::chrono::steady_clock::duration sinceLastPublish = now - mLastPublish;
+    if (mFilter.mMaxSilenceMsec != 0 && sinceLastPublish >= std::chrono::milliseconds(mFilter.mMaxSilenceMsec)) {
+        forcePublish = true;
+        return true;
+    }
+
+    if (newValue == mLastValue)
+        return false;
+
+    if (mFilter.mMinPublishMsec != 0 && sinceLastPublish < std::chrono::milliseconds(mFilter.mMinPublishMsec))
+        return false;
+
+    if (mFilter.mDeadband != 0) {
+        double lastValue = getFilterValue(mLastValue);
+        double diff = std::abs(getFilterValue(newValue) - lastValue);
+        double band = mFilter.mDeadband;
+        if (mFilter.mDeadbandPercent)
+            band = std::abs(lastValue) * mFilter.mDeadband / 100.0;
+        if (diff <= band)
+            return false;
+    }
+    return true;
+}
+
 } // namespace
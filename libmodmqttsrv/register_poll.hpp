@@ -1,7 +1,9 @@
 #pragma once
 
 #include <chrono>
+#include <algorithm>
 #include "modbus_types.hpp"
+#include "modbus_messages.hpp"
 
 namespace modmqttd {
 
@@ -10,12 +12,40 @@ class RegisterPoll {
         static constexpr std::chrono::steady_clock::duration DurationBetweenLogError = std::chrono::minutes(5);
         // if we cannot read register in this time MsgRegisterReadFailed is sent
         static constexpr int DefaultReadErrorCount = 3;
-        RegisterPoll(int regNum, RegisterType regType, int refreshMsec);
+        RegisterPoll(int slaveId, int regNum, RegisterType regType, int refreshMsec);
+        int mSlaveId;
         int mRegister;
         RegisterType mRegisterType;
         std::chrono::steady_clock::duration mRefresh;
+        PollPriority mPriority = PollPriority::NORMAL;
+        // refresh multiplier set when network is overloaded
+        int mRefreshStretch = 1;
+        std::chrono::steady_clock::duration getEffectiveRefresh() const { return mRefresh * mRefreshStretch; }
+        // how long after getNextPoll() register was polled last time
+        std::chrono::steady_clock::duration mLateness = std::chrono::steady_clock::duration::zero();
         uint16_t mLastValue;
+        // false until first value is sent to mqtt thread
+        bool mHasLastValue = false;
         std::chrono::steady_clock::time_point mLastRead;
+        // failed read is retried after refresh period
+        std::chrono::steady_clock::time_point mLastReadError;
+        // register is not polled before this time
+        // if slave does not respond
+        std::chrono::steady_clock::time_point mSuspendedUntil;
+        std::chrono::steady_clock::time_point getNextPoll() const {
+            return std::max(std::max(mLastRead, mLastReadError) + getEffectiveRefresh(), mSuspendedUntil);
+        }
+
+        RegisterChangeFilter mFilter;
+        // last time when value was sent to mqtt thread
+        std::chrono::steady_clock::time_point mLastPublish;
+        // checks if newValue should be sent to mqtt thread, or filtered out
+        // forcePublish is set when unchanged value should be sent to refresh state
+        bool shouldPublish(uint16_t newValue, const std::chrono::steady_clock::time_point& now, bool& forcePublish) const;
+        // raw value as seen by deadband filter
+        double getFilterValue(uint16_t value) const {
+            return mFilter.mDeadbandSigned ? int16_t(value) : value;
+        }
 
         int mReadErrors;
         std::chrono::steady_clock::time_point mFirstErrorTime;
@@ -0,0 +1,40 @@
+#include "topic_alias_table.hpp"
+
+namespace modmqttd {
+
+void
+TopicAliasTable::reset(uint16_t maximum) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mAliases.clear();
+    mLastAlias = 0;
+    mMaximum = maximum;
+}
+
+uint16_t
+TopicAliasTable::getAlias(const std::string& topic, bool& isNew) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    isNew = false;
+    std::unordered_map<std::string, uint16_t>::const_iterator it = mAliases.find(topic);
+    if (it != mAliases.end())
+        return it->second;
+    if (mLastAlias >= mMaximum)
+        return 0;
+    uint16_t alias = ++mLastAlias;
+    mAliases[topic] = alias;
+    isNew = true;
+    return alias;
+}
+
+void
+TopicAliasTable::remove(const std::string& topic) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mAliases.erase(topic);
+}
+
+uint16_t
+TopicAliasTable::getMaximum() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mMaximum;
+}
+
+}
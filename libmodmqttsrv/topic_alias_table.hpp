@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace modmqttd {
+
+/**
+ * MQTT v5 topic aliases assigned to published topics.
+ *
+ * Aliases are valid for a single connection, table is reset
+ * with alias limit from CONNACK after every connect. Locked because
+ * publish is called from MqttPublisher thread and reset from
+ * mosquitto callback.
+ * */
+class TopicAliasTable {
+    public:
+        // forgets all aliases and sets maximum alias number accepted by broker
+        void reset(uint16_t maximum);
+        /**
+         * Returns alias for topic or 0 if all aliases are used.
+         * isNew is set if alias was assigned by this call and
+         * must be sent with full topic name.
+         * */
+        uint16_t getAlias(const std::string& topic, bool& isNew);
+        // call when publish with new alias failed
+        void remove(const std::string& topic);
+        uint16_t getMaximum() const;
+    private:
+        mutable std::mutex mMutex;
+        std::unordered_map<std::string, uint16_t> mAliases;
+        uint16_t mMaximum = 0;
+        uint16_t mLastAlias = 0;
+};
+
+}
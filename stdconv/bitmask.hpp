@@ -3,11 +3,16 @@
 #include <cmath>
 #include "libmodmqttconv/converter.hpp"
 
-class BitmaskConverter : public IStateConverter {
+class BitmaskConverter : public IStateConverterV2 {
     public:
-        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
             int val = data.getValue(0) & mask;
-            return MqttValue::fromInt(val);
+            out.setInt(val);
+        }
+
+        virtual void convertBatch(const RegisterSpan& data, MqttValue* out) const {
+            const uint16_t m = mask;
+            convertEach<int32_t>(data, out, [m](uint16_t val) -> int32_t { return val & m; });
         }
 
         virtual void setArgs(const std::vector<std::string>& args) {
@@ -3,29 +3,37 @@
 #include <cmath>
 #include "libmodmqttconv/converter.hpp"
 
-class DivideConverter : public IStateConverter {
+class DivideConverter : public IStateConverterV2 {
     public:
-        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
-            double val = data.getValue(0) / divider;
-            if (precision != 0)
-                val = round(val, precision);
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
+            out.setDouble(divide(data.getValue(0)));
+        }
 
-            return MqttValue::fromDouble(val);
+        virtual void convertBatch(const RegisterSpan& data, MqttValue* out) const {
+            convertEach<double>(data, out, [this](uint16_t val) -> double { return divide(val); });
         }
 
         virtual void setArgs(const std::vector<std::string>& args) {
             divider = getDoubleArg(0, args);
             if (args.size() == 2)
                 precision = getIntArg(1, args);
+            precisionDivider = pow(10, precision);
         }
 
         virtual ~DivideConverter() {}
     private:
         double divider;
         int precision = 0;
+        double precisionDivider = 1;
+
+        double divide(double val) const {
+            val = val / divider;
+            if (precision != 0)
+                val = round(val, precisionDivider);
+            return val;
+        }
 
-        static double round(double val, int decimal_digits) {
-            double divider = pow(10, decimal_digits);
+        static double round(double val, double divider) {
             int dummy = (int)(val * divider);
             return dummy / divider;
         }
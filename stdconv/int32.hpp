@@ -3,15 +3,15 @@
 #include <cmath>
 #include "libmodmqttconv/converter.hpp"
 
-class Int32Converter : public IStateConverter {
+class Int32Converter : public IStateConverterV2 {
     public:
-        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
             int val = data.getValue(0);
             if (data.getCount() > 1) {
                 val = val << 16;
                 val += data.getValue(1);
             }
-            return MqttValue::fromInt(val);
+            out.setInt(val);
         }
 
         virtual ~Int32Converter() {}
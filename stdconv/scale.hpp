@@ -3,18 +3,14 @@
 #include <cmath>
 #include "libmodmqttconv/converter.hpp"
 
-class ScaleConverter : public IStateConverter {
+class ScaleConverter : public IStateConverterV2 {
     public:
-        virtual MqttValue toMqtt(const ModbusRegisters& data) const {
-            double sourceValue = data.getValue(0);
-            double targetValue = (targetScaleTo - targetScaleFrom)
-                * (sourceValue - sourceScaleFrom)/(sourceScaleTo - sourceScaleFrom)
-                + targetScaleFrom;
-
-            if (precision != 0)
-                targetValue = round(targetValue, precision);
+        virtual void convert(const RegisterSpan& data, IMqttValueSink& out) const {
+            out.setDouble(scale(data.getValue(0)));
+        }
 
-            return MqttValue::fromDouble(targetValue);
+        virtual void convertBatch(const RegisterSpan& data, MqttValue* out) const {
+            convertEach<double>(data, out, [this](uint16_t val) -> double { return scale(val); });
         }
 
         virtual void setArgs(const std::vector<std::string>& args) {
@@ -25,6 +21,7 @@ class ScaleConverter : public IStateConverter {
 
             if (args.size() == 5)
                 precision = getIntArg(4, args);
+            precisionDivider = pow(10, precision);
         }
 
         virtual ~ScaleConverter() {}
@@ -34,9 +31,19 @@ class ScaleConverter : public IStateConverter {
         double targetScaleFrom;
         double targetScaleTo;
         int precision = 0;
+        double precisionDivider = 1;
+
+        double scale(double sourceValue) const {
+            double targetValue = (targetScaleTo - targetScaleFrom)
+                * (sourceValue - sourceScaleFrom)/(sourceScaleTo - sourceScaleFrom)
+                + targetScaleFrom;
+
+            if (precision != 0)
+                targetValue = round(targetValue, precisionDivider);
+            return targetValue;
+        }
 
-        static double round(double val, int decimal_digits) {
-            double divider = pow(10, decimal_digits);
+        static double round(double val, double divider) {
             int dummy = (int)(val * divider);
             return dummy / divider;
         }
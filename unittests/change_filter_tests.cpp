@@ -0,0 +1,212 @@
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/register_poll.hpp"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+
+TEST_CASE ("Register change filter tests") {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    modmqttd::RegisterPoll reg(1, 1, modmqttd::RegisterType::INPUT, 1000);
+    reg.mLastValue = 100;
+    reg.mHasLastValue = true;
+    reg.mLastPublish = now - std::chrono::seconds(1);
+    bool force;
+
+    SECTION ("every change should be sent without filter") {
+        CHECK(reg.shouldPublish(101, now, force));
+        CHECK(!force);
+        CHECK(!reg.shouldPublish(100, now, force));
+    }
+
+    SECTION ("changes inside absolute deadband should be filtered") {
+        reg.mFilter.mDeadband = 2;
+        CHECK(!reg.shouldPublish(102, now, force));
+        CHECK(!reg.shouldPublish(98, now, force));
+        CHECK(reg.shouldPublish(103, now, force));
+        CHECK(reg.shouldPublish(97, now, force));
+    }
+
+    SECTION ("changes inside percent deadband should be filtered") {
+        reg.mFilter.mDeadband = 5;
+        reg.mFilter.mDeadbandPercent = true;
+        CHECK(!reg.shouldPublish(105, now, force));
+        CHECK(reg.shouldPublish(106, now, force));
+    }
+
+    SECTION ("changes should not be sent more often than min publish interval") {
+        reg.mFilter.mMinPublishMsec = 5000;
+        CHECK(!reg.shouldPublish(200, now, force));
+        CHECK(reg.shouldPublish(200, now + std::chrono::seconds(4), force));
+    }
+
+    SECTION ("unchanged value should be sent after max silence") {
+        reg.mFilter.mMaxSilenceMsec = 3000;
+        CHECK(!reg.shouldPublish(100, now, force));
+        CHECK(reg.shouldPublish(100, now + std::chrono::seconds(2), force));
+        CHECK(force);
+    }
+
+    SECTION ("first value should always be sent") {
+        reg.mFilter.mDeadband = 10;
+        reg.mFilter.mMinPublishMsec = 5000;
+        reg.mHasLastValue = false;
+        reg.mLastPublish = now;
+        CHECK(reg.shouldPublish(100, now, force));
+        CHECK(reg.shouldPublish(105, now, force));
+    }
+
+    SECTION ("signed values should be compared as int16") {
+        reg.mFilter.mDeadband = 2;
+        reg.mFilter.mDeadbandSigned = true;
+        reg.mLastValue = 0xFFFF;
+        CHECK(!reg.shouldPublish(0, now, force));
+        CHECK(!reg.shouldPublish(0xFFFE, now, force));
+        CHECK(reg.shouldPublish(2, now, force));
+
+        // percent of absolute value
+        reg.mFilter.mDeadband = 10;
+        reg.mFilter.mDeadbandPercent = true;
+        reg.mLastValue = uint16_t(-100);
+        CHECK(!reg.shouldPublish(uint16_t(-91), now, force));
+        CHECK(reg.shouldPublish(uint16_t(-89), now, force));
+    }
+
+    SECTION ("unsigned values should be compared as uint16") {
+        reg.mFilter.mDeadband = 2;
+        reg.mLastValue = 0xFFFF;
+        CHECK(reg.shouldPublish(0, now, force));
+    }
+
+    SECTION ("value should be sent after read error") {
+        reg.mFilter.mDeadband = 10;
+        reg.mReadErrors = 1;
+        CHECK(reg.shouldPublish(100, now, force));
+    }
+}
+
+TEST_CASE ("Merged register change filter should be the least restrictive") {
+    modmqttd::RegisterChangeFilter filter;
+    filter.mDeadband = 10;
+    filter.mMinPublishMsec = 1000;
+
+    modmqttd::RegisterChangeFilter other;
+    other.mDeadband = 5;
+    other.mMaxSilenceMsec = 60000;
+
+    filter.merge(other);
+    CHECK(filter.mDeadband == 5);
+    CHECK(filter.mMinPublishMsec == 0);
+    CHECK(filter.mMaxSilenceMsec == 60000);
+
+    other.mDeadbandPercent = true;
+    filter.merge(other);
+    CHECK(filter.mDeadband == 0);
+
+    filter.mDeadband = 5;
+    other.mDeadbandPercent = false;
+    other.mDeadbandSigned = true;
+    filter.merge(other);
+    CHECK(filter.mDeadband == 0);
+}
+
+static const std::string config = R"(
+modmqttd:
+  converter_search_path:
+    - build/stdconv
+  converter_plugins:
+    - stdconv.so
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 50ms
+  deadband: 100
+  broker:
+    host: localhost
+  objects:
+    - topic: scalar
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: int32
+      state:
+        converter: std.int32()
+        registers:
+          - register: tcptest.1.2
+            register_type: input
+          - register: tcptest.1.3
+            register_type: input
+)";
+
+TEST_CASE ("Deadband should not be applied to registers of multi register values") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 10);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 1);
+    server.setModbusRegisterValue("tcptest", 1, 3, modmqttd::RegisterType::INPUT, 0xFFFF);
+    server.start();
+
+    server.waitForPublish("scalar/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("scalar/state") == "10");
+    server.waitForPublish("int32/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("int32/state") == "131071");
+
+    // carry from low to high word is smaller than deadband
+    // in high word, both words must be published
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 11);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 2);
+    server.setModbusRegisterValue("tcptest", 1, 3, modmqttd::RegisterType::INPUT, 0);
+    server.waitForPublish("int32/state", REGWAIT_MSEC);
+    // words can be read in separate polls, wait for both
+    if (server.mqttValue("int32/state") != "131072")
+        server.waitForPublish("int32/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("int32/state") == "131072");
+    REQUIRE(server.getPublishCount("scalar/state") == 1);
+    server.stop();
+}
+
+static const std::string config_signed = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 50ms
+  deadband_signed: true
+  broker:
+    host: localhost
+  objects:
+    - topic: signed
+      state:
+        register: tcptest.1.1
+        register_type: input
+        deadband: 10
+    - topic: unsigned
+      deadband_signed: false
+      state:
+        register: tcptest.1.2
+        register_type: input
+        deadband: 10
+)";
+
+TEST_CASE ("Deadband signed flag should be inherited from upper levels") {
+    MockedModMqttServerThread server(config_signed);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 0xFFFF);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 0xFFFF);
+    server.start();
+
+    server.waitForPublish("signed/state", REGWAIT_MSEC);
+    server.waitForPublish("unsigned/state", REGWAIT_MSEC);
+
+    // -1 -> 1 is inside deadband only when compared as int16
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 1);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 1);
+    server.waitForPublish("unsigned/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("unsigned/state") == "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(server.getPublishCount("signed/state") == 1);
+    server.stop();
+}
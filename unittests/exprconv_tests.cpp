@@ -1,8 +1,12 @@
+#include <atomic>
+#include <thread>
+
 #include <libmodmqttsrv/config.hpp>
 #include "catch2/catch.hpp"
 #include <boost/dll/import.hpp>
 
 #include "libmodmqttconv/converterplugin.hpp"
+#include "libmodmqttconv/convexception.hpp"
 
 #ifdef HAVE_EXPRTK
 
@@ -51,4 +55,53 @@ TEST_CASE ("Exprtk converter test with precission") {
 }
 
 
+TEST_CASE ("Exprtk converters with the same expression should be evaluated concurrently") {
+    std::string stdconv_path = "../exprconv/exprconv.so";
+
+    boost::shared_ptr<ConverterPlugin> plugin = boost_dll_import<ConverterPlugin>(
+        stdconv_path,
+        "converter_plugin",
+        boost::dll::load_mode::append_decorations
+    );
+
+    std::vector<std::shared_ptr<IStateConverter>> converters;
+    for(int i = 0; i < 4; i++) {
+        std::shared_ptr<IStateConverter> conv(plugin->getStateConverter("evaluate"));
+        conv->setArgs({ "R0 * 2 + R1" });
+        converters.push_back(conv);
+    }
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for(std::size_t i = 0; i < converters.size(); i++) {
+        threads.push_back(std::thread([&converters, &errors, i]() {
+            int offset = i;
+            for(uint16_t val = 0; val < 1000; val++) {
+                ModbusRegisters data;
+                data.addValue(val);
+                data.addValue(offset);
+                if (converters[i]->toMqtt(data).getInt() != val * 2 + offset)
+                    errors++;
+            }
+        }));
+    }
+    for(auto& t: threads)
+        t.join();
+
+    REQUIRE(errors == 0);
+}
+
+TEST_CASE ("Exprtk converter should not accept invalid expression") {
+    std::string stdconv_path = "../exprconv/exprconv.so";
+
+    boost::shared_ptr<ConverterPlugin> plugin = boost_dll_import<ConverterPlugin>(
+        stdconv_path,
+        "converter_plugin",
+        boost::dll::load_mode::append_decorations
+    );
+
+    std::shared_ptr<IStateConverter> conv(plugin->getStateConverter("evaluate"));
+    REQUIRE_THROWS_AS(conv->setArgs({ "R0 * (2" }), ConvException);
+}
+
 #endif
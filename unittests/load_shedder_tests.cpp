@@ -0,0 +1,56 @@
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/modbus_load_shedder.hpp"
+
+using modmqttd::ModbusLoadShedder;
+using modmqttd::PollPriority;
+
+TEST_CASE ("Register should be late after half of its refresh") {
+    modmqttd::RegisterPoll reg(1, 1, modmqttd::RegisterType::HOLDING, 1000);
+
+    reg.mLateness = std::chrono::milliseconds(400);
+    CHECK(!ModbusLoadShedder::isLate(reg));
+    reg.mLateness = std::chrono::milliseconds(600);
+    CHECK(ModbusLoadShedder::isLate(reg));
+
+    reg.mRefreshStretch = 2;
+    CHECK(!ModbusLoadShedder::isLate(reg));
+
+    SECTION ("short refresh should tolerate scheduling jitter") {
+        modmqttd::RegisterPoll fast(1, 2, modmqttd::RegisterType::HOLDING, 4);
+        fast.mLateness = std::chrono::milliseconds(5);
+        CHECK(!ModbusLoadShedder::isLate(fast));
+    }
+}
+
+TEST_CASE ("Load shedder should stretch low priority registers first") {
+    ModbusLoadShedder shedder;
+
+    for(int i = 1; i < ModbusLoadShedder::OverloadCycles; i++)
+        CHECK(!shedder.cycleFinished(true));
+    CHECK(shedder.cycleFinished(true));
+    CHECK(shedder.getStretch(PollPriority::LOW) == 2);
+    CHECK(shedder.getStretch(PollPriority::NORMAL) == 1);
+
+    SECTION ("normal priority should be stretched when low is at max") {
+        for(int i = 0; i < ModbusLoadShedder::OverloadCycles * 10; i++)
+            shedder.cycleFinished(true);
+        CHECK(shedder.getStretch(PollPriority::LOW) == ModbusLoadShedder::MaxStretch);
+        CHECK(shedder.getStretch(PollPriority::NORMAL) == ModbusLoadShedder::MaxStretch);
+        CHECK(shedder.getStretch(PollPriority::HIGH) == 1);
+    }
+
+    SECTION ("single on time cycle should reset overload detection") {
+        for(int i = 1; i < ModbusLoadShedder::OverloadCycles; i++)
+            shedder.cycleFinished(true);
+        shedder.cycleFinished(false);
+        CHECK(!shedder.cycleFinished(true));
+        CHECK(shedder.getStretch(PollPriority::LOW) == 2);
+    }
+
+    SECTION ("stretch should be restored after recovery") {
+        for(int i = 1; i < ModbusLoadShedder::RecoveryCycles; i++)
+            CHECK(!shedder.cycleFinished(false));
+        CHECK(shedder.cycleFinished(false));
+        CHECK(shedder.getStretch(PollPriority::LOW) == 1);
+    }
+}
@@ -0,0 +1,100 @@
+#include "catch2/catch.hpp"
+#include "rapidjson/document.h"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+#include "libmodmqttsrv/metrics.hpp"
+
+TEST_CASE ("Latency histogram should estimate percentiles from buckets") {
+    modmqttd::LatencyHistogram histogram;
+    CHECK(histogram.getPercentileMsec(50) == 0);
+
+    for(int i = 0; i < 98; i++)
+        histogram.add(std::chrono::microseconds(800));
+    histogram.add(std::chrono::milliseconds(70));
+    histogram.add(std::chrono::milliseconds(90));
+
+    CHECK(histogram.getCount() == 100);
+    CHECK(histogram.getPercentileMsec(50) == 1);
+    CHECK(histogram.getPercentileMsec(99) == 90);
+    CHECK(histogram.getMaxMsec() == 90);
+    CHECK(histogram.getAverageMsec() == Approx(2.384));
+
+    SECTION ("merged histogram should contain samples of both") {
+        modmqttd::LatencyHistogram other;
+        other.add(std::chrono::seconds(10));
+        histogram.merge(other);
+        CHECK(histogram.getCount() == 101);
+        CHECK(histogram.getMaxMsec() == 10000);
+        CHECK(histogram.getPercentileMsec(100) == 10000);
+    }
+}
+
+static const std::string config = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 20ms
+  metrics:
+    topic: modmqttd/$SYS
+    interval: 200ms
+  broker:
+    host: localhost
+  objects:
+    - topic: one
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: two
+      state:
+        register: tcptest.2.1
+        register_type: input
+)";
+
+TEST_CASE ("Metrics should be published periodically") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 7);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 13);
+    server.start();
+    server.waitForPublish("one/state", REGWAIT_MSEC);
+    server.waitForPublish("two/state", REGWAIT_MSEC);
+    server.setModbusRegisterReadError("tcptest", 2, 1, modmqttd::RegisterType::INPUT);
+
+    // modbus threads start collecting after first request,
+    // so slave stats are sent in second publish
+    server.waitForPublish("modmqttd/$SYS/tcptest/1", std::chrono::seconds(1));
+    server.waitForPublish("modmqttd/$SYS/tcptest/2", std::chrono::seconds(1));
+    server.waitForPublish("modmqttd/$SYS/tcptest", std::chrono::seconds(1));
+    server.waitForPublish("modmqttd/$SYS/mqtt", std::chrono::seconds(1));
+
+    rapidjson::Document slave;
+    slave.Parse(server.mqttValue("modmqttd/$SYS/tcptest/1").c_str());
+    REQUIRE(slave.IsObject());
+    CHECK(slave["reads"].GetUint64() > 0);
+    CHECK(slave["errors"].GetUint64() == 0);
+    CHECK(slave["read_latency_ms"]["count"].GetUint64() == slave["reads"].GetUint64());
+
+    rapidjson::Document failingSlave;
+    failingSlave.Parse(server.mqttValue("modmqttd/$SYS/tcptest/2").c_str());
+    REQUIRE(failingSlave.IsObject());
+    CHECK(failingSlave["errors"].GetUint64() > 0);
+
+    rapidjson::Document network;
+    network.Parse(server.mqttValue("modmqttd/$SYS/tcptest").c_str());
+    REQUIRE(network.IsObject());
+    CHECK(network["poll_cycle_ms"]["count"].GetUint64() > 0);
+    CHECK(network.HasMember("lateness_ms"));
+    CHECK(network.HasMember("command_latency_ms"));
+    CHECK(network.HasMember("to_modbus_queue_max"));
+    CHECK(network.HasMember("from_modbus_queue_max"));
+
+    rapidjson::Document mqtt;
+    mqtt.Parse(server.mqttValue("modmqttd/$SYS/mqtt").c_str());
+    REQUIRE(mqtt.IsObject());
+    CHECK(mqtt.HasMember("publish_rate"));
+
+    server.stop();
+}
@@ -2,7 +2,6 @@
 
 #include "libmodmqttsrv/modbus_messages.hpp"
 #include "libmodmqttsrv/modbus_context.hpp"
-#include "catch2/catch.hpp"
 
 #include <thread>
 #include <iostream>
@@ -13,9 +12,11 @@ const std::chrono::milliseconds MockedModbusContext::sDefaultSlaveWriteTime = st
 void
 MockedModbusContext::Slave::write(const modmqttd::MsgRegisterValue& msg, bool internalOperation) {
     if (!internalOperation) {
-        std::this_thread::sleep_for(mWriteTime);
+        mWriteCount++;
+        mWrittenRegisters.push_back(msg.mRegisterNumber);
         if (mDisconnected) {
-            errno = EIO;
+            // powered off slave does not respond
+            errno = ETIMEDOUT;
             throw modmqttd::ModbusWriteException(std::string("write fn ") + std::to_string(msg.mRegisterNumber) + " failed");
         }
         if (hasError(msg.mRegisterNumber, msg.mRegisterType)) {
@@ -41,34 +42,71 @@ MockedModbusContext::Slave::write(const modmqttd::MsgRegisterValue& msg, bool in
     };
 }
 
+void
+MockedModbusContext::Slave::write(const modmqttd::MsgRegisterValues& msg) {
+    // single modbus request for all registers
+    mWriteCount++;
+    mWrittenRegisters.push_back(msg.mRegisterNumber);
+    int lastRegister = msg.mRegisterNumber + msg.mValues.size() - 1;
+    if (mDisconnected) {
+        errno = ETIMEDOUT;
+        throw modmqttd::ModbusWriteException(std::string("write fn ") + std::to_string(msg.mRegisterNumber) + "-" + std::to_string(lastRegister) + " failed");
+    }
+    for(int i = msg.mRegisterNumber; i <= lastRegister; i++) {
+        if (hasError(i, msg.mRegisterType)) {
+            errno = EIO;
+            throw modmqttd::ModbusWriteException(std::string("write fn ") + std::to_string(msg.mRegisterNumber) + "-" + std::to_string(lastRegister) + " failed");
+        }
+    }
+    for(std::size_t i = 0; i < msg.mValues.size(); i++)
+        write(modmqttd::MsgRegisterValue(msg.mSlaveId, msg.mRegisterType, msg.mRegisterNumber + i, msg.mValues[i]), true);
+}
+
 uint16_t
 MockedModbusContext::Slave::read(const modmqttd::RegisterPoll& regData, bool internalOperation) {
+    return read(regData.mRegisterType, regData.mRegister, 1, internalOperation)[0];
+}
+
+std::vector<uint16_t>
+MockedModbusContext::Slave::read(modmqttd::RegisterType regType, int firstRegister, int count, bool internalOperation) {
     if (!internalOperation) {
-        std::this_thread::sleep_for(mReadTime);
+        // single modbus request for whole block
+        mReadCount++;
         if (mDisconnected) {
-            errno = EIO;
-            throw modmqttd::ModbusReadException(std::string("read fn ") + std::to_string(regData.mRegister) + " failed");
+            // powered off slave does not respond
+            errno = ETIMEDOUT;
+            throw modmqttd::ModbusReadException(std::string("read fn ") + std::to_string(firstRegister) + " failed");
         }
-        if (hasError(regData.mRegister, regData.mRegisterType)) {
-            errno = EIO;
-            throw modmqttd::ModbusReadException(std::string("register read fn ") + std::to_string(regData.mRegister) + " failed");
+        for(int i = firstRegister; i < firstRegister + count; i++) {
+            if (hasError(i, regType)) {
+                errno = EIO;
+                throw modmqttd::ModbusReadException(std::string("register read fn ") + std::to_string(i) + " failed");
+            }
         }
     }
-    switch(regData.mRegisterType) {
+    std::vector<uint16_t> ret;
+    for(int i = firstRegister; i < firstRegister + count; i++)
+        ret.push_back(readRegister(regType, i));
+    return ret;
+}
+
+uint16_t
+MockedModbusContext::Slave::readRegister(modmqttd::RegisterType regType, int num) {
+    switch(regType) {
         case modmqttd::RegisterType::COIL:
-            return readRegister(mCoil, regData.mRegister);
+            return readRegister(mCoil, num);
         break;
         case modmqttd::RegisterType::HOLDING:
-            return readRegister(mHolding, regData.mRegister);
+            return readRegister(mHolding, num);
         break;
         case modmqttd::RegisterType::INPUT:
-            return readRegister(mInput, regData.mRegister);
+            return readRegister(mInput, num);
         break;
         case modmqttd::RegisterType::BIT:
-            return readRegister(mBit, regData.mRegister);
+            return readRegister(mBit, num);
         break;
         default:
-            throw modmqttd::ModbusReadException(std::string("Cannot read, unknown register type ") + std::to_string(regData.mRegisterType));
+            throw modmqttd::ModbusReadException(std::string("Cannot read, unknown register type ") + std::to_string(regType));
     };
 }
 
@@ -133,16 +171,23 @@ MockedModbusContext::Slave::hasError(const std::map<int, MockedModbusContext::Sl
 
 uint16_t
 MockedModbusContext::readModbusRegister(int slaveId, const modmqttd::RegisterPoll& regData) {
+    return readModbusRegisters(slaveId, regData.mRegisterType, regData.mRegister, 1)[0];
+}
+
+std::vector<uint16_t>
+MockedModbusContext::readModbusRegisters(int slaveId, modmqttd::RegisterType regType, int firstRegister, int count) {
     std::unique_lock<std::mutex> lck(mMutex);
-    std::map<int, Slave>::iterator it = findOrCreateSlave(slaveId);
-    uint16_t ret = it->second.read(regData, mInternalOperation);
-    if (mInternalOperation)
-        BOOST_LOG_SEV(log, modmqttd::Log::info) << "MODBUS: " << mNetworkName
-            << "." << it->second.mId << "." << regData.mRegister
-            << " READED: " << ret;
-
-    mInternalOperation = false;
-    return ret;
+    waitForResponse(lck, findOrCreateSlave(slaveId)->second.mReadTime);
+    return findOrCreateSlave(slaveId)->second.read(regType, firstRegister, count);
+}
+
+void
+MockedModbusContext::waitForResponse(std::unique_lock<std::mutex>& lock, std::chrono::milliseconds time) {
+    // all connections of a network share this context,
+    // other connections can use their slaves in the meantime
+    lock.unlock();
+    std::this_thread::sleep_for(time);
+    lock.lock();
 }
 
 void
@@ -153,14 +198,25 @@ MockedModbusContext::init(const modmqttd::ModbusNetworkConfig& config) {
 void
 MockedModbusContext::writeModbusRegister(const modmqttd::MsgRegisterValue& msg) {
     std::unique_lock<std::mutex> lck(mMutex);
-    std::map<int, Slave>::iterator it = findOrCreateSlave(msg.mSlaveId);
+    waitForResponse(lck, findOrCreateSlave(msg.mSlaveId)->second.mWriteTime);
+    findOrCreateSlave(msg.mSlaveId)->second.write(msg);
+}
 
-    if (mInternalOperation)
-        BOOST_LOG_SEV(log, modmqttd::Log::info) << "MODBUS: " << mNetworkName
-            << "." << it->second.mId << "." << msg.mRegisterNumber
-            << " WRITE: " << msg.mValue;
-    it->second.write(msg, mInternalOperation);
-    mInternalOperation = false;
+void
+MockedModbusContext::writeModbusRegisters(const modmqttd::MsgRegisterValues& msg) {
+    std::unique_lock<std::mutex> lck(mMutex);
+    waitForResponse(lck, findOrCreateSlave(msg.mSlaveId)->second.mWriteTime);
+    findOrCreateSlave(msg.mSlaveId)->second.write(msg);
+}
+
+void
+MockedModbusContext::setRegisterValue(const modmqttd::MsgRegisterValue& msg) {
+    std::unique_lock<std::mutex> lck(mMutex);
+    std::map<int, Slave>::iterator it = findOrCreateSlave(msg.mSlaveId);
+    BOOST_LOG_SEV(log, modmqttd::Log::info) << "MODBUS: " << mNetworkName
+        << "." << it->second.mId << "." << msg.mRegisterNumber
+        << " WRITE: " << msg.mValue;
+    it->second.write(msg, true);
 }
 
 std::map<int, MockedModbusContext::Slave>::iterator
@@ -181,6 +237,7 @@ MockedModbusContext::getSlave(int slaveId) {
 
 std::shared_ptr<MockedModbusContext>
 MockedModbusFactory::getOrCreateContext(const char* network) {
+    std::unique_lock<std::mutex> lck(mMutex);
     auto it = mModbusNetworks.find(network);
     std::shared_ptr<MockedModbusContext> ctx;
     if (it == mModbusNetworks.end()) {
@@ -199,8 +256,7 @@ void
 MockedModbusFactory::setModbusRegisterValue(const char* network, int slaveId, int regNum, modmqttd::RegisterType regtype, uint16_t val) {
     std::shared_ptr<MockedModbusContext> ctx = getOrCreateContext(network);
     modmqttd::MsgRegisterValue msg(slaveId, regtype, regNum, val);
-    ctx->mInternalOperation = true;
-    ctx->writeModbusRegister(msg);
+    ctx->setRegisterValue(msg);
 }
 
 void
@@ -212,9 +268,18 @@ MockedModbusFactory::setModbusRegisterReadError(const char* network, int slaveId
 
 
 void
-MockedModbusFactory::disconnectModbusSlave(const char* network, int slaveId) {
+MockedModbusFactory::disconnectModbusSlave(const char* network, int slaveId, bool flag) {
     std::shared_ptr<MockedModbusContext> ctx = getOrCreateContext(network);
-    ctx->getSlave(slaveId).setDisconnected();
+    ctx->getSlave(slaveId).setDisconnected(flag);
 }
 
+void
+MockedModbusFactory::disconnectModbusNetwork(const char* network) {
+    getOrCreateContext(network)->disconnect();
+}
 
+MockedModbusContext::Slave&
+MockedModbusFactory::getModbusSlave(const char* network, int slaveId) {
+    std::shared_ptr<MockedModbusContext> ctx = getOrCreateContext(network);
+    return ctx->getSlave(slaveId);
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #include <mutex>
 
+#include "libmodmqttsrv/config.hpp"
 #include "libmodmqttsrv/imodbuscontext.hpp"
 #include "libmodmqttsrv/modbus_types.hpp"
 #include "libmodmqttsrv/logging.hpp"
@@ -22,7 +23,9 @@ class MockedModbusContext : public modmqttd::IModbusContext {
             public:
                 Slave(int id = 0) : mId(id) {}
                 void write(const modmqttd::MsgRegisterValue& msg, bool internalOperation = false);
+                void write(const modmqttd::MsgRegisterValues& msg);
                 uint16_t read(const modmqttd::RegisterPoll& regData, bool internalOperation = false);
+                std::vector<uint16_t> read(modmqttd::RegisterType regType, int firstRegister, int count, bool internalOperation = false);
 
                 void setDisconnected(bool flag = true) { mDisconnected = flag; }
                 void setError(int regNum, modmqttd::RegisterType regType, bool flag = true);
@@ -37,10 +40,17 @@ class MockedModbusContext : public modmqttd::IModbusContext {
 
                 std::chrono::milliseconds mReadTime = sDefaultSlaveReadTime;
                 std::chrono::milliseconds mWriteTime = sDefaultSlaveWriteTime;
+                // number of modbus write requests
+                int mWriteCount = 0;
+                // first register of every modbus write request
+                std::vector<int> mWrittenRegisters;
+                // number of modbus read requests
+                int mReadCount = 0;
                 int mId;
 
             private:
                 bool hasError(const std::map<int, MockedModbusContext::Slave::RegData>& table, int num) const;
+                uint16_t readRegister(modmqttd::RegisterType regType, int num);
                 uint16_t readRegister(std::map<int, RegData>& table, int num);
                 bool mDisconnected = false;
         };
@@ -50,12 +60,15 @@ class MockedModbusContext : public modmqttd::IModbusContext {
         virtual bool isConnected() const { return mIsConnected; }
         virtual void disconnect() { mIsConnected = false; }
         virtual uint16_t readModbusRegister(int slaveId, const modmqttd::RegisterPoll& regData);
+        virtual std::vector<uint16_t> readModbusRegisters(int slaveId, modmqttd::RegisterType regType, int firstRegister, int count);
         virtual void writeModbusRegister(const modmqttd::MsgRegisterValue& msg);
+        virtual void writeModbusRegisters(const modmqttd::MsgRegisterValues& msg);
 
+        // sets register value without modbus request
+        void setRegisterValue(const modmqttd::MsgRegisterValue& msg);
         Slave& getSlave(int slaveId);
 
         bool mIsConnected = false;
-        bool mInternalOperation = false;
         std::string mNetworkName;
     private:
         boost::log::sources::severity_logger<modmqttd::Log::severity> log;
@@ -63,11 +76,16 @@ class MockedModbusContext : public modmqttd::IModbusContext {
         std::map<int, Slave> mSlaves;
 
         std::map<int, MockedModbusContext::Slave>::iterator findOrCreateSlave(int id);
+        // simulates request time without holding mMutex
+        void waitForResponse(std::unique_lock<std::mutex>& lock, std::chrono::milliseconds time);
 };
 
 class MockedModbusFactory : public modmqttd::IModbusFactory {
     public:
-        virtual std::shared_ptr<modmqttd::IModbusContext> getContext(const std::string& networkName) {
+        virtual std::shared_ptr<modmqttd::IModbusContext> getContext(const modmqttd::ModbusNetworkConfig& config) {
+            const std::string& networkName(config.mName);
+            // called from modbus threads, network can have more than one
+            std::unique_lock<std::mutex> lck(mMutex);
             auto it = mModbusNetworks.find(networkName);
             std::shared_ptr<MockedModbusContext> ctx;
             if (it == mModbusNetworks.end()) {
@@ -82,9 +100,13 @@ class MockedModbusFactory : public modmqttd::IModbusFactory {
 
         void setModbusRegisterValue(const char* network, int slaveId, int regNum, modmqttd::RegisterType regtype, uint16_t val);
         void setModbusRegisterReadError(const char* network, int slaveId, int regNum, modmqttd::RegisterType regtype);
-        void disconnectModbusSlave(const char* network, int slaveId);
+        void disconnectModbusSlave(const char* network, int slaveId, bool flag = true);
+        // modbus thread reconnects and does initial poll
+        void disconnectModbusNetwork(const char* network);
+        MockedModbusContext::Slave& getModbusSlave(const char* network, int slaveId);
     private:
         std::shared_ptr<MockedModbusContext> getOrCreateContext(const char* network);
+        std::mutex mMutex;
         std::map<std::string, std::shared_ptr<MockedModbusContext>> mModbusNetworks;
 };
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "mockedmqttimpl.hpp"
 #include "libmodmqttsrv/mqttclient.hpp"
 
@@ -27,22 +29,28 @@ MockedMqttImpl::stop() {
 }
 
 void
-MockedMqttImpl::subscribe(const char* topic) {
+MockedMqttImpl::subscribe(const char* topic, int qos) {
     std::unique_lock<std::mutex> lck(mMutex);
     mSubscriptions.insert(topic);
+    mSubscriptionQos[topic] = qos;
 }
 
 void
-MockedMqttImpl::publish(const char* topic, int len, const void* data) {
+MockedMqttImpl::publish(const char* topic, int len, const void* data, const modmqttd::MqttPublishProps& props) {
     std::unique_lock<std::mutex> lck(mMutex);
     MqttValue v(data, len);
     mTopics[topic] = v;
-    std::set<std::string>::const_iterator it = mSubscriptions.find(topic);
+    mPublishProps[topic] = props;
+    std::set<std::string>::const_iterator it = std::find_if(
+        mSubscriptions.begin(), mSubscriptions.end(),
+        [topic](const std::string& filter) -> bool { return modmqttd::MqttClient::topicMatches(filter.c_str(), topic); }
+    );
     if (it != mSubscriptions.end()) {
         mOwner->onMessage(topic, data, len);
     }
     BOOST_LOG_SEV(log, modmqttd::Log::info) << "PUBLISH " << topic << ": <" << v.val << ">";
     mPublishedTopics.insert(std::make_pair(topic, mPublishedTopics.size() + 1));
+    mPublishCount[topic]++;
     mCondition.notify_all();
 }
 
@@ -160,6 +168,15 @@ MockedMqttImpl::resetBroker() {
     disconnect();
 }
 
+int
+MockedMqttImpl::getPublishCount(const char* topic) {
+    std::unique_lock<std::mutex> lck(mMutex);
+    std::map<std::string, int>::const_iterator it = mPublishCount.find(topic);
+    if (it == mPublishCount.end())
+        return 0;
+    return it->second;
+}
+
 bool
 MockedMqttImpl::isTopicCreated(const char* topic) const {
     std::map<std::string, MqttValue>::const_iterator it = mTopics.find(topic);
@@ -179,3 +196,17 @@ MockedMqttImpl::mqttValue(const char* topic) {
     return val;
 }
 
+modmqttd::MqttPublishProps
+MockedMqttImpl::getPublishProps(const char* topic) {
+    std::unique_lock<std::mutex> lck(mMutex);
+    return mPublishProps[topic];
+}
+
+int
+MockedMqttImpl::getSubscriptionQos(const char* topic) {
+    std::unique_lock<std::mutex> lck(mMutex);
+    std::map<std::string, int>::const_iterator it = mSubscriptionQos.find(topic);
+    if (it == mSubscriptionQos.end())
+        return -1;
+    return it->second;
+}
@@ -50,8 +50,8 @@ class MockedMqttImpl : public modmqttd::IMqttImpl {
         virtual void disconnect();
         virtual void stop();
 
-        virtual void subscribe(const char* topic);
-        virtual void publish(const char* topic, int len, const void* data);
+        virtual void subscribe(const char* topic, int qos);
+        virtual void publish(const char* topic, int len, const void* data, const modmqttd::MqttPublishProps& props);
 
         virtual void on_disconnect(int rc);
         virtual void on_connect(int rc);
@@ -66,13 +66,22 @@ class MockedMqttImpl : public modmqttd::IMqttImpl {
         std::string waitForMqttValue(const char* topic, const char* expected, std::chrono::milliseconds timeout = std::chrono::seconds(1));
         //clear all topics and simulate broker disconnection
         void resetBroker();
+        //number of publish calls for topic
+        int getPublishCount(const char* topic);
+        //options of last publish on topic
+        modmqttd::MqttPublishProps getPublishProps(const char* topic);
+        //-1 if not subscribed
+        int getSubscriptionQos(const char* topic);
     private:
         modmqttd::MqttClient* mOwner;
         boost::log::sources::severity_logger<modmqttd::Log::severity> log;
 
         std::map<std::string, MqttValue> mTopics;
         std::set<std::string> mSubscriptions;
+        std::map<std::string, int> mSubscriptionQos;
+        std::map<std::string, modmqttd::MqttPublishProps> mPublishProps;
         std::map<std::string, int> mPublishedTopics;
+        std::map<std::string, int> mPublishCount;
 
         std::mutex mMutex;
         std::condition_variable mCondition;
@@ -87,7 +87,7 @@ class MockedModMqttServerThread : public ModMqttServerThread {
     }
 
     void publish(const char* topic, const std::string& value) {
-        mMqtt->publish(topic, value.length(), value.c_str());
+        mMqtt->publish(topic, value.length(), value.c_str(), modmqttd::MqttPublishProps());
     }
 
     void waitForMqttValue(const char* topic, const char* expected, std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
@@ -95,6 +95,10 @@ class MockedModMqttServerThread : public ModMqttServerThread {
         REQUIRE(current == expected);
     }
 
+    int getPublishCount(const char* topic) {
+        return mMqtt->getPublishCount(topic);
+    }
+
     std::string mqttValue(const char* topic) {
         bool has_topic = mMqtt->hasTopic(topic);
         REQUIRE(has_topic);
@@ -105,8 +109,12 @@ class MockedModMqttServerThread : public ModMqttServerThread {
         mModbusFactory->setModbusRegisterValue(network, slaveId, regNum, regtype, val);
     }
 
-    void disconnectModbusSlave(const char* network, int slaveId) {
-        mModbusFactory->disconnectModbusSlave(network, slaveId);
+    void disconnectModbusSlave(const char* network, int slaveId, bool flag = true) {
+        mModbusFactory->disconnectModbusSlave(network, slaveId, flag);
+    }
+
+    void disconnectModbusNetwork(const char* network) {
+        mModbusFactory->disconnectModbusNetwork(network);
     }
 
     void setModbusRegisterReadError(const char* network, int slaveId, int regNum, modmqttd::RegisterType regtype) {
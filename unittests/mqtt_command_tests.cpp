@@ -1,4 +1,5 @@
 #include "catch2/catch.hpp"
+#include "libmodmqttsrv/mqttclient.hpp"
 #include "mockedserver.hpp"
 #include "defaults.hpp"
 
@@ -112,3 +113,336 @@ TEST_CASE ("Holding register valid write to subpath topic") {
 
     server.stop();
 }
+
+static const std::string config_wildcard = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  command_subscriptions:
+    - switches/+/set
+  broker:
+    host: localhost
+  objects:
+    - topic: switches/first
+      commands:
+        - name: set
+          register: tcptest.1.1
+          register_type: holding
+      state:
+        register: tcptest.1.1
+        register_type: holding
+    - topic: switches/second
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+        - name: reset
+          register: tcptest.1.2
+          register_type: holding
+      state:
+        register: tcptest.1.2
+        register_type: holding
+)";
+
+TEST_CASE ("Commands should be received with wildcard subscription") {
+    MockedModMqttServerThread server(config_wildcard);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::HOLDING, 0);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 0);
+    server.start();
+
+    server.waitForPublish("switches/second/state", REGWAIT_MSEC);
+    CHECK(server.mMqtt->getSubscriptionQos("switches/+/set") == 0);
+    CHECK(server.mMqtt->getSubscriptionQos("switches/first/set") == -1);
+    // not covered by wildcard
+    CHECK(server.mMqtt->getSubscriptionQos("switches/second/reset") == 0);
+
+    server.publish("switches/second/set", "7");
+    server.waitForPublish("switches/second/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("switches/second/state") == "7");
+
+    server.publish("switches/second/reset", "3");
+    server.waitForPublish("switches/second/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("switches/second/state") == "3");
+
+    server.stop();
+}
+
+TEST_CASE ("Topic should match subscription filter") {
+    using modmqttd::MqttClient;
+    CHECK(MqttClient::topicMatches("a/b/set", "a/b/set"));
+    CHECK(!MqttClient::topicMatches("a/b/set", "a/b/se"));
+    CHECK(!MqttClient::topicMatches("a/b/se", "a/b/set"));
+    CHECK(MqttClient::topicMatches("a/+/set", "a/b/set"));
+    CHECK(!MqttClient::topicMatches("a/+/set", "a/b/c/set"));
+    CHECK(MqttClient::topicMatches("+/+/set", "a/b/set"));
+    CHECK(MqttClient::topicMatches("a/#", "a/b/c/set"));
+    CHECK(MqttClient::topicMatches("a/#", "a"));
+    CHECK(!MqttClient::topicMatches("a/#", "ab"));
+    CHECK(MqttClient::topicMatches("a/+", "a/"));
+    CHECK(!MqttClient::topicMatches("a/+", "a"));
+}
+
+// value written by multiple requests can be published more than once
+static void
+waitForState(MockedModMqttServerThread& server, const char* topic, const char* expected, std::chrono::milliseconds timeout = REGWAIT_MSEC) {
+    server.waitForPublish(topic, timeout);
+    if (server.mqttValue(topic) != expected)
+        server.waitForPublish(topic, timeout);
+    REQUIRE(server.mqttValue(topic) == expected);
+}
+
+TEST_CASE ("Queued writes to the same register should be collapsed") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 0);
+    MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 1));
+    slave.mWriteTime = std::chrono::milliseconds(100);
+    server.start();
+
+    server.waitForPublish("test_switch/state", REGWAIT_MSEC);
+
+    for(int i = 1; i <= 10; i++)
+        server.publish("test_switch/set", std::to_string(i));
+
+    waitForState(server, "test_switch/state", "10", std::chrono::milliseconds(1000));
+    server.stop();
+    // first write may be sent before others are queued
+    CHECK(slave.mWriteCount < 10);
+}
+
+static const std::string config_order = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  broker:
+    host: localhost
+  objects:
+    - topic: first
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+    - topic: second
+      commands:
+        - name: set
+          register: tcptest.1.3
+          register_type: holding
+    - topic: third
+      commands:
+        - name: set
+          register: tcptest.1.4
+          register_type: holding
+      state:
+        register: tcptest.1.4
+        register_type: holding
+)";
+
+TEST_CASE ("Collapsed write should be sent in order of arrival") {
+    MockedModMqttServerThread server(config_order);
+    server.setModbusRegisterValue("tcptest", 1, 4, modmqttd::RegisterType::HOLDING, 0);
+    MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 1));
+    slave.mWriteTime = std::chrono::milliseconds(100);
+    server.start();
+    server.waitForPublish("third/state", REGWAIT_MSEC);
+
+    // following commands are queued while this write is in progress
+    server.publish("third/set", "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    server.publish("first/set", "1");
+    server.publish("second/set", "1");
+    server.publish("first/set", "2");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    server.stop();
+    REQUIRE(slave.mWrittenRegisters == std::vector<int>({4, 3, 2}));
+    CHECK(slave.mHolding[2].mValue == 2);
+}
+
+static const std::string config_multi = R"(
+modmqttd:
+  converter_search_path:
+    - build/stdconv
+  converter_plugins:
+    - stdconv.so
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  broker:
+    host: localhost
+  objects:
+    - topic: test_pair
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+          count: 2
+      state:
+        converter: std.int32()
+        registers:
+          - register: tcptest.1.2
+            register_type: holding
+          - register: tcptest.1.3
+            register_type: holding
+)";
+
+TEST_CASE ("Multiple registers should be written with single request") {
+    MockedModMqttServerThread server(config_multi);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 0);
+    server.setModbusRegisterValue("tcptest", 1, 3, modmqttd::RegisterType::HOLDING, 0);
+    server.start();
+
+    server.waitForPublish("test_pair/state", REGWAIT_MSEC);
+    MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 1));
+
+    SECTION ("from list of values") {
+        server.publish("test_pair/set", "[2, 1]");
+        //2^17 + 1
+        waitForState(server, "test_pair/state", "131073");
+    }
+
+    SECTION ("from integer split into registers") {
+        server.publish("test_pair/set", "-2");
+        waitForState(server, "test_pair/state", "-2");
+    }
+
+    SECTION ("with invalid number of values") {
+        server.publish("test_pair/set", "[1,2,3]");
+        server.publish("test_pair/set", "65536");
+        waitForState(server, "test_pair/state", "65536");
+    }
+
+    server.stop();
+    CHECK(slave.mWriteCount == 1);
+}
+
+static const std::string config_read_back = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+      read_after_write: true
+mqtt:
+  client_id: mqtt_test
+  refresh: 10s
+  broker:
+    host: localhost
+  objects:
+    - topic: test_switch
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+      state:
+        register: tcptest.1.2
+        register_type: holding
+)";
+
+TEST_CASE ("Written register should be read back if read_after_write is set") {
+    MockedModMqttServerThread server(config_read_back);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 0);
+    MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 1));
+    server.start();
+
+    server.waitForPublish("test_switch/state", REGWAIT_MSEC);
+    server.publish("test_switch/set", "32");
+    server.waitForPublish("test_switch/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("test_switch/state") == "32");
+
+    server.stop();
+    // initial poll and read after write
+    CHECK(slave.mReadCount == 2);
+}
+
+// test_switch and ten state registers polled with separate requests
+static std::string
+longPollConfig(const char* refresh) {
+    std::string ret = std::string(R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: )") + refresh + R"(
+  broker:
+    host: localhost
+  objects:
+    - topic: test_switch
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+      state:
+        register: tcptest.1.2
+        register_type: holding
+)";
+    for(int i = 1; i <= 10; i++) {
+        ret += "    - topic: value" + std::to_string(i) + "\n"
+               "      state:\n"
+               "        register: tcptest.1." + std::to_string(i * 10) + "\n"
+               "        register_type: input\n";
+    }
+    return ret;
+}
+
+// waits for mocked slave request counter
+static bool
+waitForCount(const int& counter, int count, std::chrono::milliseconds timeout) {
+    auto end = std::chrono::steady_clock::now() + timeout;
+    while(counter < count) {
+        if (std::chrono::steady_clock::now() > end)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+TEST_CASE ("Write should be sent before remaining registers of long poll") {
+    static const int pollRequests = 11;
+    MockedModbusContext::Slave* slave = nullptr;
+    std::unique_ptr<MockedModMqttServerThread> server;
+
+    SECTION ("during initial poll") {
+        server.reset(new MockedModMqttServerThread(longPollConfig("10s")));
+        slave = &server->mModbusFactory->getModbusSlave("tcptest", 1);
+        // whole poll takes 1.1s
+        slave->mReadTime = std::chrono::milliseconds(100);
+        server->start();
+        // initial poll state is published after all registers are read
+        REQUIRE(waitForCount(slave->mReadCount, 1, std::chrono::milliseconds(1000)));
+    }
+
+    SECTION ("during refresh") {
+        server.reset(new MockedModMqttServerThread(longPollConfig("1500ms")));
+        slave = &server->mModbusFactory->getModbusSlave("tcptest", 1);
+        slave->mReadTime = std::chrono::milliseconds(100);
+        server->start();
+        server->waitForPublish("value10/state", std::chrono::milliseconds(2000));
+        int initialReads = slave->mReadCount;
+        REQUIRE(initialReads >= pollRequests);
+        // wait for next poll
+        REQUIRE(waitForCount(slave->mReadCount, initialReads + 1, std::chrono::milliseconds(2000)));
+    }
+
+    int readsBefore = slave->mReadCount;
+    server->publish("test_switch/set", "7");
+    // only read in progress can delay the write,
+    // remaining poll requests take another 900ms
+    REQUIRE(waitForCount(slave->mWriteCount, 1, std::chrono::milliseconds(400)));
+    CHECK(slave->mReadCount - readsBefore <= 2);
+
+    server->stop();
+}
@@ -0,0 +1,63 @@
+#include "catch2/catch.hpp"
+
+#include "mockedserver.hpp"
+
+static const std::string config = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 50ms
+  qos: 1
+  broker:
+    host: localhost
+  objects:
+    - topic: test_switch
+      retain: false
+      message_expiry: 1500ms
+      state:
+        register: tcptest.1.1
+        register_type: coil
+      commands:
+        - name: set
+          register: tcptest.1.1
+          register_type: coil
+        - name: reset
+          qos: 2
+          register: tcptest.1.1
+          register_type: coil
+    - topic: test_sensor
+      qos: 0
+      state:
+        register: tcptest.1.2
+        register_type: holding
+)";
+
+TEST_CASE ("Publish options should be read from mqtt and object config") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::COIL, true);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 7);
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    server.start();
+
+    server.waitForPublish("test_switch/state");
+    modmqttd::MqttPublishProps props(server.mMqtt->getPublishProps("test_switch/state"));
+    CHECK(props.mQos == 1);
+    CHECK(!props.mRetain);
+    CHECK(props.mMessageExpirySec == 2);
+    CHECK(props.mPollTime >= start);
+
+    server.waitForPublish("test_sensor/state");
+    props = server.mMqtt->getPublishProps("test_sensor/state");
+    CHECK(props.mQos == 0);
+    CHECK(props.mRetain);
+    CHECK(props.mMessageExpirySec == 0);
+
+    CHECK(server.mMqtt->getSubscriptionQos("test_switch/set") == 1);
+    CHECK(server.mMqtt->getSubscriptionQos("test_switch/reset") == 2);
+
+    server.stop();
+}
@@ -0,0 +1,137 @@
+#include <mutex>
+#include <condition_variable>
+
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/mqtt_publisher.hpp"
+
+/**
+ * Records published messages, publish can be blocked
+ * to simulate slow broker
+ * */
+class RecordingMqttImpl : public modmqttd::IMqttImpl {
+    public:
+        virtual void init(modmqttd::MqttClient*, const char*) {}
+        virtual void connect(const modmqttd::MqttBrokerConfig&) {}
+        virtual void reconnect() {}
+        virtual void disconnect() {}
+        virtual void stop() {}
+        virtual void subscribe(const char*, int) {}
+        virtual void on_disconnect(int) {}
+        virtual void on_connect(int) {}
+        virtual void on_log(int, const char*) {}
+
+        virtual void publish(const char* topic, int len, const void* data, const modmqttd::MqttPublishProps&) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mInPublish = true;
+            mChanged.notify_all();
+            while(mBlocked)
+                mChanged.wait(lock);
+            mPublished.push_back(std::string(topic) + "=" + std::string((const char*)data, len));
+            mInPublish = false;
+        }
+
+        void setBlocked(bool blocked) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mBlocked = blocked;
+            mChanged.notify_all();
+        }
+
+        void waitForPublishCall() {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while(!mInPublish)
+                mChanged.wait(lock);
+        }
+
+        std::vector<std::string> getPublished() {
+            std::unique_lock<std::mutex> lock(mMutex);
+            return mPublished;
+        }
+    private:
+        std::mutex mMutex;
+        std::condition_variable mChanged;
+        bool mBlocked = false;
+        bool mInPublish = false;
+        std::vector<std::string> mPublished;
+};
+
+static void
+publish(modmqttd::MqttPublisher& publisher, const char* topic, const std::string& value) {
+    publisher.publish(topic, value.c_str(), value.length());
+}
+
+TEST_CASE ("Mqtt publisher should send committed messages in order") {
+    std::shared_ptr<RecordingMqttImpl> impl(new RecordingMqttImpl());
+    modmqttd::MqttPublisher publisher;
+    publisher.start(impl);
+    publisher.setConnected(true);
+
+    publish(publisher, "a", "1");
+    publish(publisher, "b", "2");
+    publisher.flush();
+
+    std::vector<std::string> published(impl->getPublished());
+    REQUIRE(published.size() == 2);
+    CHECK(published[0] == "a=1");
+    CHECK(published[1] == "b=2");
+
+    SECTION ("last value of topic in a batch should be sent") {
+        publish(publisher, "a", "3");
+        publish(publisher, "a", "4");
+        publisher.flush();
+
+        published = impl->getPublished();
+        REQUIRE(published.size() == 3);
+        CHECK(published[2] == "a=4");
+        CHECK(publisher.getSupersededCount() == 1);
+    }
+
+    SECTION ("value queued behind slow broker should be replaced") {
+        impl->setBlocked(true);
+        publish(publisher, "c", "1");
+        publisher.commit();
+        impl->waitForPublishCall();
+
+        publish(publisher, "a", "5");
+        publish(publisher, "b", "6");
+        publisher.commit();
+        publish(publisher, "a", "7");
+        publisher.commit();
+        impl->setBlocked(false);
+        publisher.flush();
+
+        published = impl->getPublished();
+        REQUIRE(published.size() == 5);
+        CHECK(published[2] == "c=1");
+        CHECK(published[3] == "a=7");
+        CHECK(published[4] == "b=6");
+        CHECK(publisher.getSupersededCount() == 1);
+    }
+
+    SECTION ("stop should send uncommitted messages") {
+        publish(publisher, "d", "8");
+        publisher.stop();
+        published = impl->getPublished();
+        REQUIRE(published.size() == 3);
+        CHECK(published[2] == "d=8");
+    }
+
+    SECTION ("last value should be kept while disconnected and sent on reconnect") {
+        publisher.setConnected(false);
+        publish(publisher, "a", "9");
+        publisher.commit();
+        publish(publisher, "a", "10");
+        publish(publisher, "c", "11");
+        publisher.flush();
+        CHECK(impl->getPublished().size() == 2);
+
+        publisher.setConnected(true);
+        publisher.flush();
+        published = impl->getPublished();
+        REQUIRE(published.size() == 5);
+        // topics changed when offline are sent first
+        CHECK(published[2] == "a=10");
+        CHECK(published[3] == "c=11");
+        CHECK(published[4] == "b=2");
+        CHECK(publisher.getSupersededCount() == 1);
+    }
+}
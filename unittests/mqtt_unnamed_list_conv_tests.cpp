@@ -45,3 +45,49 @@ TEST_CASE ("Unnamed state list should output converted value") {
     REQUIRE(server.mqttValue("test_state/state") == "65537");
     server.stop();
 }
+
+static const std::string config_batch = R"(
+modmqttd:
+  converter_search_path:
+    - build/stdconv
+  converter_plugins:
+    - stdconv.so
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 1s
+  broker:
+    host: localhost
+  objects:
+    - topic: test_state
+      state:
+        - register: tcptest.1.2
+          register_type: input
+          converter: std.divide(10)
+        - register: tcptest.1.3
+          register_type: input
+          converter: std.divide(10)
+        - register: tcptest.1.4
+          register_type: input
+        - register: tcptest.1.5
+          register_type: input
+          converter: std.bitmask(0xf)
+)";
+
+TEST_CASE ("Unnamed state list should output values converted per register") {
+    MockedModMqttServerThread server(config_batch);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 15);
+    server.setModbusRegisterValue("tcptest", 1, 3, modmqttd::RegisterType::INPUT, 20);
+    server.setModbusRegisterValue("tcptest", 1, 4, modmqttd::RegisterType::INPUT, 7);
+    server.setModbusRegisterValue("tcptest", 1, 5, modmqttd::RegisterType::INPUT, 0x1f);
+    server.start();
+
+    server.waitForPublish("test_state/state", REGWAIT_MSEC);
+
+    REQUIRE_JSON(server.mqttValue("test_state/state"), "[1.5, 2.0, 7, 15]");
+    server.stop();
+}
@@ -0,0 +1,70 @@
+#include <string>
+#include <utility>
+
+#include "catch2/catch.hpp"
+#include "libmodmqttconv/mqttvalue.hpp"
+
+static std::string
+toChars(const MqttValue& value) {
+    char buf[MqttValue::MaxCharsLength];
+    char* end = value.toChars(buf, buf + sizeof(buf));
+    REQUIRE(end != nullptr);
+    return std::string(buf, end);
+}
+
+TEST_CASE ("MqttValue should format numbers without trailing zeros") {
+    CHECK(MqttValue::fromInt(-123).getString() == "-123");
+    CHECK(MqttValue::fromDouble(700).getString() == "700");
+    CHECK(MqttValue::fromDouble(0).getString() == "0");
+    CHECK(MqttValue::fromDouble(-2.5).getString() == "-2.5");
+    CHECK(MqttValue::fromDouble(1.0/3).getString() == "0.333333");
+    CHECK(MqttValue::fromDouble(0.0000004).getString() == "0");
+
+    CHECK(toChars(MqttValue::fromInt(42)) == "42");
+    CHECK(toChars(MqttValue::fromDouble(12.125)) == "12.125");
+
+    char small[2];
+    CHECK(MqttValue::fromInt(123).toChars(small, small + sizeof(small)) == nullptr);
+}
+
+TEST_CASE ("MqttValue should store strings") {
+    std::string shortText("on");
+    std::string longText(MqttValue::SmallBufferSize * 2, 'x');
+
+    SECTION ("string should set binary type and size") {
+        MqttValue value;
+        value.setString("12.5");
+        CHECK(value.getSourceType() == MqttValue::SourceType::BINARY);
+        CHECK(value.getBinarySize() == 4);
+        CHECK(value.getDouble() == 12.5);
+        CHECK(value.getInt() == 12);
+    }
+
+    SECTION ("inline and allocated values should be copied") {
+        for (const std::string& text: { shortText, longText }) {
+            MqttValue value(MqttValue::fromBinary(text.c_str(), text.length()));
+            MqttValue copy(value);
+            MqttValue assigned;
+            assigned = copy;
+            value.setInt(1);
+
+            CHECK(copy.getString() == text);
+            CHECK(assigned.getString() == text);
+            CHECK(toChars(assigned) == text);
+        }
+    }
+
+    SECTION ("moved value should take over allocated buffer") {
+        MqttValue value(MqttValue::fromBinary(longText.c_str(), longText.length()));
+        const void* data = value.getBinaryPtr();
+
+        MqttValue moved(std::move(value));
+        CHECK(moved.getBinaryPtr() == data);
+        CHECK(moved.getString() == longText);
+
+        MqttValue assigned(MqttValue::fromBinary(shortText.c_str(), shortText.length()));
+        assigned = std::move(moved);
+        CHECK(assigned.getBinaryPtr() == data);
+        CHECK(assigned.getString() == longText);
+    }
+}
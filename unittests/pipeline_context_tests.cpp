@@ -0,0 +1,223 @@
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/modbus_pipeline_context.hpp"
+#include "libmodmqttsrv/modbus_context.hpp"
+
+/**
+ * Minimal Modbus/TCP slave for a single client.
+ *
+ * Requests are answered in reverse order after mBatchSize
+ * requests are received or when client stops sending.
+ * Register value is slaveId * 1000 + register number,
+ * registers above 1000 return illegal data address exception.
+ * */
+class PipelineTestServer {
+    public:
+        PipelineTestServer(int batchSize) : mBatchSize(batchSize) {
+            mListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+            int flag = 1;
+            setsockopt(mListenSocket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+            struct sockaddr_in addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            bind(mListenSocket, (struct sockaddr*)&addr, sizeof(addr));
+            socklen_t len = sizeof(addr);
+            getsockname(mListenSocket, (struct sockaddr*)&addr, &len);
+            mPort = ntohs(addr.sin_port);
+            listen(mListenSocket, 1);
+            mThread = std::thread(&PipelineTestServer::run, this);
+        }
+
+        ~PipelineTestServer() {
+            mShouldRun = false;
+            mThread.join();
+            close(mListenSocket);
+        }
+
+        int mPort;
+        // max number of requests received before sending responses
+        std::atomic<int> mMaxPending {0};
+        std::atomic<int> mWrittenValue {-1};
+        // register count and last value of multiple register write
+        std::atomic<int> mWrittenCount {0};
+        std::atomic<int> mWrittenLastValue {-1};
+        // drop responses for this register to force timeout
+        std::atomic<int> mSilentRegister {-1};
+    private:
+        int mListenSocket;
+        int mBatchSize;
+        std::atomic<bool> mShouldRun {true};
+        std::thread mThread;
+
+        void run() {
+            int client = -1;
+            std::vector<uint8_t> buffer;
+            std::deque<std::vector<uint8_t>> pending;
+            while(mShouldRun) {
+                struct pollfd pfd = { client == -1 ? mListenSocket : client, POLLIN, 0 };
+                int ret = poll(&pfd, 1, 20);
+                if (ret == 1 && client == -1) {
+                    client = accept(mListenSocket, nullptr, nullptr);
+                    continue;
+                }
+                if (ret == 1) {
+                    uint8_t buf[256];
+                    ssize_t count = recv(client, buf, sizeof(buf), 0);
+                    if (count <= 0) {
+                        close(client);
+                        client = -1;
+                        buffer.clear();
+                        pending.clear();
+                        continue;
+                    }
+                    buffer.insert(buffer.end(), buf, buf + count);
+                    // frame length is in MBAP header
+                    while(buffer.size() >= 6 && buffer.size() >= std::size_t(6 + ((buffer[4] << 8) | buffer[5]))) {
+                        std::size_t length = 6 + ((buffer[4] << 8) | buffer[5]);
+                        pending.push_back(std::vector<uint8_t>(buffer.begin(), buffer.begin() + length));
+                        buffer.erase(buffer.begin(), buffer.begin() + length);
+                    }
+                    if (int(pending.size()) > mMaxPending)
+                        mMaxPending = pending.size();
+                }
+                if (!pending.empty() && (ret == 0 || int(pending.size()) >= mBatchSize)) {
+                    while(!pending.empty()) {
+                        std::vector<uint8_t> response(createResponse(pending.back()));
+                        if (!response.empty())
+                            send(client, response.data(), response.size(), MSG_NOSIGNAL);
+                        pending.pop_back();
+                    }
+                }
+            }
+            if (client != -1)
+                close(client);
+        }
+
+        std::vector<uint8_t> createResponse(const std::vector<uint8_t>& request) {
+            uint8_t unit = request[6];
+            uint8_t function = request[7];
+            int address = (request[8] << 8) | request[9];
+            int count = (request[10] << 8) | request[11];
+            if (address == mSilentRegister)
+                return std::vector<uint8_t>();
+
+            std::vector<uint8_t> pdu;
+            if (address + count > 1000) {
+                pdu.push_back(function | 0x80);
+                pdu.push_back(0x02);
+            } else if (function == 0x03 || function == 0x04) {
+                pdu.push_back(function);
+                pdu.push_back(count * 2);
+                for(int i = 0; i < count; i++) {
+                    uint16_t value = unit * 1000 + address + i;
+                    pdu.push_back(value >> 8);
+                    pdu.push_back(value & 0xFF);
+                }
+            } else if (function == 0x06) {
+                mWrittenValue = count;
+                pdu.insert(pdu.end(), request.begin() + 7, request.end());
+            } else if (function == 0x10) {
+                mWrittenCount = count;
+                mWrittenValue = (request[13] << 8) | request[14];
+                mWrittenLastValue = (request[11 + count * 2] << 8) | request[12 + count * 2];
+                pdu.insert(pdu.end(), request.begin() + 7, request.begin() + 12);
+            }
+
+            std::vector<uint8_t> response(request.begin(), request.begin() + 4);
+            response.push_back((pdu.size() + 1) >> 8);
+            response.push_back((pdu.size() + 1) & 0xFF);
+            response.push_back(unit);
+            response.insert(response.end(), pdu.begin(), pdu.end());
+            return response;
+        }
+};
+
+TEST_CASE ("Pipelined context should match responses by transaction id") {
+    PipelineTestServer server(4);
+
+    modmqttd::ModbusNetworkConfig config;
+    config.mType = modmqttd::ModbusNetworkConfig::TCPIP;
+    config.mName = "pipeline";
+    config.mAddress = "127.0.0.1";
+    config.mPort = server.mPort;
+    config.mPipelineDepth = 4;
+
+    modmqttd::ModbusPipelineContext ctx;
+    ctx.init(config);
+    ctx.connect();
+    REQUIRE(ctx.isConnected());
+    REQUIRE(ctx.getMaxPendingRequests() == 4);
+
+    SECTION ("all requests should be sent before responses arrive") {
+        std::vector<modmqttd::ModbusReadRequest> requests;
+        for(int i = 0; i < 8; i++)
+            requests.push_back(modmqttd::ModbusReadRequest(1 + i % 2, modmqttd::RegisterType::HOLDING, i * 10, 2));
+
+        ctx.readModbusRegisters(requests);
+
+        CHECK(server.mMaxPending == 4);
+        for(int i = 0; i < 8; i++) {
+            INFO("request " << i);
+            REQUIRE(requests[i].mError.empty());
+            REQUIRE(requests[i].mValues.size() == 2);
+            CHECK(requests[i].mValues[0] == (1 + i % 2) * 1000 + i * 10);
+            CHECK(requests[i].mValues[1] == (1 + i % 2) * 1000 + i * 10 + 1);
+        }
+    }
+
+    SECTION ("exception response should fail only its request") {
+        std::vector<modmqttd::ModbusReadRequest> requests;
+        requests.push_back(modmqttd::ModbusReadRequest(1, modmqttd::RegisterType::INPUT, 1, 1));
+        requests.push_back(modmqttd::ModbusReadRequest(1, modmqttd::RegisterType::INPUT, 2000, 1));
+        requests.push_back(modmqttd::ModbusReadRequest(1, modmqttd::RegisterType::INPUT, 3, 1));
+
+        ctx.readModbusRegisters(requests);
+
+        CHECK(requests[0].mError.empty());
+        CHECK(!requests[1].mError.empty());
+        CHECK(requests[2].mError.empty());
+        CHECK(requests[2].mValues[0] == 1003);
+        CHECK(ctx.isConnected());
+    }
+
+    SECTION ("request without response should time out") {
+        server.mSilentRegister = 5;
+        std::vector<modmqttd::ModbusReadRequest> requests;
+        requests.push_back(modmqttd::ModbusReadRequest(1, modmqttd::RegisterType::HOLDING, 5, 1));
+        requests.push_back(modmqttd::ModbusReadRequest(1, modmqttd::RegisterType::HOLDING, 6, 1));
+
+        ctx.readModbusRegisters(requests);
+
+        CHECK(!requests[0].mError.empty());
+        CHECK(requests[1].mError.empty());
+        CHECK(ctx.isConnected());
+        CHECK(ctx.readModbusRegisters(2, modmqttd::RegisterType::HOLDING, 7, 1)[0] == 2007);
+    }
+
+    SECTION ("single register write should be confirmed") {
+        modmqttd::MsgRegisterValue msg(1, modmqttd::RegisterType::HOLDING, 10, 42);
+        ctx.writeModbusRegister(msg);
+        CHECK(server.mWrittenValue == 42);
+    }
+
+    SECTION ("multiple registers should be written with a single request") {
+        modmqttd::MsgRegisterValues msg(1, modmqttd::RegisterType::HOLDING, 10, std::vector<uint16_t>({1, 2, 0x1234}));
+        ctx.writeModbusRegisters(msg);
+        CHECK(server.mWrittenCount == 3);
+        CHECK(server.mWrittenValue == 1);
+        CHECK(server.mWrittenLastValue == 0x1234);
+    }
+
+    ctx.disconnect();
+}
@@ -0,0 +1,109 @@
+#include "catch2/catch.hpp"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+#include "jsonutils.hpp"
+
+static const std::string config = R"(
+modmqttd:
+  converter_search_path:
+    - build/stdconv
+  converter_plugins:
+    - stdconv.so
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 100ms
+  broker:
+    host: localhost
+  objects:
+    - topic: raw
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: masked
+      state:
+        register: tcptest.1.1
+        register_type: input
+        converter: std.bitmask(0x00ff)
+)";
+
+TEST_CASE ("Unchanged state payload should not be published again") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 0x0107);
+    server.start();
+    server.waitForPublish("raw/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("raw/state") == "263");
+    server.waitForPublish("masked/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("masked/state") == "7");
+
+    // raw register value changes, but masked value stays the same
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 0x0207);
+    server.waitForPublish("raw/state", std::chrono::seconds(1));
+    REQUIRE(server.mqttValue("raw/state") == "519");
+    REQUIRE(server.getPublishCount("masked/state") == 1);
+    server.stop();
+}
+
+static const std::string config_threads = R"(
+modmqttd:
+  conversion_threads: 2
+  converter_search_path:
+    - build/stdconv
+  converter_plugins:
+    - stdconv.so
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 100ms
+  broker:
+    host: localhost
+  objects:
+    - topic: raw
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: masked
+      state:
+        register: tcptest.1.1
+        register_type: input
+        converter: std.bitmask(0x00ff)
+    - topic: divided
+      state:
+        - name: first
+          register: tcptest.1.1
+          register_type: input
+          converter: std.divide(10)
+        - name: second
+          register: tcptest.1.2
+          register_type: input
+)";
+
+TEST_CASE ("Changed objects should be published by conversion threads") {
+    MockedModMqttServerThread server(config_threads);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 0x0107);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 5);
+    server.start();
+    server.waitForPublish("raw/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("raw/state") == "263");
+    server.waitForPublish("masked/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("masked/state") == "7");
+    server.waitForPublish("divided/state", REGWAIT_MSEC);
+    REQUIRE_JSON(server.mqttValue("divided/state"), R"({"first": 26.3, "second": 5})");
+
+    // unchanged payloads are still filtered in conversion threads
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 0x0207);
+    server.waitForPublish("raw/state", std::chrono::seconds(1));
+    REQUIRE(server.mqttValue("raw/state") == "519");
+    server.waitForPublish("divided/state", std::chrono::seconds(1));
+    REQUIRE_JSON(server.mqttValue("divided/state"), R"({"first": 51.9, "second": 5})");
+    REQUIRE(server.getPublishCount("masked/state") == 1);
+    server.stop();
+}
@@ -0,0 +1,54 @@
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/queue_notifier.hpp"
+
+using modmqttd::QueueNotifier;
+
+class TestEntry : public QueueNotifier::Entry {
+    public:
+        TestEntry(int id) : mId(id) {}
+        int mId;
+};
+
+static std::vector<int>
+drain(QueueNotifier& notifier) {
+    std::vector<int> ret;
+    notifier.drainReady([&ret](QueueNotifier::Entry& entry) {
+        ret.push_back(static_cast<TestEntry&>(entry).mId);
+    });
+    return ret;
+}
+
+TEST_CASE ("Queue notifier should return ready entries once in notification order") {
+    QueueNotifier notifier;
+    TestEntry first(1), second(2);
+
+    CHECK(!notifier.wait(std::chrono::steady_clock::now() + std::chrono::milliseconds(5)));
+
+    notifier.notify(second);
+    notifier.notify(first);
+    notifier.notify(second);
+    CHECK(notifier.wait(std::chrono::steady_clock::now()));
+    CHECK(drain(notifier) == std::vector<int>({ 2, 1 }));
+    CHECK(drain(notifier).empty());
+
+    SECTION ("entry notified while drained should be ready again") {
+        notifier.notify(first);
+        notifier.drainReady([&](QueueNotifier::Entry& entry) {
+            notifier.notify(entry);
+        });
+        CHECK(drain(notifier) == std::vector<int>({ 1 }));
+    }
+
+    SECTION ("notification from other thread should wake up waiting thread") {
+        std::thread producer([&notifier, &first]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            notifier.notify(first);
+        });
+        CHECK(notifier.wait(std::chrono::steady_clock::now() + std::chrono::seconds(5)));
+        producer.join();
+        CHECK(drain(notifier) == std::vector<int>({ 1 }));
+    }
+}
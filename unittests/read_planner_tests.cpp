@@ -0,0 +1,97 @@
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/modbus_read_planner.hpp"
+
+typedef std::vector<std::shared_ptr<modmqttd::RegisterPoll>> RegisterList;
+
+static void addRegister(RegisterList& list, int regNum, modmqttd::RegisterType regType, int slaveId = 1) {
+    list.push_back(std::shared_ptr<modmqttd::RegisterPoll>(new modmqttd::RegisterPoll(slaveId, regNum, regType, 1000)));
+}
+
+TEST_CASE( "Read planner basic tests" ) {
+    modmqttd::ModbusReadPlanner planner;
+    RegisterList source;
+
+    SECTION ("No registers should return empty list of blocks") {
+        REQUIRE(planner.planReads(source).size() == 0);
+    }
+
+    SECTION ("Adjacent registers should be read in one block") {
+        addRegister(source, 1, modmqttd::RegisterType::HOLDING);
+        addRegister(source, 2, modmqttd::RegisterType::HOLDING);
+        addRegister(source, 3, modmqttd::RegisterType::HOLDING);
+
+        std::vector<modmqttd::RegisterReadBlock> blocks(planner.planReads(source));
+        REQUIRE(blocks.size() == 1);
+        CHECK(blocks[0].mFirstRegister == 1);
+        CHECK(blocks[0].mCount == 3);
+        CHECK(blocks[0].mEnd - blocks[0].mBegin == 3);
+    }
+
+    SECTION ("Registers with a gap should be split without max gap set") {
+        addRegister(source, 1, modmqttd::RegisterType::INPUT);
+        addRegister(source, 3, modmqttd::RegisterType::INPUT);
+
+        std::vector<modmqttd::RegisterReadBlock> blocks(planner.planReads(source));
+        REQUIRE(blocks.size() == 2);
+        CHECK(blocks[1].mFirstRegister == 3);
+        CHECK(blocks[1].mCount == 1);
+    }
+
+    SECTION ("Registers from different slaves should be read in separate blocks") {
+        addRegister(source, 1, modmqttd::RegisterType::HOLDING, 1);
+        addRegister(source, 2, modmqttd::RegisterType::HOLDING, 1);
+        addRegister(source, 3, modmqttd::RegisterType::HOLDING, 2);
+
+        std::vector<modmqttd::RegisterReadBlock> blocks(planner.planReads(source));
+        REQUIRE(blocks.size() == 2);
+        CHECK(blocks[0].mSlaveId == 1);
+        CHECK(blocks[0].mCount == 2);
+        CHECK(blocks[1].mSlaveId == 2);
+        CHECK(blocks[1].mFirstRegister == 3);
+    }
+
+    SECTION ("Different register types should be read in separate blocks") {
+        addRegister(source, 1, modmqttd::RegisterType::COIL);
+        addRegister(source, 2, modmqttd::RegisterType::HOLDING);
+
+        REQUIRE(planner.planReads(source).size() == 2);
+    }
+}
+
+TEST_CASE( "Read planner gap and limit tests" ) {
+    RegisterList source;
+
+    SECTION ("Registers within max gap should be read in one block") {
+        modmqttd::ModbusReadPlanner planner(2);
+        addRegister(source, 10, modmqttd::RegisterType::HOLDING);
+        addRegister(source, 13, modmqttd::RegisterType::HOLDING);
+        addRegister(source, 17, modmqttd::RegisterType::HOLDING);
+
+        std::vector<modmqttd::RegisterReadBlock> blocks(planner.planReads(source));
+        REQUIRE(blocks.size() == 2);
+        CHECK(blocks[0].mFirstRegister == 10);
+        CHECK(blocks[0].mCount == 4);
+        CHECK(blocks[0].mEnd - blocks[0].mBegin == 2);
+        CHECK(blocks[1].mFirstRegister == 17);
+    }
+
+    SECTION ("Block of registers should not exceed protocol limit") {
+        modmqttd::ModbusReadPlanner planner;
+        for(int i = 0; i < 130; i++)
+            addRegister(source, i, modmqttd::RegisterType::INPUT);
+
+        std::vector<modmqttd::RegisterReadBlock> blocks(planner.planReads(source));
+        REQUIRE(blocks.size() == 2);
+        CHECK(blocks[0].mCount == modmqttd::ModbusReadPlanner::MaxReadRegisters);
+        CHECK(blocks[1].mFirstRegister == modmqttd::ModbusReadPlanner::MaxReadRegisters);
+        CHECK(blocks[1].mCount == 5);
+    }
+
+    SECTION ("Block of coils should use bit read limit") {
+        modmqttd::ModbusReadPlanner planner;
+        for(int i = 0; i < 130; i++)
+            addRegister(source, i, modmqttd::RegisterType::COIL);
+
+        REQUIRE(planner.planReads(source).size() == 1);
+    }
+}
@@ -34,9 +34,8 @@ mqtt:
 TEST_CASE ("Start and stop real server that cannot connect to anything") {
     ModMqttServerThread server(config);
     server.start();
-    // we need to sleep to let mqtt server to start waiting on gHasMessagesCondition
-    // in mqtt initial connection loop
-    // otherwise stop signal is missed and test will last for 5 seconds
+    // let mqtt server to enter initial connection loop
+    // before stop request is sent
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
     server.stop();
 }
@@ -0,0 +1,24 @@
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/mqttobject.hpp"
+
+TEST_CASE ("Register ident should unpack values from key") {
+    modmqttd::MqttObjectRegisterIdent ident(3, 247, modmqttd::RegisterType::INPUT, 65535);
+
+    CHECK(ident.getNetworkId() == 3);
+    CHECK(ident.getSlaveId() == 247);
+    CHECK(ident.getRegisterType() == modmqttd::RegisterType::INPUT);
+    CHECK(ident.getRegisterNumber() == 65535);
+}
+
+TEST_CASE ("Register idents should be ordered by network, slave, number and type") {
+    modmqttd::MqttObjectRegisterIdent::Compare less;
+
+    modmqttd::MqttObjectRegisterIdent first(0, 2, modmqttd::RegisterType::INPUT, 1);
+    modmqttd::MqttObjectRegisterIdent second(0, 2, modmqttd::RegisterType::COIL, 2);
+    modmqttd::MqttObjectRegisterIdent third(1, 1, modmqttd::RegisterType::COIL, 1);
+
+    CHECK(less(first, second));
+    CHECK(less(second, third));
+    CHECK(!less(third, first));
+    CHECK(first == modmqttd::MqttObjectRegisterIdent(0, 2, modmqttd::RegisterType::INPUT, 1));
+}
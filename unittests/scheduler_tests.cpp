@@ -2,16 +2,21 @@
 #include "libmodmqttsrv/modbus_scheduler.hpp"
 #include <iostream>
 
-typedef std::map<int, std::vector<std::shared_ptr<modmqttd::RegisterPoll>>> RegisterSpec;
+typedef std::vector<std::shared_ptr<modmqttd::RegisterPoll>> RegisterList;
+
+static std::shared_ptr<modmqttd::RegisterPoll> createRegister(int slaveId, int regNum, int refreshMsec) {
+    return std::shared_ptr<modmqttd::RegisterPoll>(new modmqttd::RegisterPoll(slaveId, regNum, modmqttd::RegisterType::BIT, refreshMsec));
+}
 
 TEST_CASE( "Modbus scheduler basic tests" ) {
     modmqttd::ModbusScheduler scheduler;
-    std::chrono::nanoseconds duration = std::chrono::seconds(1000);
     std::chrono::time_point<std::chrono::steady_clock> timePoint;
 
     SECTION ("No registers should return empty list to poll") {
-        RegisterSpec source;
-        REQUIRE(scheduler.getRegistersToPoll(source, duration, timePoint).size() == 0);
+        RegisterList poll;
+        scheduler.getRegistersToPoll(poll, timePoint);
+        REQUIRE(poll.size() == 0);
+        REQUIRE(scheduler.getWaitDuration(timePoint) == std::chrono::steady_clock::duration::max());
     }
 }
 
@@ -19,28 +24,104 @@ TEST_CASE( "Modbus scheduler single register tests" ) {
     modmqttd::ModbusScheduler scheduler;
     std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
 
-    RegisterSpec source;
-    std::shared_ptr<modmqttd::RegisterPoll> reg(new modmqttd::RegisterPoll(1, modmqttd::RegisterType::BIT, 1000));
-    reg->mRefresh = std::chrono::milliseconds(1000);
-    source[0].push_back(reg);
-
-    std::chrono::nanoseconds duration = std::chrono::seconds(1000);
+    std::shared_ptr<modmqttd::RegisterPoll> reg(createRegister(1, 1, 1000));
+    RegisterList poll;
 
     SECTION ("poll register now and wait 1sec for next poll") {
         reg->mLastRead = now - std::chrono::milliseconds(1000);
-        RegisterSpec poll = scheduler.getRegistersToPoll(source, duration, now);
-
-        CHECK(duration == std::chrono::milliseconds(1000));
+        scheduler.addRegister(reg);
+        scheduler.getRegistersToPoll(poll, now);
         REQUIRE(poll.size() == 1);
+
+        reg->mLastRead = now;
+        scheduler.reschedule(poll);
+        CHECK(poll.size() == 0);
+        CHECK(scheduler.getWaitDuration(now) == std::chrono::milliseconds(1000));
     }
 
     SECTION ("wait 800ms to poll register") {
         reg->mLastRead = now - std::chrono::milliseconds(200);
-        RegisterSpec poll = scheduler.getRegistersToPoll(source, duration, now);
+        scheduler.addRegister(reg);
+        scheduler.getRegistersToPoll(poll, now);
+
+        REQUIRE(poll.size() == 0);
+        CHECK(scheduler.getWaitDuration(now) == std::chrono::milliseconds(800));
+    }
+
+    SECTION ("failed read should be retried after refresh period") {
+        reg->mLastRead = now - std::chrono::milliseconds(5000);
+        scheduler.addRegister(reg);
+        scheduler.getRegistersToPoll(poll, now);
+        REQUIRE(poll.size() == 1);
+
+        //mLastRead is not updated on read error
+        reg->mLastReadError = now;
+        scheduler.reschedule(poll);
+        CHECK(scheduler.getWaitDuration(now) == std::chrono::milliseconds(1000));
+        scheduler.getRegistersToPoll(poll, now + std::chrono::milliseconds(999));
+        CHECK(poll.size() == 0);
+        scheduler.getRegistersToPoll(poll, now + std::chrono::milliseconds(1000));
+        REQUIRE(poll.size() == 1);
+    }
+
+    SECTION ("register refreshed after scheduling should be postponed") {
+        reg->mLastRead = now - std::chrono::milliseconds(1000);
+        scheduler.addRegister(reg);
+
+        //register was written and state published
+        reg->mLastRead = now - std::chrono::milliseconds(100);
+        scheduler.getRegistersToPoll(poll, now);
 
-        CHECK(duration == std::chrono::milliseconds(800));
         REQUIRE(poll.size() == 0);
-        std::cerr << "dur: " << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << std::endl;
+        CHECK(scheduler.getWaitDuration(now) == std::chrono::milliseconds(900));
+    }
+}
+
+TEST_CASE( "Modbus scheduler multiple registers tests" ) {
+    modmqttd::ModbusScheduler scheduler;
+    std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+
+    std::shared_ptr<modmqttd::RegisterPoll> fast(createRegister(2, 10, 100));
+    std::shared_ptr<modmqttd::RegisterPoll> slow(createRegister(1, 20, 1000));
+    std::shared_ptr<modmqttd::RegisterPoll> other(createRegister(1, 5, 500));
+    fast->mLastRead = now - std::chrono::milliseconds(100);
+    slow->mLastRead = now - std::chrono::milliseconds(1000);
+    other->mLastRead = now - std::chrono::milliseconds(200);
+    scheduler.addRegister(fast);
+    scheduler.addRegister(slow);
+    scheduler.addRegister(other);
+
+    RegisterList poll;
+
+    SECTION ("only due registers should be returned, sorted by slave and number") {
+        scheduler.getRegistersToPoll(poll, now);
+        REQUIRE(poll.size() == 2);
+        CHECK(poll[0] == slow);
+        CHECK(poll[1] == fast);
+    }
+
+    SECTION ("wait duration should be set by nearest register") {
+        scheduler.getRegistersToPoll(poll, now);
+        for(auto& reg: poll)
+            reg->mLastRead = now;
+        scheduler.reschedule(poll);
+
+        CHECK(scheduler.getWaitDuration(now) == std::chrono::milliseconds(100));
+
+        //fast register is polled again, slow is not
+        scheduler.getRegistersToPoll(poll, now + std::chrono::milliseconds(100));
+        REQUIRE(poll.size() == 1);
+        CHECK(poll[0] == fast);
     }
 
+    SECTION ("poll list should be reused between calls") {
+        poll.reserve(16);
+        auto capacity = poll.capacity();
+        scheduler.getRegistersToPoll(poll, now);
+        scheduler.reschedule(poll);
+        scheduler.getRegistersToPoll(poll, now + std::chrono::milliseconds(1000));
+
+        CHECK(poll.size() == 3);
+        CHECK(poll.capacity() == capacity);
+    }
 }
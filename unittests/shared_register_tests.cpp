@@ -0,0 +1,60 @@
+#include "catch2/catch.hpp"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+#include "jsonutils.hpp"
+
+static const std::string config = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 1s
+  broker:
+    host: localhost
+  objects:
+    - topic: one
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: two
+      state:
+        - name: first
+          register: tcptest.1.1
+          register_type: input
+        - name: second
+          register: tcptest.1.2
+          register_type: input
+    - topic: three
+      state:
+        register: tcptest.1.2
+        register_type: input
+      availability:
+        register: tcptest.1.1
+        register_type: input
+        available_value: 7
+)";
+
+    TEST_CASE ("register used in many objects should update all of them") {
+        MockedModMqttServerThread server(config);
+        server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 7);
+        server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::INPUT, 13);
+        server.start();
+        server.waitForPublish("one/state", REGWAIT_MSEC);
+        REQUIRE(server.mqttValue("one/state") == "7");
+        server.waitForPublish("two/state", REGWAIT_MSEC);
+        REQUIRE_JSON(server.mqttValue("two/state"), "{\"first\": 7, \"second\": 13}");
+        server.waitForPublish("three/availability", REGWAIT_MSEC);
+        REQUIRE(server.mqttValue("three/availability") == "1");
+
+        server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 8);
+        server.waitForPublish("one/state", std::chrono::seconds(2));
+        REQUIRE(server.mqttValue("one/state") == "8");
+        server.waitForPublish("two/state", REGWAIT_MSEC);
+        REQUIRE_JSON(server.mqttValue("two/state"), "{\"first\": 8, \"second\": 13}");
+        server.waitForPublish("three/availability", REGWAIT_MSEC);
+        REQUIRE(server.mqttValue("three/availability") == "0");
+        server.stop();
+    }
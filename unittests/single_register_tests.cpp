@@ -102,6 +102,18 @@ mqtt:
         server.stop();
     }
 
+    TEST_CASE ("Register with read error should not be read again before refresh period") {
+        MockedModMqttServerThread server(config);
+        server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::BIT, true);
+        server.setModbusRegisterReadError("tcptest", 1, 1, modmqttd::RegisterType::COIL);
+        MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 1));
+        server.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        server.stop();
+        // initial poll and single refresh of both registers
+        CHECK(slave.mReadCount <= 4);
+    }
+
     TEST_CASE ("If broker is restarted all mqtt objects should be republished") {
         MockedModMqttServerThread server(config);
         server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::BIT, true);
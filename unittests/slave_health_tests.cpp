@@ -0,0 +1,100 @@
+#include "catch2/catch.hpp"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+#include "libmodmqttsrv/modbus_slave_health.hpp"
+
+TEST_CASE ("Slave health should back off probes of dead slave") {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    modmqttd::ModbusSlaveHealth health;
+
+    CHECK(!health.pollTimedOut(now));
+    CHECK(!health.pollTimedOut(now));
+    CHECK(health.isResponding());
+    CHECK(health.pollTimedOut(now));
+    CHECK(!health.isResponding());
+    CHECK(health.getNextProbe() == now + modmqttd::ModbusSlaveHealth::MinProbeInterval);
+
+    SECTION ("probe interval should double after failed probe") {
+        CHECK(!health.pollTimedOut(now));
+        CHECK(health.getProbeInterval() == modmqttd::ModbusSlaveHealth::MinProbeInterval * 2);
+        for(int i = 0; i < 20; i++)
+            health.pollTimedOut(now);
+        CHECK(health.getProbeInterval() == modmqttd::ModbusSlaveHealth::MaxProbeInterval);
+    }
+
+    SECTION ("answered probe should restore slave") {
+        CHECK(health.pollAnswered());
+        CHECK(health.isResponding());
+        CHECK(!health.pollAnswered());
+    }
+}
+
+static const std::string config = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+mqtt:
+  client_id: mqtt_test
+  refresh: 100ms
+  broker:
+    host: localhost
+  objects:
+    - topic: one
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: two
+      state:
+        - register: tcptest.2.1
+          register_type: input
+        - register: tcptest.2.10
+          register_type: input
+)";
+
+TEST_CASE ("Dead slave should be unavailable and probed until it responds") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 7);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 13);
+    server.start();
+    server.waitForPublish("one/state", REGWAIT_MSEC);
+    server.waitForPublish("two/availability", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("two/availability") == "1");
+
+    server.disconnectModbusSlave("tcptest", 2);
+    server.waitForPublish("two/availability", std::chrono::seconds(1));
+    REQUIRE(server.mqttValue("two/availability") == "0");
+
+    // healthy slave is still polled
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 8);
+    server.waitForPublish("one/state", std::chrono::seconds(1));
+    REQUIRE(server.mqttValue("one/state") == "8");
+
+    server.disconnectModbusSlave("tcptest", 2, false);
+    // first probe is done after a second
+    server.waitForPublish("two/availability", std::chrono::seconds(3));
+    REQUIRE(server.mqttValue("two/availability") == "1");
+    server.stop();
+}
+
+TEST_CASE ("Dead slave should not be polled after modbus reconnect") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 7);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 13);
+    MockedModbusContext::Slave& slave(server.mModbusFactory->getModbusSlave("tcptest", 2));
+    server.start();
+    server.waitForPublish("two/availability", REGWAIT_MSEC);
+
+    server.disconnectModbusSlave("tcptest", 2);
+    server.waitForPublish("two/availability", std::chrono::seconds(1));
+    REQUIRE(server.mqttValue("two/availability") == "0");
+    int deadReads = slave.mReadCount;
+
+    // initial poll after reconnect should skip suspended registers,
+    // first probe is due a second after suspension
+    server.disconnectModbusNetwork("tcptest");
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    CHECK(slave.mReadCount == deadReads);
+    server.stop();
+}
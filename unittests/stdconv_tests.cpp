@@ -26,3 +26,67 @@ TEST_CASE ("Scale value with integer result") {
 
     REQUIRE(ret.getString() == "100");
 }
+
+class RecordingValueSink : public IMqttValueSink {
+    public:
+        virtual void setInt(int32_t val) { mInt = val; mCalls++; }
+        virtual void setDouble(double) { mCalls++; }
+        virtual void setString(const char*, size_t) { mCalls++; }
+        int32_t mInt = 0;
+        int mCalls = 0;
+};
+
+TEST_CASE ("Int32 value should be converted from register span") {
+    std::string stdconv_path = "../stdconv/stdconv.so";
+
+    boost::shared_ptr<ConverterPlugin> plugin = boost_dll_import<ConverterPlugin>(
+        stdconv_path,
+        "converter_plugin",
+        boost::dll::load_mode::append_decorations
+    );
+
+    std::shared_ptr<IStateConverter> conv(plugin->getStateConverter("int32"));
+    IStateConverterV2* convV2 = dynamic_cast<IStateConverterV2*>(conv.get());
+    REQUIRE(convV2 != nullptr);
+
+    uint16_t registers[] = { 0x1, 0x2 };
+    RecordingValueSink sink;
+    convV2->convert(RegisterSpan(registers, 2), sink);
+    REQUIRE(sink.mCalls == 1);
+    REQUIRE(sink.mInt == 0x10002);
+
+    SECTION ("legacy interface should return the same value") {
+        ModbusRegisters data;
+        data.addValue(0x1);
+        data.addValue(0x2);
+        REQUIRE(conv->toMqtt(data).getString() == "65538");
+    }
+}
+
+TEST_CASE ("Batch conversion should return the same values as single conversion") {
+    std::string stdconv_path = "../stdconv/stdconv.so";
+
+    boost::shared_ptr<ConverterPlugin> plugin = boost_dll_import<ConverterPlugin>(
+        stdconv_path,
+        "converter_plugin",
+        boost::dll::load_mode::append_decorations
+    );
+
+    std::shared_ptr<IStateConverter> conv(plugin->getStateConverter("scale"));
+    conv->setArgs({ "0", "1000", "-10", "10", "2" });
+    IStateConverterV2* convV2 = dynamic_cast<IStateConverterV2*>(conv.get());
+    REQUIRE(convV2 != nullptr);
+
+    // more than one internal chunk
+    std::vector<uint16_t> registers;
+    for(uint16_t i = 0; i < 100; i++)
+        registers.push_back(i * 10);
+    std::vector<MqttValue> values(registers.size());
+    convV2->convertBatch(RegisterSpan(registers.data(), registers.size()), values.data());
+
+    for(size_t i = 0; i < registers.size(); i++) {
+        ModbusRegisters data(registers[i]);
+        REQUIRE(values[i].getString() == conv->toMqtt(data).getString());
+    }
+    CHECK(values[99].getString() == "9.8");
+}
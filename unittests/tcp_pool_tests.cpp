@@ -0,0 +1,135 @@
+#include "catch2/catch.hpp"
+#include "mockedserver.hpp"
+#include "defaults.hpp"
+
+static const std::string config = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+      pool_size: 2
+mqtt:
+  client_id: mqtt_test
+  refresh: 1s
+  broker:
+    host: localhost
+  objects:
+    - topic: one
+      commands:
+        - name: set
+          register: tcptest.1.2
+          register_type: holding
+      state:
+        register: tcptest.1.2
+        register_type: holding
+    - topic: two
+      state:
+        register: tcptest.2.1
+        register_type: input
+    - topic: three
+      state:
+        register: tcptest.3.1
+        register_type: input
+)";
+
+TEST_CASE ("slaves polled by connection pool should publish all values") {
+    MockedModMqttServerThread server(config);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 7);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 13);
+    server.setModbusRegisterValue("tcptest", 3, 1, modmqttd::RegisterType::INPUT, 21);
+    server.start();
+    server.waitForPublish("one/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("one/state") == "7");
+    server.waitForPublish("two/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("two/state") == "13");
+    server.waitForPublish("three/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("three/state") == "21");
+
+    server.publish("one/set", "5");
+    server.waitForPublish("one/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("one/state") == "5");
+    server.stop();
+}
+
+TEST_CASE ("slaves polled with connection per slave should publish all values") {
+    std::string perSlave(config);
+    perSlave.replace(perSlave.find("pool_size: 2"), 12, "pool_size: per_slave");
+
+    MockedModMqttServerThread server(perSlave);
+    server.setModbusRegisterValue("tcptest", 1, 2, modmqttd::RegisterType::HOLDING, 7);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 13);
+    server.setModbusRegisterValue("tcptest", 3, 1, modmqttd::RegisterType::INPUT, 21);
+    server.start();
+    server.waitForPublish("one/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("one/state") == "7");
+    server.waitForPublish("two/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("two/state") == "13");
+    server.waitForPublish("three/state", REGWAIT_MSEC);
+    REQUIRE(server.mqttValue("three/state") == "21");
+    server.stop();
+}
+
+TEST_CASE ("pool size for RTU network should be rejected") {
+    static const std::string rtuConfig = R"(
+modbus:
+  networks:
+    - name: rtutest
+      device: /dev/ttyUSB0
+      baud: 9600
+      parity: E
+      data_bit: 8
+      stop_bit: 1
+      pool_size: 2
+)";
+    YAML::Node node = YAML::Load(rtuConfig);
+    REQUIRE_THROWS_AS(modmqttd::ModbusNetworkConfig(node["modbus"]["networks"][0]), modmqttd::ConfigurationException);
+}
+
+TEST_CASE ("slow slave should not delay slave polled by other connection") {
+    static const std::string slowConfig = R"(
+modbus:
+  networks:
+    - name: tcptest
+      address: localhost
+      port: 501
+      pool_size: 2
+mqtt:
+  client_id: mqtt_test
+  refresh: 50ms
+  broker:
+    host: localhost
+  objects:
+    - topic: slow
+      state:
+        register: tcptest.1.1
+        register_type: input
+    - topic: fast
+      state:
+        register: tcptest.2.1
+        register_type: input
+)";
+
+    MockedModMqttServerThread server(slowConfig);
+    MockedModbusContext::Slave& slow(server.mModbusFactory->getModbusSlave("tcptest", 1));
+    MockedModbusContext::Slave& fast(server.mModbusFactory->getModbusSlave("tcptest", 2));
+    // every read of slave 1 blocks its connection for 500ms
+    slow.mReadTime = std::chrono::milliseconds(500);
+    server.setModbusRegisterValue("tcptest", 1, 1, modmqttd::RegisterType::INPUT, 1);
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 2);
+    server.start();
+    server.waitForPublish("fast/state", REGWAIT_MSEC);
+    server.waitForPublish("slow/state", std::chrono::milliseconds(1000));
+
+    int fastReads = fast.mReadCount;
+    int slowReads = slow.mReadCount;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    // slave 2 keeps 50ms refresh, slave 1 is read at most three times
+    CHECK(fast.mReadCount - fastReads >= 10);
+    CHECK(slow.mReadCount - slowReads <= 3);
+
+    server.setModbusRegisterValue("tcptest", 2, 1, modmqttd::RegisterType::INPUT, 3);
+    server.waitForPublish("fast/state", std::chrono::milliseconds(200));
+    REQUIRE(server.mqttValue("fast/state") == "3");
+    server.stop();
+}
@@ -0,0 +1,51 @@
+#include "catch2/catch.hpp"
+#include "libmodmqttsrv/topic_alias_table.hpp"
+
+TEST_CASE ("Topic aliases should be assigned up to limit from broker") {
+    modmqttd::TopicAliasTable aliases;
+    bool isNew = true;
+
+    SECTION ("no aliases before connect") {
+        CHECK(aliases.getAlias("a/state", isNew) == 0);
+        CHECK(!isNew);
+    }
+
+    // topic alias maximum from CONNACK
+    aliases.reset(2);
+
+    SECTION ("alias should be reused for the same topic") {
+        CHECK(aliases.getAlias("a/state", isNew) == 1);
+        CHECK(isNew);
+        CHECK(aliases.getAlias("a/state", isNew) == 1);
+        CHECK(!isNew);
+    }
+
+    SECTION ("topic should be sent without alias when limit is reached") {
+        CHECK(aliases.getAlias("a/state", isNew) == 1);
+        CHECK(aliases.getAlias("b/state", isNew) == 2);
+        CHECK(aliases.getAlias("c/state", isNew) == 0);
+        CHECK(!isNew);
+        CHECK(aliases.getAlias("b/state", isNew) == 2);
+    }
+
+    SECTION ("aliases should be assigned again after reconnect") {
+        CHECK(aliases.getAlias("a/state", isNew) == 1);
+        CHECK(aliases.getAlias("b/state", isNew) == 2);
+
+        aliases.reset(1);
+        CHECK(aliases.getMaximum() == 1);
+        CHECK(aliases.getAlias("b/state", isNew) == 1);
+        CHECK(isNew);
+        CHECK(aliases.getAlias("a/state", isNew) == 0);
+
+        aliases.reset(0);
+        CHECK(aliases.getAlias("b/state", isNew) == 0);
+    }
+
+    SECTION ("removed topic should get new alias") {
+        CHECK(aliases.getAlias("a/state", isNew) == 1);
+        aliases.remove("a/state");
+        CHECK(aliases.getAlias("a/state", isNew) == 2);
+        CHECK(isNew);
+    }
+}